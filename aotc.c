@@ -0,0 +1,610 @@
+#include "ext/cart.h"
+#include "soc/cpu_common.h"
+#include "soc/instr/instrs.h"
+#include "soc/soc.h"
+#include "types.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* gbemu-aot: walks the code reachable from the entry point, the RST vectors
+ * and the interrupt vectors, and writes a C file with one function per block.
+ * the blocks are cut exactly like the block cache does, so that the emulator
+ * can attach them to its own blocks */
+
+/* a discovered block */
+typedef struct aot_src {
+    uint16_t pc;
+    unsigned bank;
+    uint16_t end;
+    unsigned len;
+    uint16_t pcs[BCACHE_BLOCK_LEN];
+    cpu_op_t ops[BCACHE_BLOCK_LEN];
+} aot_src_t;
+
+/* the state of the walk */
+typedef struct aotc {
+    cart_t *cart;
+
+    /* the switchable banks: the value written to the MBC and the bank the
+     * emulator sees as a result */
+    uint8_t type;
+    unsigned nbanks;
+    unsigned *sel, *keys;
+    unsigned cur_sel;
+
+    /* the blocks seen so far, one bit per bank and address */
+    uint8_t *seen;
+    unsigned max_key;
+
+    /* discovered blocks, which double as the work queue */
+    aot_src_t *blocks;
+    size_t nblocks, cap;
+
+    /* a CPU only to resolve the decoded operands against */
+    cpu_t cpu;
+} aotc_t;
+
+static const char *_r_names[8] = {
+    "bc.hi", "bc.lo", "de.hi", "de.lo", "hl.hi", "hl.lo", NULL, "af.hi"
+};
+
+/* NZ, Z, NC, C. flipping bit 0 gives the opposite condition. Z is set when
+ * the result is zero */
+static const char *_cc_conds[4] = {
+    "cpu->flags.res", "!cpu->flags.res",
+    "!cpu->flags.carry", "cpu->flags.carry"
+};
+
+/* select a bank at 0x4000 the way the MBC wants it. the bank number only fits
+ * in 0x2000 - 0x3FFF on its own up to 256 banks */
+static void
+_aotc_select(aotc_t *aotc, unsigned sel)
+{
+    cart_t *cart = aotc->cart;
+    switch (aotc->type) {
+        case 0x01:
+        case 0x02:
+        case 0x03:
+            /* MBC1 takes the upper 2 bits at 0x4000 - 0x5FFF */
+            cart->write_rom(cart, 0x2000, sel & 0x1F);
+            cart->write_rom(cart, 0x4000, (sel >> 5) & 0x03);
+            break;
+        case 0x19:
+        case 0x1A:
+        case 0x1B:
+        case 0x1C:
+        case 0x1D:
+        case 0x1E:
+            /* MBC5 takes the 9th bit at 0x3000 - 0x3FFF */
+            cart->write_rom(cart, 0x2000, sel & 0xFF);
+            cart->write_rom(cart, 0x3000, (sel >> 8) & 0x01);
+            break;
+        default:
+            cart->write_rom(cart, 0x2000, sel);
+            break;
+    }
+}
+
+static uint8_t
+_aotc_read(aotc_t *aotc, unsigned bank, uint16_t addr)
+{
+    /* the fixed bank is always there */
+    if (addr < 0x4000)
+        return aotc->cart->read_rom(aotc->cart, addr);
+
+    /* switch to the right bank first */
+    for (size_t i = 0; i < aotc->nbanks; ++i) {
+        if (aotc->keys[i] != bank)
+            continue;
+        if (aotc->cur_sel != aotc->sel[i]) {
+            _aotc_select(aotc, aotc->sel[i]);
+            aotc->cur_sel = aotc->sel[i];
+        }
+        break;
+    }
+
+    return aotc->cart->read_rom(aotc->cart, addr);
+}
+
+static bool
+_aotc_mark(aotc_t *aotc, unsigned bank, uint16_t pc)
+{
+    /* returns whether the block is new */
+    size_t idx = (size_t)bank * 0x8000 + pc;
+    if (aotc->seen[idx >> 3] & (1 << (idx & 7)))
+        return false;
+
+    aotc->seen[idx >> 3] |= 1 << (idx & 7);
+    return true;
+}
+
+static void
+_aotc_add(aotc_t *aotc, unsigned bank, uint16_t pc)
+{
+    /* only ROM is known in advance */
+    if (pc >= 0x8000)
+        return;
+
+    /* the fixed bank has no bank to speak of */
+    if (pc < 0x4000)
+        bank = 0;
+
+    if (!_aotc_mark(aotc, bank, pc))
+        return;
+
+    if (aotc->nblocks == aotc->cap) {
+        aotc->cap = aotc->cap ? aotc->cap * 2 : 256;
+        aotc->blocks = realloc(aotc->blocks, aotc->cap * sizeof(aot_src_t));
+        if (!aotc->blocks)
+            gb_die(errno);
+    }
+
+    aot_src_t *block = &aotc->blocks[aotc->nblocks++];
+    block->pc = pc;
+    block->bank = bank;
+}
+
+/* a jump from a block to somewhere else in ROM */
+static void
+_aotc_add_target(aotc_t *aotc, aot_src_t *from, uint16_t pc)
+{
+    /* code in a switchable bank jumps within it. code in the fixed bank might
+     * jump into any of them */
+    if (pc >= 0x4000 && pc < 0x8000 && from->pc < 0x4000) {
+        for (size_t i = 0; i < aotc->nbanks; ++i)
+            _aotc_add(aotc, aotc->keys[i], pc);
+        return;
+    }
+
+    _aotc_add(aotc, from->bank, pc);
+}
+
+static void
+_aotc_build(aotc_t *aotc, aot_src_t *block)
+{
+    /* this is _bcache_build() over the ROM file */
+    uint16_t end = block->pc < 0x4000 ? 0x4000 : 0x8000;
+    uint16_t addr = block->pc;
+
+    block->len = 0;
+    while (block->len < BCACHE_BLOCK_LEN) {
+        uint8_t ir = _aotc_read(aotc, block->bank, addr);
+        unsigned len = cpu_instr_len(ir);
+        if (end - addr < len)
+            break;
+
+        cpu_op_t *op = &block->ops[block->len];
+        cpu_decode(op, ir);
+        if (ir == 0xCB)
+            cpu_decode_cb(op, _aotc_read(aotc, block->bank, addr + 1));
+
+        block->pcs[block->len++] = addr;
+        addr += len;
+
+        if (cpu_instr_ends_block(ir) || addr == end)
+            break;
+    }
+    block->end = addr;
+}
+
+static void
+_aotc_walk(aotc_t *aotc, aot_src_t *block)
+{
+    /* find out where the block goes */
+    for (size_t i = 0; i < block->len; ++i) {
+        const cpu_op_t *op = &block->ops[i];
+        fn_list_t list = cpu_op_group(op);
+        uint16_t pc = block->pcs[i];
+        uint16_t next = pc + cpu_instr_len(op->ir);
+        uint8_t n = _aotc_read(aotc, block->bank, pc + 1);
+        uint16_t nn = n | _aotc_read(aotc, block->bank, pc + 2) << 8;
+
+        if (list == jr_e || list == jr_cc_e)
+            _aotc_add_target(aotc, block, next + (int8_t)n);
+        else if (list == jp_nn || list == jp_cc_nn || list == call_nn ||
+                list == call_cc_nn)
+            _aotc_add_target(aotc, block, nn);
+        else if (list == rst_n)
+            _aotc_add_target(aotc, block, OP_N(op->ir) * 0x08);
+
+        /* conditionals fall through, calls come back and HALT and STOP
+         * just wait */
+        if (list == jr_cc_e || list == jp_cc_nn || list == call_nn ||
+                list == call_cc_nn || list == ret_cc || list == rst_n ||
+                list == halt || list == stop)
+            _aotc_add_target(aotc, block, next);
+    }
+
+    /* a block cut short continues with the next one */
+    if (!cpu_instr_ends_block(block->ops[block->len - 1].ir))
+        _aotc_add_target(aotc, block, block->end);
+}
+
+static const char *
+_aotc_rr(aotc_t *aotc, const reg_t *rr)
+{
+    if (rr == &aotc->cpu.af)
+        return "af";
+    if (rr == &aotc->cpu.bc)
+        return "bc";
+    if (rr == &aotc->cpu.de)
+        return "de";
+    if (rr == &aotc->cpu.hl)
+        return "hl";
+    return "sp";
+}
+
+/* call the micro-op handlers of an instruction as they are */
+static void
+_aotc_emit_handlers(FILE *out, unsigned i, const char *field, fn_list_t list,
+        unsigned first)
+{
+    fprintf(out, "    cpu->op = &ops[%u];\n", i);
+    for (unsigned k = first; list[k].fn; ++k)
+        fprintf(out, "    cpu_op_%s(&ops[%u])[%u].fn(cpu);\n", field, i, k);
+}
+
+/* emit one instruction. returns its machine cycles (the longest path for
+ * jumps) or -1 if it has to be interpreted. *ends is set if the block has been
+ * left */
+static int
+_aotc_emit_instr(aotc_t *aotc, FILE *out, aot_src_t *block, unsigned i,
+        unsigned cycles, bool *ends)
+{
+    const cpu_op_t *op = &block->ops[i];
+    uint16_t pc = block->pcs[i];
+    uint8_t n = _aotc_read(aotc, block->bank, pc + 1);
+    uint16_t nn = n | _aotc_read(aotc, block->bank, pc + 2) << 8;
+    xlat_t x;
+    if (!cpu_translate(op, pc, n, nn, &x))
+        return -1;
+
+    const char *src = _r_names[op->ir & 0x07];
+    const char *dst = _r_names[(op->ir & 0x38) >> 3];
+    const char *rr = _aotc_rr(aotc, cpu_op_rr(&aotc->cpu, op->ir));
+    const char *field = op->ir == 0xCB ? "cb_list" : "list";
+    unsigned taken = cycles + x.mcycles, len = block->len;
+
+    *ends = x.ends;
+
+    /* a failed access leaves before the instruction */
+#define CHECK(expr) \
+    fprintf(out, "    if ((" expr ") < 0)\n" \
+            "        EXIT(0x%04X, %u, %u);\n", pc, cycles, i)
+
+    /* a failed condition leaves for the next instruction */
+    if (x.cc >= 0)
+        fprintf(out, "    if (%s)\n"
+                "        EXIT(0x%04X, %u, %u);\n", _cc_conds[x.cc ^ 1],
+                x.next, cycles + x.skip_mcycles, len);
+
+    switch (x.kind) {
+        case XLAT_NOP:
+            break;
+
+        case XLAT_LD_R_R:
+            fprintf(out, "    cpu->%s = cpu->%s;\n", dst, src);
+            break;
+
+        case XLAT_LD_R_N:
+            fprintf(out, "    cpu->%s = 0x%02X;\n", dst, n);
+            break;
+
+        case XLAT_LD_R_IHL:
+            CHECK("v = cpu_native_read(cpu, cpu->hl.val)");
+            fprintf(out, "    cpu->%s = v;\n", dst);
+            break;
+
+        case XLAT_LD_IHL_R:
+            fprintf(out, "    if (cpu_native_write(cpu, cpu->hl.val, cpu->%s) < 0)\n"
+                    "        EXIT(0x%04X, %u, %u);\n", src, pc, cycles, i);
+            break;
+
+        case XLAT_LD_IHL_N:
+            fprintf(out, "    if (cpu_native_write(cpu, cpu->hl.val, 0x%02X) < 0)\n"
+                    "        EXIT(0x%04X, %u, %u);\n", n, pc, cycles, i);
+            break;
+
+        case XLAT_LD_A_IRR:
+        case XLAT_LD_IRR_A:
+            if (x.kind == XLAT_LD_A_IRR)
+                fprintf(out, "    if ((v = cpu_native_read(cpu, cpu->%s.val)) < 0)\n"
+                        "        EXIT(0x%04X, %u, %u);\n"
+                        "    cpu->af.hi = v;\n", rr, pc, cycles, i);
+            else
+                fprintf(out, "    if (cpu_native_write(cpu, cpu->%s.val, cpu->af.hi) < 0)\n"
+                        "        EXIT(0x%04X, %u, %u);\n", rr, pc, cycles, i);
+            if (x.step)
+                fprintf(out, "    %scpu->hl.val;\n", x.step > 0 ? "++" : "--");
+            break;
+
+        case XLAT_LD_A_ADDR:
+            fprintf(out, "    if ((v = cpu_native_read(cpu, 0x%04X)) < 0)\n"
+                    "        EXIT(0x%04X, %u, %u);\n"
+                    "    cpu->af.hi = v;\n", x.addr, pc, cycles, i);
+            break;
+
+        case XLAT_LD_ADDR_A:
+            fprintf(out, "    if (cpu_native_write(cpu, 0x%04X, cpu->af.hi) < 0)\n"
+                    "        EXIT(0x%04X, %u, %u);\n", x.addr, pc, cycles, i);
+            break;
+
+        case XLAT_LD_RR_NN:
+            fprintf(out, "    cpu->%s.val = 0x%04X;\n", rr, nn);
+            break;
+
+        case XLAT_LD_SP_HL:
+            fprintf(out, "    cpu->sp.val = cpu->hl.val;\n");
+            break;
+
+        case XLAT_PUSH:
+            /* F has to be worked out first */
+            if (!strcmp(rr, "af"))
+                fprintf(out, "    _cpu_flags(cpu);\n");
+            fprintf(out, "    if (cpu_native_push(cpu, cpu->sp.val, cpu->%s.val) < 0)\n"
+                    "        EXIT(0x%04X, %u, %u);\n"
+                    "    cpu->sp.val -= 2;\n", rr, pc, cycles, i);
+            break;
+
+        case XLAT_POP:
+            CHECK("v = cpu_native_pop(cpu, cpu->sp.val)");
+            fprintf(out, "    cpu->sp.val += 2;\n"
+                    "    cpu->%s.val = v;\n", rr);
+            if (!strcmp(rr, "af"))
+                fprintf(out, "    _cpu_set_flags(cpu, cpu->af.lo);\n");
+            break;
+
+        case XLAT_ADD_RR:
+            fprintf(out, "    %scpu->%s.val;\n", x.step > 0 ? "++" : "--", rr);
+            break;
+
+        case XLAT_HANDLERS:
+        case XLAT_HANDLERS_N:
+        case XLAT_HANDLERS_IHL:
+            if (x.kind == XLAT_HANDLERS_N)
+                fprintf(out, "    cpu->wz.lo = 0x%02X;\n", n);
+            else if (x.kind == XLAT_HANDLERS_IHL)
+                CHECK("cpu_native_read_z(cpu, cpu->hl.val)");
+            _aotc_emit_handlers(out, i, field, x.list, x.first);
+            break;
+
+        case XLAT_RMW_IHL:
+            fprintf(out, "    cpu->op = &ops[%u];\n", i);
+            fprintf(out, "    if (cpu_native_rmw(cpu, cpu->hl.val, cpu_op_%s(&ops[%u])[%u].fn) < 0)\n"
+                    "        EXIT(0x%04X, %u, %u);\n", field, i, x.first,
+                    pc, cycles, i);
+            break;
+
+        case XLAT_JUMP:
+            fprintf(out, "    EXIT(0x%04X, %u, %u);\n", x.addr, taken, len);
+            break;
+
+        case XLAT_JUMP_HL:
+            fprintf(out, "    EXIT(cpu->hl.val, %u, %u);\n", taken, len);
+            break;
+
+        case XLAT_CALL:
+            fprintf(out, "    if (cpu_native_push(cpu, cpu->sp.val, 0x%04X) < 0)\n"
+                    "        EXIT(0x%04X, %u, %u);\n"
+                    "    cpu->sp.val -= 2;\n"
+                    "    EXIT(0x%04X, %u, %u);\n", x.next, pc, cycles, i,
+                    x.addr, taken, len);
+            break;
+
+        case XLAT_RET:
+            CHECK("v = cpu_native_pop(cpu, cpu->sp.val)");
+            fprintf(out, "    cpu->sp.val += 2;\n"
+                    "    EXIT(v, %u, %u);\n", taken, len);
+            break;
+    }
+
+#undef CHECK
+
+    return x.mcycles;
+}
+
+/* returns the maximum machine cycles, or 0 if nothing could be compiled */
+static unsigned
+_aotc_emit_block(aotc_t *aotc, FILE *file, aot_src_t *block)
+{
+    /* the block is only written out if there's something in it */
+    char *buf;
+    size_t size;
+    FILE *out = open_memstream(&buf, &size);
+    if (!out)
+        gb_die(errno);
+
+    /* the handlers' names double as mnemonics */
+    fprintf(out, "static unsigned\n"
+            "_aot_%u_%04X(cpu_t *cpu, const cpu_op_t *ops)\n"
+            "{\n"
+            "    int v = 0;\n"
+            "    (void)v;\n", block->bank, block->pc);
+
+    unsigned cycles = 0, i;
+    bool ends = false;
+    for (i = 0; i < block->len && !ends; ++i) {
+        const cpu_op_t *op = &block->ops[i];
+        const char *name = op->ir == 0xCB ? cpu_op_cb_list(op)[1].name :
+            cpu_op_list(op)[0].name;
+        if (name) {
+            int len = strcspn(name, "[");
+            while (len && name[len - 1] == ' ')
+                --len;
+            fprintf(out, "\n    /* 0x%04X: %.*s */\n", block->pcs[i], len,
+                    name);
+        }
+
+        int c = _aotc_emit_instr(aotc, out, block, i, cycles, &ends);
+        if (c < 0)
+            break;
+        cycles += c;
+    }
+
+    /* whatever is left of the block goes back to the interpreter */
+    if (!ends)
+        fprintf(out, "    EXIT(0x%04X, %u, %u);\n",
+                i < block->len ? block->pcs[i] : block->end, cycles, i);
+    fprintf(out, "}\n\n");
+    fclose(out);
+
+    /* not even the first instruction could be compiled */
+    if (!cycles) {
+        free(buf);
+        return 0;
+    }
+
+    fwrite(buf, 1, size, file);
+    free(buf);
+    return cycles;
+}
+
+static int
+_aotc_cmp(const void *a, const void *b)
+{
+    const aot_src_t *x = a, *y = b;
+    if (x->bank != y->bank)
+        return x->bank < y->bank ? -1 : 1;
+    return (int)x->pc - (int)y->pc;
+}
+
+static void
+_aotc_setup_banks(aotc_t *aotc)
+{
+    /* the ROM size is 32KiB << n */
+    aotc->type = aotc->cart->read_rom(aotc->cart, 0x0147);
+    uint8_t size = aotc->cart->read_rom(aotc->cart, 0x0148);
+    aotc->nbanks = (2u << size) - 1;
+    aotc->sel = malloc(aotc->nbanks * sizeof(unsigned));
+    aotc->keys = malloc(aotc->nbanks * sizeof(unsigned));
+    if (!aotc->sel || !aotc->keys)
+        gb_die(errno);
+
+    /* ask the cart which bank each selection ends up in */
+    aotc->max_key = 0;
+    unsigned count = 0;
+    for (unsigned sel = 1; sel <= aotc->nbanks; ++sel) {
+        _aotc_select(aotc, sel);
+        unsigned key = aotc->cart->bank(aotc->cart, 0x4000);
+
+        bool dup = false;
+        for (unsigned i = 0; i < count; ++i)
+            dup |= aotc->keys[i] == key;
+        if (dup)
+            continue;
+
+        aotc->sel[count] = sel;
+        aotc->keys[count++] = key;
+        if (key > aotc->max_key)
+            aotc->max_key = key;
+    }
+    aotc->nbanks = count;
+    aotc->cur_sel = 0;
+
+    aotc->seen = calloc((aotc->max_key + 1) * 0x8000 / 8, 1);
+    if (!aotc->seen)
+        gb_die(errno);
+}
+
+int
+main(int argc, char *argv[])
+{
+    if (argc < 3) {
+        fprintf(stderr, "usage: %s <rom> <output.c>\n", argv[0]);
+        return 1;
+    }
+
+    aotc_t aotc;
+    memset(&aotc, 0, sizeof(aotc));
+    if (cart_create(&aotc.cart, argv[1]) != GBEMU_SUCCESS) {
+        fprintf(stderr, "can't open cart!\n");
+        return 1;
+    }
+    _aotc_setup_banks(&aotc);
+
+    /* the entry point, the RST vectors and the interrupt vectors */
+    _aotc_add(&aotc, 0, 0x0100);
+    for (uint16_t pc = 0x0000; pc <= 0x0060; pc += 0x08)
+        _aotc_add(&aotc, 0, pc);
+
+    /* the discovered blocks are the queue. the walk adds more of them, which
+     * can move the queue around, so it gets a copy of the block */
+    for (size_t i = 0; i < aotc.nblocks; ++i) {
+        _aotc_build(&aotc, &aotc.blocks[i]);
+        aot_src_t block = aotc.blocks[i];
+        if (block.len)
+            _aotc_walk(&aotc, &block);
+    }
+    qsort(aotc.blocks, aotc.nblocks, sizeof(aot_src_t), _aotc_cmp);
+
+    FILE *out = fopen(argv[2], "w");
+    if (!out) {
+        fprintf(stderr, "can't open %s!\n", argv[2]);
+        return 1;
+    }
+
+    /* the file is built against the core */
+    char title[17];
+    for (size_t i = 0; i < 16; ++i)
+        title[i] = aotc.cart->read_rom(aotc.cart, 0x0134 + i);
+    title[16] = '\0';
+    fprintf(out, "/* generated by gbemu-aot, do not edit */\n"
+            "#include \"soc/cpu_common.h\"\n"
+            "#include \"soc/instr/instrs.h\"\n"
+            "#include \"soc/soc.h\"\n\n"
+            "#define EXIT(to, cycles, idx) \\\n"
+            "    return (cpu->pc.val = (to), NATIVE_RET(cycles, idx))\n\n");
+
+    unsigned *cycles = malloc(aotc.nblocks * sizeof(unsigned));
+    if (!cycles && aotc.nblocks)
+        gb_die(errno);
+    size_t compiled = 0;
+    for (size_t i = 0; i < aotc.nblocks; ++i) {
+        if (!aotc.blocks[i].len) {
+            cycles[i] = 0;
+            continue;
+        }
+        cycles[i] = _aotc_emit_block(&aotc, out, &aotc.blocks[i]);
+        compiled += !!cycles[i];
+    }
+
+    /* the table the emulator looks the blocks up in */
+    fprintf(out, "static const aot_block_t _aot_blocks[] = {\n");
+    for (size_t i = 0; i < aotc.nblocks; ++i) {
+        aot_src_t *block = &aotc.blocks[i];
+        if (!cycles[i])
+            continue;
+        fprintf(out, "    { 0x%04X, %u, 0x%04X, %u, %u, _aot_%u_%04X },\n",
+                block->pc, block->bank, block->end, block->len, cycles[i],
+                block->bank, block->pc);
+    }
+    if (!compiled)
+        fprintf(out, "    { 0 }\n");
+    fprintf(out, "};\n\n");
+
+    fprintf(out, "const aot_image_t aot_image = {\n"
+            "    .title = {");
+    for (size_t i = 0; i < 16; ++i)
+        fprintf(out, "%s0x%02X", i ? ", " : " ", (uint8_t)title[i]);
+    fprintf(out, " },\n"
+            "    .header_checksum = 0x%02X,\n"
+            "    .global_checksum = 0x%04X,\n"
+            "    .nblocks = %zu,\n"
+            "    .blocks = _aot_blocks,\n"
+            "};\n", aotc.cart->read_rom(aotc.cart, 0x014D),
+            aotc.cart->read_rom(aotc.cart, 0x014E) << 8 |
+            aotc.cart->read_rom(aotc.cart, 0x014F), compiled);
+    fclose(out);
+
+    printf("%zu blocks found, %zu compiled\n", aotc.nblocks, compiled);
+
+    free(cycles);
+    free(aotc.blocks);
+    free(aotc.seen);
+    free(aotc.sel);
+    free(aotc.keys);
+    cart_destroy(aotc.cart);
+    return 0;
+}
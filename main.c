@@ -13,9 +13,11 @@
 static void
 print_cpu_state(cpu_t *cpu)
 {
+    /* the flags are only worked out when asked for */
+    uint8_t f = _cpu_flags(cpu);
     printf("==========================\n");
     printf("Flags: Z=%d, N=%d, H=%d, C=%d\n",
-            FLAG(7), FLAG(6), FLAG(5), FLAG(4));
+            (f >> 7) & 1, (f >> 6) & 1, (f >> 5) & 1, (f >> 4) & 1);
     printf("AF: 0x%04X\n", cpu->af.val);
     printf("BC: 0x%04X\n", cpu->bc.val);
     printf("DE: 0x%04X\n", cpu->de.val);
@@ -91,12 +93,20 @@ int main(int argc, char *argv[])
         fprintf(stderr, "can't open cart!\n");
         return 1;
     }
-    mem64_t *mem = malloc(sizeof(mem64_t));
-    mem64_t *vram = malloc(sizeof(mem64_t));
+    mem8k_t *mem = malloc(sizeof(mem8k_t));
+    mem8k_t *vram = malloc(sizeof(mem8k_t));
 
     bus_t *bus = ext_bus_create(mem, cart);
     bus_t *vid_bus = vid_bus_create(vram);
     soc_t *soc = soc_create((bus_t *)bus, (bus_t *)vid_bus);
+    if (!soc) {
+        fprintf(stderr, "can't create the SoC!\n");
+        return 1;
+    }
+
+    /* the clock on the cart (if any) only counts emulated time, so that runs
+     * can be repeated */
+    cart_set_clock(cart, &soc->timestamp, CART_CLOCK_EMULATED);
 
     while (true) {
         while (soc->cpu->curpc.val != 0x16d) {
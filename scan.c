@@ -0,0 +1,136 @@
+/* nftw() */
+#define _XOPEN_SOURCE 700
+
+#include "ext/scan.h"
+#include "types.h"
+
+#include <ftw.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+
+/* gbemu-scan: finds the ROMs under the given files and directories, reads
+ * their headers in parallel and writes the library index. -l lists an
+ * existing index instead */
+
+static const char **_paths;
+static size_t _npaths, _cap;
+
+static void
+_add_path(const char *path)
+{
+    if (_npaths == _cap) {
+        _cap = _cap ? _cap * 2 : 1024;
+        _paths = realloc(_paths, _cap * sizeof(*_paths));
+        if (!_paths)
+            gb_die(errno);
+    }
+    _paths[_npaths] = strdup(path);
+    if (!_paths[_npaths++])
+        gb_die(errno);
+}
+
+static int
+_walk(const char *path, const struct stat *st, int flag, struct FTW *ftw)
+{
+    /* only files that look like ROMs */
+    const char *ext = strrchr(path + ftw->base, '.');
+    if (flag == FTW_F && ext &&
+            (!strcasecmp(ext, ".gb") || !strcasecmp(ext, ".gbc")))
+        _add_path(path);
+    return 0;
+}
+
+static const char *
+_status(const scan_entry_t *entry)
+{
+    switch (entry->status) {
+        case GBEMU_SUCCESS:
+            return "ok";
+        case GBEMU_BAD_FILE:
+            return "bad file";
+        default:
+            return entry->flags & SCAN_CHECKSUM_OK ? "unsupported" :
+                "bad checksum";
+    }
+}
+
+static int
+_list(const char *index)
+{
+    scan_index_t idx;
+    if (scan_index_open(&idx, index) != GBEMU_SUCCESS) {
+        fprintf(stderr, "can't open %s!\n", index);
+        return 1;
+    }
+
+    for (size_t i = 0; i < idx.count; ++i) {
+        const scan_entry_t *entry = &idx.entries[i];
+        printf("%-16.16s type %02X rom %4u ram %2u %-12s %s\n", entry->title,
+                entry->type, entry->nbanks, entry->nrams, _status(entry),
+                scan_index_path(&idx, entry));
+    }
+    scan_index_close(&idx);
+    return 0;
+}
+
+int
+main(int argc, char *argv[])
+{
+    unsigned nthreads = 0;
+    bool list = false;
+    int opt;
+    while ((opt = getopt(argc, argv, "j:l")) != -1) {
+        switch (opt) {
+            case 'j':
+                nthreads = atoi(optarg);
+                break;
+            case 'l':
+                list = true;
+                break;
+            default:
+                goto usage;
+        }
+    }
+
+    if (list && optind + 1 == argc)
+        return _list(argv[optind]);
+    if (list || optind + 2 > argc)
+        goto usage;
+
+    /* collect the ROMs */
+    const char *index = argv[optind++];
+    for (; optind < argc; ++optind) {
+        if (nftw(argv[optind], _walk, 32, FTW_PHYS)) {
+            fprintf(stderr, "can't walk %s!\n", argv[optind]);
+            return 1;
+        }
+    }
+
+    if (scan_library(_paths, _npaths, nthreads, index) != GBEMU_SUCCESS) {
+        fprintf(stderr, "can't write %s!\n", index);
+        return 1;
+    }
+
+    /* see how it went */
+    scan_index_t idx;
+    size_t runnable = 0;
+    if (scan_index_open(&idx, index) == GBEMU_SUCCESS) {
+        for (size_t i = 0; i < idx.count; ++i)
+            runnable += idx.entries[i].status == GBEMU_SUCCESS;
+        scan_index_close(&idx);
+    }
+    printf("%zu ROMs scanned, %zu can be run\n", _npaths, runnable);
+
+    for (size_t i = 0; i < _npaths; ++i)
+        free((char *)_paths[i]);
+    free(_paths);
+    return 0;
+
+usage:
+    fprintf(stderr, "usage: %s [-j threads] <index> <rom or dir>...\n"
+            "       %s -l <index>\n", argv[0], argv[0]);
+    return 1;
+}
@@ -16,10 +16,12 @@
 static void
 print_cpu_state(cpu_t *cpu)
 {
+    /* the flags are only worked out when asked for */
+    uint8_t f = _cpu_flags(cpu);
     printf("==========================\n");
     printf("AF: 0x%04X\n", cpu->af.val);
     printf("Flags: Z=%d, N=%d, H=%d, C=%d\n",
-            FLAG(7), FLAG(6), FLAG(5), FLAG(4));
+            (f >> 7) & 1, (f >> 6) & 1, (f >> 5) & 1, (f >> 4) & 1);
     printf("BC: 0x%04X\n", cpu->bc.val);
     printf("DE: 0x%04X\n", cpu->de.val);
     printf("HL: 0x%04X\n", cpu->hl.val);
@@ -85,12 +87,29 @@ int main(int argc, char *argv[])
         exit(1);
     }
 
-    mem64_t *mem = malloc(sizeof(mem64_t));
-    mem64_t *vram = malloc(sizeof(mem64_t));
+    /* the save sits next to the ROM, with a .sav extension */
+    char save[strlen(argv[1]) + sizeof(".sav")];
+    strcpy(save, argv[1]);
+    char *ext = strrchr(save, '.');
+    if (ext && !strchr(ext, '/'))
+        *ext = '\0';
+    strcat(save, ".sav");
+    if (cart_load_save(cart, save) != GBEMU_SUCCESS)
+        fprintf(stderr, "can't open save, progress won't be kept\n");
+
+    mem8k_t *mem = malloc(sizeof(mem8k_t));
+    mem8k_t *vram = malloc(sizeof(mem8k_t));
 
     bus_t *bus = ext_bus_create(mem, cart);
     bus_t *vid_bus = vid_bus_create(vram);
     soc_t *soc = soc_create((bus_t *)bus, (bus_t *)vid_bus);
+    if (!soc) {
+        fprintf(stderr, "error creating the SoC\n");
+        exit(1);
+    }
+
+    /* the clock on the cart (if any) runs along with the SoC */
+    cart_set_clock(cart, &soc->timestamp, CART_CLOCK_REALTIME);
 
     if (SDL_Init(SDL_INIT_VIDEO)) {
         SDL_Log("unable to initialize SDL: %s", SDL_GetError());
@@ -180,9 +199,12 @@ int main(int argc, char *argv[])
             return 1;
         }
         assert(pitch * WIN_HEIGHT == sizeof(pixels));
-        memcpy(texture_pixels, soc->ppu->screen, pitch * WIN_HEIGHT);
+        ppu_blit(soc->ppu, texture_pixels, pitch);
         SDL_UnlockTexture(texture);
 
+        /* write back whatever the game saved this frame */
+        cart_flush(cart);
+
         SDL_RenderClear(renderer);
         SDL_RenderCopy(renderer, texture, NULL, NULL);
         SDL_RenderPresent(renderer);
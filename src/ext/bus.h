@@ -5,22 +5,33 @@
 #include "mem.h"
 
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 
 /* bus_t struct:
  * this represents a generic 16-bit addressable bus with an 8-bit word. it
  * offers the methods read() and write(), which depend on the implementation.
  * 'cs' is the chip select parameter, which is sent alongside the read/write
- * signals */
+ * signals. bank() tells which bank is currently mapped at an address, so that
+ * whoever caches the bus contents can tell two banks apart. map() returns the
+ * host memory behind the 256-byte page at an address, if reading (or writing)
+ * it is nothing more than a memory access. it returns NULL otherwise. usage()
+ * tells how much host memory the bus and whatever is behind it take. both may
+ * be left NULL */
 typedef struct bus {
     uint8_t (*read)(struct bus *bus, uint16_t addr, bool cs);
     void    (*write)(struct bus *bus, uint16_t addr, bool cs, uint8_t val);
+    unsigned (*bank)(struct bus *bus, uint16_t addr, bool cs);
+    uint8_t *(*map)(struct bus *bus, uint16_t addr, bool cs, bool write);
+    size_t  (*usage)(struct bus *bus);
 } bus_t;
 
 /* ext_bus.c */
-bus_t *ext_bus_create(mem64_t *ext_ram, cart_t *cart);
+bus_t *ext_bus_create(mem8k_t *ext_ram, cart_t *cart);
+bool ext_bus_is_std(bus_t *bus);
 
 /* vid_bus.c */
-bus_t *vid_bus_create(mem64_t *vram);
+bus_t *vid_bus_create(mem8k_t *vram);
+bool vid_bus_is_std(bus_t *bus);
 
 #endif /* __BUS_H */
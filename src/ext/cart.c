@@ -1,113 +1,307 @@
+/* sync_file_range() */
+#define _GNU_SOURCE
+
 #include "cart.h"
 #include "log.h"
 #include "types.h"
 
-static uint8_t
-_fake_read(cart_t *cart, uint16_t addr)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+static bool
+_has_battery(uint8_t type)
 {
-    return 0xFF;
+    switch (type) {
+        case 0x03:
+        case 0x09:
+        case 0x0F:
+        case 0x10:
+        case 0x13:
+        case 0x1B:
+        case 0x1E:
+            return true;
+        default:
+            return false;
+    }
 }
 
-static void
-_fake_write(cart_t *cart, uint16_t addr, uint8_t val)
+static bool
+_has_rtc(uint8_t type)
 {
-    return;
+    /* MBC3+TIMER, with or without RAM */
+    return type == 0x0F || type == 0x10;
 }
 
-struct nombc {
-    uint8_t bank1[0x4000];
+static bool
+_has_mbc(uint8_t type)
+{
+    /* the ones select_mbc() knows */
+    switch (type) {
+        case 0x00:
+        case 0x01:
+        case 0x02:
+        case 0x03:
+        case 0x08:
+        case 0x09:
+        case 0x0F:
+        case 0x10:
+        case 0x11:
+        case 0x12:
+        case 0x13:
+        case 0x19:
+        case 0x1A:
+        case 0x1B:
+        case 0x1C:
+        case 0x1D:
+        case 0x1E:
+            return true;
+        default:
+            return false;
+    }
+}
+
+static bool
+_decode_sizes(const uint8_t *header, unsigned *nbanks, unsigned *nrams)
+{
+    /* the ROM size is 32KiB << n, up to 8MiB */
+    uint8_t rom_size = header[0x148];
+    if (rom_size > 0x08)
+        return false;
+    *nbanks = 2u << rom_size;
+
+    /* the RAM size is a code. a 2KiB RAM gets a whole bank anyway */
+    static const unsigned ram_banks[] = { 0, 1, 1, 4, 16, 8 };
+    uint8_t ram_size = header[0x149];
+    if (ram_size >= sizeof(ram_banks) / sizeof(*ram_banks))
+        return false;
+    *nrams = ram_banks[ram_size];
+    return true;
+}
+
+static unsigned
+_fixed_bank(cart_t *cart, uint16_t addr)
+{
+    /* nothing is ever switched, so there's only one bank for each address */
+    return 0;
+}
+
+/* what every controller has in common: a switchable ROM bank, maybe a
+ * switchable lower one, and switchable RAM. the controllers work out which
+ * banks are mapped whenever one of their registers is written, so that reads
+ * and writes only have to index into them. every MBC's data starts with this,
+ * so the cart functions can always reach it */
+struct banked {
+    /* what's mapped at 0x0000 - 0x3FFF, 0x4000 - 0x7FFF and 0xA000 - 0xBFFF.
+     * ram is NULL when the RAM is disabled or something else is there */
+    uint8_t *rom[2];
     uint8_t *ram;
+    unsigned rom_bank[2];
+    unsigned ram_bank;
+
+    /* the whole RAM, and how many 16KiB ROM and 8KiB RAM banks there are.
+     * both counts are powers of two (or no RAM at all) */
+    uint8_t *rams;
+    unsigned nbanks;
+    unsigned nrams;
+    bool ram_enabled;
+
+    /* battery-backed RAM is a mapping of the save file. writes mark the host
+     * pages they touch, and cart_flush() only writes those back. the file
+     * stays open for whatever else is kept after the RAM */
+    bool saved;
+    int fd;
+    size_t page_size;
+    uint32_t dirty;
 };
 
 static enum gb_err
-nombc_init(cart_t *cart, FILE *file)
+_banked_init(cart_t *cart, struct banked *banked)
 {
-    enum gb_err err;
-
-    /* allocate the mbc data */
-    cart->mbc_data = malloc(sizeof(struct nombc));
-    if (!cart->mbc_data)
-        gb_die(errno);
+    /* the sizes come from the header */
+    if (!_decode_sizes(cart->bank0, &banked->nbanks, &banked->nrams)) {
+        LOG(LOG_ERR, "invalid number of ROM or RAM banks");
+        return GBEMU_BAD_CART;
+    }
 
-    /* fill the struct with empty data */
-    memset(cart->mbc_data, 0, sizeof(struct nombc));
-    struct nombc *nombc_data = (struct nombc *)cart->mbc_data;
+    /* the banks are all in the image, one after the other */
+    if (cart->rom->size < 0x4000 * banked->nbanks) {
+        LOG(LOG_ERR, "ROM file is too small for its banks");
+        return GBEMU_BAD_FILE;
+    }
 
-    /* try reading the second bank */
-    if (!fread(nombc_data->bank1, 0x4000, 1, file)) {
-        LOG(LOG_ERR, "can't read second ROM bank from file");
-        err = GBEMU_BAD_FILE;
-        goto free;
+    /* allocate rams, all zeroes */
+    banked->rams = NULL;
+    if (banked->nrams) {
+        banked->rams = calloc(banked->nrams, 0x2000);
+        if (!banked->rams)
+            gb_die(errno);
     }
 
+    banked->ram_enabled = false;
+    banked->saved = false;
+    banked->dirty = 0;
+    cart->usage += 0x2000 * banked->nrams;
     return GBEMU_SUCCESS;
+}
 
-free:
-    free(cart->mbc_data);
-    return err;
+static void
+_banked_switch(struct banked *banked, cart_t *cart, unsigned rom0,
+        unsigned romx, unsigned ram)
+{
+    /* point at the selected banks. the upper bank lines that aren't wired
+     * to anything are simply lost */
+    banked->rom_bank[0] = rom0 & (banked->nbanks - 1);
+    banked->rom_bank[1] = romx & (banked->nbanks - 1);
+    banked->rom[0] = cart->rom->data + 0x4000 * banked->rom_bank[0];
+    banked->rom[1] = cart->rom->data + 0x4000 * banked->rom_bank[1];
+
+    banked->ram_bank = ram;
+    banked->ram = NULL;
+    if (banked->ram_enabled && banked->nrams)
+        banked->ram = banked->rams + 0x2000 * (ram & (banked->nrams - 1));
 }
 
 static uint8_t
-nombc_read_rom(cart_t *cart, uint16_t addr)
+_banked_read_rom(cart_t *cart, uint16_t addr)
 {
-    /* access first bank (A14 is low) */
-    if (!(addr & 0x4000))
-        return cart->bank0[addr & 0x3FFF];
-
-    /* return second bank (A14 is high) */
-    struct nombc *nombc_data = (struct nombc *)cart->mbc_data;
-    return nombc_data->bank1[addr & 0x3FFF];
+    /* A14 picks the bank */
+    struct banked *banked = (struct banked *)cart->mbc_data;
+    return banked->rom[(addr >> 14) & 1][addr & 0x3FFF];
 }
 
-static void
-nombc_write_rom(cart_t *cart, uint16_t addr, uint8_t val)
+static uint8_t *
+_banked_map_rom(cart_t *cart, uint16_t addr)
 {
-    /* writing to a read only memory is generally not a good idea */
-    return;
+    /* same as _banked_read_rom() */
+    struct banked *banked = (struct banked *)cart->mbc_data;
+    return &banked->rom[(addr >> 14) & 1][addr & 0x3F00];
 }
 
 static uint8_t
-nombc_read_ram(cart_t *cart, uint16_t addr)
+_banked_read_ram(cart_t *cart, uint16_t addr)
 {
-    /* if RAM exists, read from it */
-    struct nombc *nombc_data = (struct nombc *)cart->mbc_data;
-    if (nombc_data->ram)
-        return nombc_data->ram[addr & 0x1FFF];
+    /* if RAM is enabled, read from it */
+    struct banked *banked = (struct banked *)cart->mbc_data;
+    if (banked->ram)
+        return banked->ram[addr & 0x1FFF];
     return 0xFF;
 }
 
 static void
-nombc_write_ram(cart_t *cart, uint16_t addr, uint8_t val)
+_banked_write_ram(cart_t *cart, uint16_t addr, uint8_t val)
 {
-    /* if RAM exists, write to it */
-    struct nombc *nombc_data = (struct nombc *)cart->mbc_data;
-    if (nombc_data->ram) {
-        nombc_data->ram[addr & 0x1FFF] = val;
+    /* if RAM is enabled, write to it */
+    struct banked *banked = (struct banked *)cart->mbc_data;
+    if (!banked->ram)
         return;
+
+    banked->ram[addr & 0x1FFF] = val;
+    if (banked->saved) {
+        size_t offset = banked->ram - banked->rams + (addr & 0x1FFF);
+        banked->dirty |= 1u << offset / banked->page_size;
     }
 }
 
-struct mbc1 {
-    /* the banks and rams arrays */
-    uint8_t (*banks)[0x4000];
-    uint8_t (*rams)[0x2000];
+static uint8_t *
+_banked_map_ram(cart_t *cart, uint16_t addr, bool write)
+{
+    /* enabled RAM is plain memory. writes to a save have to be seen, though */
+    struct banked *banked = (struct banked *)cart->mbc_data;
+    if (banked->ram && !(write && banked->saved))
+        return &banked->ram[addr & 0x1F00];
+    return NULL;
+}
 
-    /* the number of banks and rams */
-    unsigned nbanks;
-    unsigned nrams;
+static unsigned
+_banked_bank(cart_t *cart, uint16_t addr)
+{
+    /* the cart RAM has banks too */
+    struct banked *banked = (struct banked *)cart->mbc_data;
+    if (addr & 0x8000)
+        return banked->ram_bank;
+
+    return banked->rom_bank[(addr >> 14) & 1];
+}
+
+static void
+_banked_deinit(cart_t *cart)
+{
+    /* the RAM is ours, the ROM isn't. a save gets written back first */
+    struct banked *banked = (struct banked *)cart->mbc_data;
+    if (!banked->saved) {
+        free(banked->rams);
+        return;
+    }
+
+    cart_flush(cart);
+    if (banked->nrams)
+        munmap(banked->rams, 0x2000 * banked->nrams);
+    close(banked->fd);
+}
 
-    /* the current bank register. this has to be masked with all the possible
-     * ROMS (if it's 3, then mask it with 0x03). note that for the 00 -> 01
-     * conversion, all the 5 bits are checked (mask is 0x1F always) */
-    uint8_t cur_bank;
+struct nombc {
+    struct banked banked;
 };
 
 static enum gb_err
-mbc1_init(cart_t *cart, FILE *file)
+nombc_init(cart_t *cart)
 {
-    /* TODO */
-    enum gb_err err;
+    /* allocate the mbc data */
+    cart->mbc_data = malloc(sizeof(struct nombc));
+    if (!cart->mbc_data)
+        gb_die(errno);
+
+    struct nombc *nombc_data = (struct nombc *)cart->mbc_data;
+    enum gb_err err = _banked_init(cart, &nombc_data->banked);
+    if (err != GBEMU_SUCCESS) {
+        free(cart->mbc_data);
+        return err;
+    }
+
+    /* both banks are fixed, and the RAM (if any) is always there */
+    nombc_data->banked.ram_enabled = true;
+    _banked_switch(&nombc_data->banked, cart, 0, 1, 0);
+
+    cart->usage += sizeof(struct nombc);
+    return GBEMU_SUCCESS;
+}
 
+static void
+nombc_write_rom(cart_t *cart, uint16_t addr, uint8_t val)
+{
+    /* writing to a read only memory is generally not a good idea */
+    return;
+}
+
+struct mbc1 {
+    struct banked banked;
+
+    /* BANK1 holds the lower 5 bits of the ROM bank, BANK2 the 2 bits above
+     * them. in mode 1, BANK2 also switches the lower ROM bank and the RAM */
+    uint8_t bank1;
+    uint8_t bank2;
+    uint8_t mode;
+};
+
+static void
+_mbc1_switch(cart_t *cart)
+{
+    struct mbc1 *mbc1_data = (struct mbc1 *)cart->mbc_data;
+    unsigned high = mbc1_data->bank2 << 5;
+    if (mbc1_data->mode)
+        _banked_switch(&mbc1_data->banked, cart, high,
+                high | mbc1_data->bank1, mbc1_data->bank2);
+    else
+        _banked_switch(&mbc1_data->banked, cart, 0,
+                high | mbc1_data->bank1, 0);
+}
+
+static enum gb_err
+mbc1_init(cart_t *cart)
+{
     /* try allocating the MBC1 data */
     cart->mbc_data = malloc(sizeof(struct mbc1));
     if (!cart->mbc_data)
@@ -115,136 +309,467 @@ mbc1_init(cart_t *cart, FILE *file)
 
     /* get MBC1 data */
     struct mbc1 *mbc1_data = (struct mbc1 *)cart->mbc_data;
-
-    /* read ROMS */
-    switch (cart->bank0[0x148]) {
-        case 0x01:
-            mbc1_data->nbanks = 3;
-            break;
-        default:
-            LOG(LOG_ERR, "invalid number of ROM banks");
-            err = GBEMU_BAD_CART;
-            goto free_data;
+    enum gb_err err = _banked_init(cart, &mbc1_data->banked);
+    if (err != GBEMU_SUCCESS) {
+        free(cart->mbc_data);
+        return err;
     }
 
-    /* read RAMS */
-    switch (cart->bank0[0x149]) {
-        case 0x00:
-            mbc1_data->nrams = 0;
+    /* start on bank 1 */
+    mbc1_data->bank1 = 1;
+    mbc1_data->bank2 = 0;
+    mbc1_data->mode = 0;
+    _mbc1_switch(cart);
+
+    cart->usage += sizeof(struct mbc1);
+    return GBEMU_SUCCESS;
+}
+
+static void
+mbc1_write_rom(cart_t *cart, uint16_t addr, uint8_t val)
+{
+    /* get our mbc data */
+    struct mbc1 *mbc1_data = (struct mbc1 *)cart->mbc_data;
+
+    switch (addr >> 13) {
+        case 0:
+            /* 0x0000 - 0x1FFF - RAM enable */
+            mbc1_data->banked.ram_enabled = (val & 0x0F) == 0x0A;
             break;
-        case 0x02:
-            mbc1_data->nrams = 1;
+        case 1:
+            /* 0x2000 - 0x3FFF - ROM bank number. 0 can't be selected, all the
+             * 5 bits are checked for that */
+            mbc1_data->bank1 = val & 0x1F ? val & 0x1F : 1;
+            break;
+        case 2:
+            /* 0x4000 - 0x5FFF - upper ROM bits or RAM bank */
+            mbc1_data->bank2 = val & 0x03;
             break;
         default:
-            LOG(LOG_ERR, "invalid number of RAM banks");
-            err = GBEMU_BAD_CART;
-            goto free_data;
+            /* 0x6000 - 0x7FFF - banking mode */
+            mbc1_data->mode = val & 0x01;
+            break;
     }
 
-    /* allocate roms */
-    mbc1_data->banks = malloc(0x4000 * mbc1_data->nbanks);
-    if (!mbc1_data->banks)
-        gb_die(errno);
+    _mbc1_switch(cart);
+}
 
-    /* fill roms from file */
-    for (size_t i = 0; i < mbc1_data->nbanks; ++i) {
-        if (!fread(mbc1_data->banks[i], 0x4000, 1, file)) {
-            LOG(LOG_ERR, "can't read ROM banks from file");
-            err = GBEMU_BAD_FILE;
-            goto free_banks;
-        }
+struct mbc3 {
+    struct banked banked;
+
+    /* the ROM bank, and the RAM bank or RTC register selected at 0xA000 */
+    uint8_t rom_bank;
+    uint8_t ram_bank;
+
+    /* the latched clock registers (seconds, minutes, hours, lower and upper
+     * day counter) and the last value written to the latch */
+    uint8_t rtc[5];
+    uint8_t latch;
+
+    /* the clock is never ticked. it held rtc_base cycles (counted from day 0,
+     * 00:00:00) when the emulated cycle counter was at rtc_anchor, and the
+     * rest follows from how far the counter is now */
+    const uint64_t *clock;
+    uint64_t rtc_base;
+    uint64_t rtc_anchor;
+    bool rtc_halt;
+    bool rtc_carry;
+
+    /* when the clock was last saved, in host time. rtc_dirty means the save
+     * is behind something the game wrote */
+    time_t rtc_saved_at;
+    bool rtc_dirty;
+};
+
+/* RAM bank values from this one on select an RTC register */
+#define MBC3_RTC_SELECT 0x08
+
+/* the clock counts T-cycles, the day counter has 9 bits */
+#define RTC_SECOND      4194304ull
+#define RTC_WRAP        (512 * 86400 * RTC_SECOND)
+
+static inline uint64_t
+_mbc3_rtc_now(struct mbc3 *mbc3_data)
+{
+    /* only a running clock moves */
+    uint64_t now = mbc3_data->rtc_base;
+    if (!mbc3_data->rtc_halt && mbc3_data->clock)
+        now += *mbc3_data->clock - mbc3_data->rtc_anchor;
+    return now;
+}
+
+static void
+_mbc3_rtc_set(struct mbc3 *mbc3_data, uint64_t now)
+{
+    /* start counting again from now. the day counter overflowing sets the
+     * carry, which stays until the game clears it */
+    if (now >= RTC_WRAP) {
+        mbc3_data->rtc_carry = true;
+        now %= RTC_WRAP;
     }
+    mbc3_data->rtc_base = now;
+    mbc3_data->rtc_anchor = mbc3_data->clock ? *mbc3_data->clock : 0;
+}
 
-    /* allocate rams */
-    if (mbc1_data->nrams) {
-        mbc1_data->rams = malloc(0x2000 * mbc1_data->nrams);
-        if (mbc1_data->rams)
-            gb_die(errno);
+static void
+_mbc3_rtc_regs(struct mbc3 *mbc3_data, uint8_t regs[5])
+{
+    /* split the clock into the registers */
+    uint64_t now = _mbc3_rtc_now(mbc3_data);
+    bool carry = mbc3_data->rtc_carry || now >= RTC_WRAP;
+    uint64_t secs = now % RTC_WRAP / RTC_SECOND;
+    unsigned days = secs / 86400;
+    regs[0] = secs % 60;
+    regs[1] = secs / 60 % 60;
+    regs[2] = secs / 3600 % 24;
+    regs[3] = days & 0xFF;
+    regs[4] = days >> 8 | mbc3_data->rtc_halt << 6 | carry << 7;
+}
+
+static void
+_mbc3_rtc_write(struct mbc3 *mbc3_data, unsigned reg, uint8_t val)
+{
+    /* change one register of the live clock. the fraction of a second is
+     * kept, unless the seconds are written (that resets the divider).
+     * values out of range are folded into the next unit */
+    uint64_t now = _mbc3_rtc_now(mbc3_data);
+    uint64_t frac = now % RTC_SECOND;
+    uint8_t regs[5];
+    _mbc3_rtc_regs(mbc3_data, regs);
+    regs[reg] = val;
+
+    unsigned days = regs[3] | (regs[4] & 0x01) << 8;
+    uint64_t secs = (regs[0] & 0x3F) + (regs[1] & 0x3F) * 60 +
+        (regs[2] & 0x1F) * 3600 + days * 86400ull;
+    mbc3_data->rtc_halt = regs[4] & 0x40;
+    mbc3_data->rtc_carry = regs[4] & 0x80;
+    _mbc3_rtc_set(mbc3_data, secs * RTC_SECOND + (reg ? frac : 0));
+
+    /* the latched copy shows what was written */
+    mbc3_data->rtc[reg] = val;
+    mbc3_data->rtc_dirty = true;
+}
+
+/* the clock goes after the RAM in the save, in the layout most emulators
+ * use: the live and the latched registers as 32-bit words, then the host
+ * time they were saved at as a 64-bit one, all little endian */
+#define RTC_SAVE_SIZE   48
+
+static inline void
+_put_le(uint8_t *buf, uint64_t val, unsigned n)
+{
+    for (unsigned i = 0; i < n; ++i)
+        buf[i] = val >> (8 * i);
+}
 
-        /* fill rams with all zeroes */
-        for (size_t i = 0; i < mbc1_data->nrams; ++i)
-            memset(mbc1_data->rams[i], 0, 0x2000);
+static inline uint64_t
+_get_le(const uint8_t *buf, unsigned n)
+{
+    uint64_t val = 0;
+    for (unsigned i = 0; i < n; ++i)
+        val |= (uint64_t)buf[i] << (8 * i);
+    return val;
+}
+
+static void
+_mbc3_rtc_save(cart_t *cart)
+{
+    /* write the clock right after the RAM */
+    struct mbc3 *mbc3_data = (struct mbc3 *)cart->mbc_data;
+    uint8_t buf[RTC_SAVE_SIZE], regs[5];
+    _mbc3_rtc_regs(mbc3_data, regs);
+    for (unsigned i = 0; i < 5; ++i) {
+        _put_le(&buf[4 * i], regs[i], 4);
+        _put_le(&buf[20 + 4 * i], mbc3_data->rtc[i], 4);
     }
+    mbc3_data->rtc_saved_at = time(NULL);
+    _put_le(&buf[40], mbc3_data->rtc_saved_at, 8);
 
-    /* set current (external) bank to 1 */
-    mbc1_data->cur_bank = 1;
+    off_t offset = 0x2000 * mbc3_data->banked.nrams;
+    if (pwrite(mbc3_data->banked.fd, buf, sizeof(buf), offset) != sizeof(buf))
+        LOG(LOG_ERR, "can't save the clock");
+    mbc3_data->rtc_dirty = false;
+}
 
-    return GBEMU_SUCCESS;
+static void
+_mbc3_rtc_load(cart_t *cart)
+{
+    /* a save without the clock starts it from zero */
+    struct mbc3 *mbc3_data = (struct mbc3 *)cart->mbc_data;
+    uint8_t buf[RTC_SAVE_SIZE];
+    off_t offset = 0x2000 * mbc3_data->banked.nrams;
+    ssize_t n = pread(mbc3_data->banked.fd, buf, sizeof(buf), offset);
+    if (n < RTC_SAVE_SIZE - 4)
+        return;
 
-free_banks:
-    free(mbc1_data->banks);
-free_data:
-    free(cart->mbc_data);
-    return err;
+    /* the live registers go through the normal write path. some emulators
+     * only keep a 32-bit time */
+    for (unsigned i = 0; i < 5; ++i)
+        _mbc3_rtc_write(mbc3_data, i, _get_le(&buf[4 * i], 4));
+    for (unsigned i = 0; i < 5; ++i)
+        mbc3_data->rtc[i] = _get_le(&buf[20 + 4 * i], 4);
+    mbc3_data->rtc_saved_at = _get_le(&buf[40], n < RTC_SAVE_SIZE ? 4 : 8);
+    mbc3_data->rtc_dirty = false;
 }
 
-static inline unsigned
-_mbc1_get_cur_rom(struct mbc1 *mbc1_data)
+static void
+mbc3_deinit(cart_t *cart)
 {
-    /* current ROM bank */
-    unsigned cur_rom = mbc1_data->cur_bank & mbc1_data->nbanks;
-    if ((mbc1_data->cur_bank & 0x1F) == 0)
-        cur_rom = 1;
+    /* keep the clock with the save */
+    struct mbc3 *mbc3_data = (struct mbc3 *)cart->mbc_data;
+    if (mbc3_data->banked.saved && _has_rtc(cart->bank0[0x147]))
+        _mbc3_rtc_save(cart);
+    _banked_deinit(cart);
+}
 
-    return cur_rom;
+static void
+_mbc3_switch(cart_t *cart)
+{
+    /* the RTC registers aren't memory */
+    struct mbc3 *mbc3_data = (struct mbc3 *)cart->mbc_data;
+    _banked_switch(&mbc3_data->banked, cart, 0, mbc3_data->rom_bank,
+            mbc3_data->ram_bank);
+    if (mbc3_data->ram_bank >= MBC3_RTC_SELECT)
+        mbc3_data->banked.ram = NULL;
 }
 
-static uint8_t
-mbc1_read_rom(cart_t *cart, uint16_t addr)
+static enum gb_err
+mbc3_init(cart_t *cart)
 {
-    /* TODO */
+    /* try allocating the MBC3 data */
+    cart->mbc_data = malloc(sizeof(struct mbc3));
+    if (!cart->mbc_data)
+        gb_die(errno);
 
-    /* if A14 is low read first bank */
-    if (!(addr & 0x4000))
-        return cart->bank0[addr & 0x3FFF];
+    /* get MBC3 data */
+    struct mbc3 *mbc3_data = (struct mbc3 *)cart->mbc_data;
+    enum gb_err err = _banked_init(cart, &mbc3_data->banked);
+    if (err != GBEMU_SUCCESS) {
+        free(cart->mbc_data);
+        return err;
+    }
 
+    /* start on bank 1, the clock at zero. it doesn't move until it's given
+     * a cycle counter */
+    mbc3_data->rom_bank = 1;
+    mbc3_data->ram_bank = 0;
+    memset(mbc3_data->rtc, 0, sizeof(mbc3_data->rtc));
+    mbc3_data->latch = 0xFF;
+    mbc3_data->clock = NULL;
+    mbc3_data->rtc_halt = mbc3_data->rtc_carry = false;
+    _mbc3_rtc_set(mbc3_data, 0);
+    mbc3_data->rtc_saved_at = 0;
+    mbc3_data->rtc_dirty = false;
+    _mbc3_switch(cart);
+
+    cart->usage += sizeof(struct mbc3);
+    return GBEMU_SUCCESS;
+}
+
+static void
+mbc3_write_rom(cart_t *cart, uint16_t addr, uint8_t val)
+{
     /* get our mbc data */
-    struct mbc1 *mbc1_data = (struct mbc1 *)cart->mbc_data;
+    struct mbc3 *mbc3_data = (struct mbc3 *)cart->mbc_data;
 
-    /* get current rom */
-    unsigned cur_rom = _mbc1_get_cur_rom(mbc1_data);
+    switch (addr >> 13) {
+        case 0:
+            /* 0x0000 - 0x1FFF - RAM and RTC enable */
+            mbc3_data->banked.ram_enabled = (val & 0x0F) == 0x0A;
+            break;
+        case 1:
+            /* 0x2000 - 0x3FFF - ROM bank number (7 bits), 0 means 1 */
+            val &= 0x7F;
+            mbc3_data->rom_bank = val ? val : 1;
+            break;
+        case 2:
+            /* 0x4000 - 0x5FFF - RAM bank or RTC register */
+            mbc3_data->ram_bank = val & 0x0F;
+            break;
+        default:
+            /* 0x6000 - 0x7FFF - writing 0 then 1 latches the clock. this is
+             * the only time the registers are worked out */
+            if (mbc3_data->latch == 0x00 && val == 0x01)
+                _mbc3_rtc_regs(mbc3_data, mbc3_data->rtc);
+            mbc3_data->latch = val;
+            break;
+    }
 
-    /* if current rom is 0, read from first bank */
-    if (cur_rom == 0)
-        return cart->bank0[addr & 0x3FFF];
-    
-    /* else, read from the rom's external banks */
-    assert(cur_rom <= mbc1_data->nbanks);
-    return mbc1_data->banks[cur_rom - 1][addr & 0x3FFF];
+    _mbc3_switch(cart);
+}
+
+static uint8_t
+mbc3_read_ram(cart_t *cart, uint16_t addr)
+{
+    /* RAM goes the usual way */
+    struct mbc3 *mbc3_data = (struct mbc3 *)cart->mbc_data;
+    if (mbc3_data->ram_bank < MBC3_RTC_SELECT)
+        return _banked_read_ram(cart, addr);
+
+    /* the RTC registers are only there if enabled */
+    unsigned reg = mbc3_data->ram_bank - MBC3_RTC_SELECT;
+    if (!mbc3_data->banked.ram_enabled || reg >= sizeof(mbc3_data->rtc))
+        return 0xFF;
+    return mbc3_data->rtc[reg];
 }
 
 static void
-mbc1_write_rom(cart_t *cart, uint16_t addr, uint8_t val)
+mbc3_write_ram(cart_t *cart, uint16_t addr, uint8_t val)
 {
-    /* TODO (do NOT write to a ROM) */
+    /* RAM goes the usual way */
+    struct mbc3 *mbc3_data = (struct mbc3 *)cart->mbc_data;
+    if (mbc3_data->ram_bank < MBC3_RTC_SELECT) {
+        _banked_write_ram(cart, addr, val);
+        return;
+    }
+
+    /* set the RTC register */
+    unsigned reg = mbc3_data->ram_bank - MBC3_RTC_SELECT;
+    if (mbc3_data->banked.ram_enabled && reg < sizeof(mbc3_data->rtc))
+        _mbc3_rtc_write(mbc3_data, reg, val);
+}
+
+struct mbc5 {
+    struct banked banked;
 
+    /* the 9-bit ROM bank and the 4-bit RAM bank */
+    uint16_t rom_bank;
+    uint8_t ram_bank;
+};
+
+static void
+_mbc5_switch(cart_t *cart)
+{
+    struct mbc5 *mbc5_data = (struct mbc5 *)cart->mbc_data;
+    _banked_switch(&mbc5_data->banked, cart, 0, mbc5_data->rom_bank,
+            mbc5_data->ram_bank);
+}
+
+static enum gb_err
+mbc5_init(cart_t *cart)
+{
+    /* try allocating the MBC5 data */
+    cart->mbc_data = malloc(sizeof(struct mbc5));
+    if (!cart->mbc_data)
+        gb_die(errno);
+
+    /* get MBC5 data */
+    struct mbc5 *mbc5_data = (struct mbc5 *)cart->mbc_data;
+    enum gb_err err = _banked_init(cart, &mbc5_data->banked);
+    if (err != GBEMU_SUCCESS) {
+        free(cart->mbc_data);
+        return err;
+    }
+
+    /* start on bank 1 */
+    mbc5_data->rom_bank = 1;
+    mbc5_data->ram_bank = 0;
+    _mbc5_switch(cart);
+
+    cart->usage += sizeof(struct mbc5);
+    return GBEMU_SUCCESS;
+}
+
+static void
+mbc5_write_rom(cart_t *cart, uint16_t addr, uint8_t val)
+{
     /* get our mbc data */
-    struct mbc1 *mbc1_data = (struct mbc1 *)cart->mbc_data;
+    struct mbc5 *mbc5_data = (struct mbc5 *)cart->mbc_data;
 
-    /* 0x2000 - 0x3FFF - ROM Bank Number */
-    if (addr >= 0x2000 && addr < 0x4000)
-        mbc1_data->cur_bank = val;
+    switch (addr >> 12) {
+        case 0:
+        case 1:
+            /* 0x0000 - 0x1FFF - RAM enable, only 0x0A turns it on */
+            mbc5_data->banked.ram_enabled = val == 0x0A;
+            break;
+        case 2:
+            /* 0x2000 - 0x2FFF - lower 8 bits of the ROM bank. 0 is fine */
+            mbc5_data->rom_bank = (mbc5_data->rom_bank & 0x100) | val;
+            break;
+        case 3:
+            /* 0x3000 - 0x3FFF - 9th bit of the ROM bank */
+            mbc5_data->rom_bank = (mbc5_data->rom_bank & 0xFF) |
+                (val & 0x01) << 8;
+            break;
+        case 4:
+        case 5:
+            /* 0x4000 - 0x5FFF - RAM bank (bit 3 drives the rumble motor on
+             * the carts that have one) */
+            mbc5_data->ram_bank = val & 0x0F;
+            break;
+        default:
+            /* 0x6000 - 0x7FFF - nothing */
+            return;
+    }
+
+    _mbc5_switch(cart);
 }
 
 static enum gb_err
-select_mbc(cart_t *cart, FILE *file)
+select_mbc(cart_t *cart)
 {
-    /* TODO */
     enum gb_err ret;
     switch (cart->bank0[0x147]) {
         case 0x00:
-            ret = nombc_init(cart, file);
-            cart->read_rom = nombc_read_rom;
+        case 0x08:
+        case 0x09:
+            /* ROM only (+RAM) (+BATTERY) */
+            ret = nombc_init(cart);
+            cart->read_rom = _banked_read_rom;
             cart->write_rom = nombc_write_rom;
-            cart->read_ram = nombc_read_ram;
-            cart->write_ram = nombc_write_ram;
+            cart->read_ram = _banked_read_ram;
+            cart->write_ram = _banked_write_ram;
+            cart->bank = _fixed_bank;
+            cart->map_rom = _banked_map_rom;
+            cart->map_ram = _banked_map_ram;
+            cart->deinit = _banked_deinit;
             break;
         case 0x01:
-            ret = mbc1_init(cart, file);
-            cart->read_rom = mbc1_read_rom;
+        case 0x02:
+        case 0x03:
+            /* MBC1 (+RAM) (+BATTERY) */
+            ret = mbc1_init(cart);
+            cart->read_rom = _banked_read_rom;
             cart->write_rom = mbc1_write_rom;
-            cart->read_ram = _fake_read;
-            cart->write_ram = _fake_write;
+            cart->read_ram = _banked_read_ram;
+            cart->write_ram = _banked_write_ram;
+            cart->bank = _banked_bank;
+            cart->map_rom = _banked_map_rom;
+            cart->map_ram = _banked_map_ram;
+            cart->deinit = _banked_deinit;
+            break;
+        case 0x0F:
+        case 0x10:
+        case 0x11:
+        case 0x12:
+        case 0x13:
+            /* MBC3 (+TIMER) (+RAM) (+BATTERY) */
+            ret = mbc3_init(cart);
+            cart->read_rom = _banked_read_rom;
+            cart->write_rom = mbc3_write_rom;
+            cart->read_ram = mbc3_read_ram;
+            cart->write_ram = mbc3_write_ram;
+            cart->bank = _banked_bank;
+            cart->map_rom = _banked_map_rom;
+            cart->map_ram = _banked_map_ram;
+            cart->deinit = mbc3_deinit;
+            break;
+        case 0x19:
+        case 0x1A:
+        case 0x1B:
+        case 0x1C:
+        case 0x1D:
+        case 0x1E:
+            /* MBC5 (+RUMBLE) (+RAM) (+BATTERY) */
+            ret = mbc5_init(cart);
+            cart->read_rom = _banked_read_rom;
+            cart->write_rom = mbc5_write_rom;
+            cart->read_ram = _banked_read_ram;
+            cart->write_ram = _banked_write_ram;
+            cart->bank = _banked_bank;
+            cart->map_rom = _banked_map_rom;
+            cart->map_ram = _banked_map_ram;
+            cart->deinit = _banked_deinit;
             break;
         default:
             LOG(LOG_ERR, "invalid MBC type");
@@ -256,55 +781,204 @@ select_mbc(cart_t *cart, FILE *file)
 }
 
 enum gb_err
-cart_init(cart_t *cart, FILE *file)
+cart_parse_header(const uint8_t *header, size_t size, cart_header_t *hdr)
 {
-    /* try reading from file */
-    memset(cart, 0, sizeof(cart_t));
-    if (!fread(cart->bank0, 0x4000, 1, file)) {
-        LOG(LOG_ERR, "can't read first ROM bank from file");
+    /* the title, up to the first NUL */
+    memset(hdr, 0, sizeof(*hdr));
+    for (size_t i = 0; i < 16 && header[0x134 + i]; ++i)
+        hdr->title[i] = header[0x134 + i];
+    hdr->type = header[0x147];
+    hdr->battery = _has_battery(hdr->type);
+    hdr->rtc = _has_rtc(hdr->type);
+    hdr->header_checksum = header[0x14D];
+    hdr->global_checksum = header[0x14E] << 8 | header[0x14F];
+
+    /* the boot ROM won't start a cart whose header doesn't add up */
+    uint8_t sum = 0;
+    for (size_t i = 0x134; i < 0x14D; ++i)
+        sum = sum - header[i] - 1;
+    hdr->checksum_ok = sum == hdr->header_checksum;
+
+    /* can we run it at all? */
+    if (!_has_mbc(hdr->type) ||
+            !_decode_sizes(header, &hdr->nbanks, &hdr->nrams))
+        return GBEMU_BAD_CART;
+    if (size < 0x4000 * hdr->nbanks)
         return GBEMU_BAD_FILE;
-    }
+    return GBEMU_SUCCESS;
+}
+
+enum gb_err
+cart_init(cart_t *cart, rom_t *rom)
+{
+    /* the first bank is the start of the image */
+    memset(cart, 0, sizeof(cart_t));
+    cart->usage = sizeof(cart_t);
+    cart->rom = rom;
+    cart->bank0 = rom->data;
 
     /* select MBC */
-    return select_mbc(cart, file);
+    enum gb_err ret = select_mbc(cart);
+    if (ret != GBEMU_SUCCESS)
+        return ret;
+
+    /* the cart holds on to the image from now on */
+    rom_ref(rom);
+    return GBEMU_SUCCESS;
 }
 
 enum gb_err
-cart_create(cart_t **pcart, const char *filename)
+cart_create_shared(cart_t **pcart, rom_t *rom)
 {
     /* try mallocing */
     cart_t *cart = malloc(sizeof(cart_t));
     if (!cart)
         gb_die(errno);
 
-    /* open file and init cart */
-    FILE *file = fopen(filename, "rb");
-    if (!file) {
-        LOG(LOG_ERR, "failed to open file");
-        free(cart);
-        return GBEMU_BAD_FILE;
-    }
-
-    enum gb_err ret = cart_init(cart, file);
-    fclose(file);
+    enum gb_err ret = cart_init(cart, rom);
     if (ret != GBEMU_SUCCESS) {
         LOG(LOG_ERR, "failed to initialize cart");
         free(cart);
         return ret;
     }
 
-    /* close file and return cart */
     *pcart = cart;
     return GBEMU_SUCCESS;
 }
 
+enum gb_err
+cart_create(cart_t **pcart, const char *filename)
+{
+    /* map the file and make a cart out of it. the cart keeps its own
+     * reference, so ours goes away either way */
+    rom_t *rom;
+    enum gb_err ret = rom_open(&rom, filename);
+    if (ret != GBEMU_SUCCESS)
+        return ret;
+
+    ret = cart_create_shared(pcart, rom);
+    rom_unref(rom);
+    return ret;
+}
+
+enum gb_err
+cart_load_save(cart_t *cart, const char *filename)
+{
+    /* only battery-backed RAM (or a clock) is worth keeping */
+    struct banked *banked = (struct banked *)cart->mbc_data;
+    uint8_t type = cart->bank0[0x147];
+    if (!_has_battery(type) || (!banked->nrams && !_has_rtc(type)) ||
+            banked->saved)
+        return GBEMU_SUCCESS;
+
+    /* open the save, or start a new one. a short one is padded with zeroes */
+    size_t size = 0x2000 * banked->nrams;
+    int fd = open(filename, O_RDWR | O_CREAT, 0644);
+    if (fd < 0) {
+        LOG(LOG_ERR, "failed to open save file");
+        return GBEMU_BAD_FILE;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) < 0 ||
+            ((size_t)st.st_size < size && ftruncate(fd, size) < 0)) {
+        LOG(LOG_ERR, "can't size the save file");
+        close(fd);
+        return GBEMU_BAD_FILE;
+    }
+
+    /* every write lands straight in the page cache, so nothing is lost if
+     * we crash. only the OS going down can lose what isn't flushed yet */
+    if (size) {
+        uint8_t *rams = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED,
+                fd, 0);
+        if (rams == MAP_FAILED) {
+            LOG(LOG_ERR, "can't map the save file");
+            close(fd);
+            return GBEMU_BAD_FILE;
+        }
+
+        /* move over to the save, keeping the same bank mapped */
+        if (banked->ram)
+            banked->ram = rams + (banked->ram - banked->rams);
+        free(banked->rams);
+        banked->rams = rams;
+    }
+
+    banked->saved = true;
+    banked->fd = fd;
+    banked->page_size = sysconf(_SC_PAGESIZE);
+    assert(size / banked->page_size <= 32);
+
+    /* the clock comes right after */
+    if (_has_rtc(type))
+        _mbc3_rtc_load(cart);
+    return GBEMU_SUCCESS;
+}
+
+void
+cart_flush(cart_t *cart)
+{
+    /* start writing back the pages written since the last flush. this
+     * doesn't wait for the disk */
+    struct banked *banked = (struct banked *)cart->mbc_data;
+    size_t size = 0x2000 * banked->nrams;
+    while (banked->dirty) {
+        size_t offset = __builtin_ctz(banked->dirty) * banked->page_size;
+        size_t len = size - offset < banked->page_size ?
+            size - offset : banked->page_size;
+        banked->dirty &= banked->dirty - 1;
+#ifdef SYNC_FILE_RANGE_WRITE
+        /* the RAM is mapped from the start of the save file */
+        sync_file_range(banked->fd, offset, len, SYNC_FILE_RANGE_WRITE);
+#else
+        /* without it, the kernel writes the pages back whenever it chooses
+         * (Linux doesn't start anything for MS_ASYNC) */
+        msync(banked->rams + offset, len, MS_ASYNC);
+#endif
+    }
+
+    /* the clock only has to be saved when the game sets it. the rest can be
+     * worked out from when it was saved */
+    if (banked->saved && _has_rtc(cart->bank0[0x147]) &&
+            ((struct mbc3 *)cart->mbc_data)->rtc_dirty)
+        _mbc3_rtc_save(cart);
+}
+
+void
+cart_set_clock(cart_t *cart, const uint64_t *cycles, enum cart_clock mode)
+{
+    /* only MBC3 has a clock */
+    if (!_has_rtc(cart->bank0[0x147]))
+        return;
+
+    /* keep the current value, but count from the new counter */
+    struct mbc3 *mbc3_data = (struct mbc3 *)cart->mbc_data;
+    uint64_t now = _mbc3_rtc_now(mbc3_data);
+
+    /* a real cart's clock keeps going while it sits on the shelf. when the
+     * runs have to be reproducible, only emulated time counts */
+    time_t host = time(NULL);
+    if (mode == CART_CLOCK_REALTIME && !mbc3_data->rtc_halt &&
+            mbc3_data->rtc_saved_at && host > mbc3_data->rtc_saved_at)
+        now += (host - mbc3_data->rtc_saved_at) * RTC_SECOND;
+
+    mbc3_data->clock = cycles;
+    _mbc3_rtc_set(mbc3_data, now);
+}
+
 void
 cart_destroy(cart_t *cart)
 {
     /* first nuke the mbc data (if any) (wait why shouldn't it be) */
+    if (cart->deinit)
+        cart->deinit(cart);
     if (cart->mbc_data)
         free(cart->mbc_data);
 
+    /* then let go of the ROM */
+    rom_unref(cart->rom);
+
     /* nuke the cart */
     free(cart);
 }
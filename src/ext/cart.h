@@ -1,23 +1,74 @@
 #ifndef __CART_H
 #define __CART_H
 
+#include "rom.h"
+
 #include <gbemu/errors.h>
+#include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
-#include <stdio.h>
 
 /* cartridge type. it may have different read and write functions depending on
- * the MBC type */
+ * the MBC type. map_rom() and map_ram() return the memory currently behind the
+ * 256-byte page at an address, or NULL if accessing it does anything else
+ * (map_ram() is told whether it's for writing, a save has to see its writes).
+ * deinit(), if there, frees whatever the MBC allocated besides mbc_data */
 typedef struct cart {
     void    *mbc_data;
     uint8_t (*read_rom)(struct cart *cart, uint16_t addr);
     void    (*write_rom)(struct cart *cart, uint16_t addr, uint8_t val);
     uint8_t (*read_ram)(struct cart *cart, uint16_t addr);
     void    (*write_ram)(struct cart *cart, uint16_t addr, uint8_t val);
-    uint8_t bank0[0x4000];
+    unsigned (*bank)(struct cart *cart, uint16_t addr);
+    uint8_t *(*map_rom)(struct cart *cart, uint16_t addr);
+    uint8_t *(*map_ram)(struct cart *cart, uint16_t addr, bool write);
+    void    (*deinit)(struct cart *cart);
+
+    /* the host memory the cart takes, MBC data included. the ROM image is
+     * shared, so it isn't counted */
+    size_t  usage;
+    rom_t   *rom;
+    uint8_t *bank0;
 } cart_t;
 
-enum gb_err cart_init(cart_t *cart, FILE *file);
+/* what the header at 0x100 - 0x14F says about a cart. it is enough to tell
+ * whether a cart can run without making one */
+typedef struct cart_header {
+    char     title[17];
+    uint8_t  type;
+    unsigned nbanks;
+    unsigned nrams;
+    bool     battery;
+    bool     rtc;
+    uint8_t  header_checksum;
+    uint16_t global_checksum;
+    bool     checksum_ok;
+} cart_header_t;
+
+/* header points to the start of the image (at least 0x150 bytes of it), size
+ * is the size of the whole image */
+enum gb_err cart_parse_header(const uint8_t *header, size_t size,
+                              cart_header_t *hdr);
+
+enum gb_err cart_init(cart_t *cart, rom_t *rom);
 enum gb_err cart_create(cart_t **pcart, const char *filename);
+enum gb_err cart_create_shared(cart_t **pcart, rom_t *rom);
+
+/* battery-backed RAM. the save has to be loaded before the cart goes on a
+ * bus, and flushed every now and then (once a frame is fine) */
+enum gb_err cart_load_save(cart_t *cart, const char *filename);
+void        cart_flush(cart_t *cart);
+
+/* the MBC3 clock runs on an emulated T-cycle counter (the SoC's timestamp).
+ * in real time mode it also catches up with the time the save sat unused,
+ * so it has to be set after cart_load_save() */
+enum cart_clock {
+    CART_CLOCK_REALTIME,
+    CART_CLOCK_EMULATED,
+};
+
+void        cart_set_clock(cart_t *cart, const uint64_t *cycles,
+                           enum cart_clock mode);
 void        cart_destroy(cart_t *cart);
 
 #endif /* __CART_H */
@@ -1,71 +1,34 @@
-#include "bus.h"
+#include "std_bus.h"
 #include "log.h"
 #include "types.h"
 
-/* this represents an external bus */
-typedef struct ext_bus {
-    uint8_t (*read)(struct ext_bus *bus, uint16_t addr, bool cs);
-    void    (*write)(struct ext_bus *bus, uint16_t addr, bool cs, uint8_t val);
-    mem64_t *ext_ram;
-    cart_t  *cart;
-} ext_bus_t;
-
-/* quick shortcuts */
-#define A15(addr) (addr & 0x8000)
-#define A14(addr) (addr & 0x4000)
-#define A13(addr) (addr & 0x2000)
-
-static uint8_t
-_ext_bus_read(ext_bus_t *bus, uint16_t addr, bool cs)
+static uint8_t *
+_ext_bus_map(ext_bus_t *bus, uint16_t addr, bool cs, bool write)
 {
-    /* if A15 is low (ROM) */
+    /* ROM writes go to the MBC */
     if (cs && !A15(addr))
-        return bus->cart->read_rom(bus->cart, addr);
+        return write ? NULL : bus->cart->map_rom(bus->cart, addr);
 
-    /* if #cs is low and A14 is up (ext RAM). by placing this before cart RAM,
-     * we make Echo RAM possible. notice however that if A14 and A15 are up at
-     * the same time, the PC should explode */
+    /* ext RAM (echo RAM included, see _ext_bus_read()) */
     if (!cs && A14(addr))
-        return bus->ext_ram->data[addr];
+        return mem8k_page(bus->ext_ram, addr);
 
-    /* if #cs is low and A13 is up (cart RAM) */
+    /* cart RAM, if the MBC has it plainly mapped */
     if (!cs && A13(addr))
-        return bus->cart->read_ram(bus->cart, addr);
+        return bus->cart->map_ram(bus->cart, addr, write);
 
-    /* this is not supposed to happen */
-    LOG(LOG_ERR, "bad read issued to external bus");
-    return 0xFF;
+    return NULL;
 }
 
-static void
-_ext_bus_write(ext_bus_t *bus, uint16_t addr, bool cs, uint8_t val)
+static size_t
+_ext_bus_usage(ext_bus_t *bus)
 {
-    /* if A15 is low (ROM) */
-    if (cs && !A15(addr)) {
-        bus->cart->write_rom(bus->cart, addr, val);
-        return;
-    }
-
-    /* if #cs is low and A14 is up (ext RAM). by placing this before cart RAM,
-     * we make Echo RAM possible. notice however that if A14 and A15 are up at
-     * the same time, the PC should explode */
-    if (!cs && A14(addr)) {
-        bus->ext_ram->data[addr] = val;
-        return;
-    }
-
-    /* if #cs is low and A13 is up (cart RAM) */
-    if (!cs && A13(addr)) {
-        bus->cart->write_ram(bus->cart, addr, val);
-        return;
-    }
-
-    /* not supposed to happen */
-    LOG(LOG_ERR, "bad write issued to external bus");
+    /* the bus itself, the ext RAM and the cart */
+    return sizeof(*bus) + sizeof(*bus->ext_ram) + bus->cart->usage;
 }
 
 bus_t *
-ext_bus_create(mem64_t *ext_ram, cart_t *cart)
+ext_bus_create(mem8k_t *ext_ram, cart_t *cart)
 {
     /* try to allocate */
     ext_bus_t *ext_bus = malloc(sizeof(ext_bus_t));
@@ -75,8 +38,19 @@ ext_bus_create(mem64_t *ext_ram, cart_t *cart)
     /* fill struct */
     ext_bus->read = _ext_bus_read;
     ext_bus->write = _ext_bus_write;
+    ext_bus->bank = _ext_bus_bank;
+    ext_bus->map = _ext_bus_map;
+    ext_bus->usage = _ext_bus_usage;
     ext_bus->ext_ram = ext_ram;
     ext_bus->cart = cart;
 
     return (bus_t *)ext_bus;
 }
+
+bool
+ext_bus_is_std(bus_t *bus)
+{
+    /* only our own buses read through this */
+    return bus->read ==
+        (uint8_t (*)(bus_t *, uint16_t, bool))_ext_bus_read;
+}
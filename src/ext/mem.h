@@ -3,23 +3,32 @@
 
 #include <stdint.h>
 
-/* very simple representation of a memory array of 0x10000 bytes */
-typedef struct mem64 {
-    uint8_t data[0x10000];
-} mem64_t;
+/* very simple representation of an 8KiB SRAM chip, like the WRAM and the VRAM.
+ * only the lower 13 address lines are wired to it, so it shows up again every
+ * 8KiB (this is what makes echo RAM) */
+typedef struct mem8k {
+    uint8_t data[0x2000];
+} mem8k_t;
 
 static inline uint8_t
-mem64_read(mem64_t *mem, uint16_t addr)
+mem8k_read(mem8k_t *mem, uint16_t addr)
 {
     /* very simple... */
-    return mem->data[addr];
+    return mem->data[addr & 0x1FFF];
 }
 
 static inline void
-mem64_write(mem64_t *mem, uint16_t addr, uint8_t val)
+mem8k_write(mem8k_t *mem, uint16_t addr, uint8_t val)
 {
     /* also simple... */
-    mem->data[addr] = val;
+    mem->data[addr & 0x1FFF] = val;
+}
+
+static inline uint8_t *
+mem8k_page(mem8k_t *mem, uint16_t addr)
+{
+    /* the 256-byte page an address falls in */
+    return &mem->data[addr & 0x1F00];
 }
 
 #endif /* __MEM_H */
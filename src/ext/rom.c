@@ -0,0 +1,104 @@
+#include "rom.h"
+#include "log.h"
+#include "types.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static bool
+_rom_read(rom_t *rom, int fd)
+{
+    /* not every filesystem can map files. read those the old way instead */
+    rom->data = malloc(rom->size);
+    if (!rom->data)
+        gb_die(errno);
+
+    for (size_t done = 0; done < rom->size;) {
+        ssize_t n = read(fd, rom->data + done, rom->size - done);
+        if (n <= 0) {
+            free(rom->data);
+            return false;
+        }
+        done += n;
+    }
+
+    rom->mapped = false;
+    return true;
+}
+
+enum gb_err
+rom_open(rom_t **prom, const char *filename)
+{
+    enum gb_err err;
+
+    /* open the file and see how big it is */
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0) {
+        LOG(LOG_ERR, "failed to open file");
+        return GBEMU_BAD_FILE;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) < 0 || !S_ISREG(st.st_mode)) {
+        LOG(LOG_ERR, "can't tell the size of the ROM");
+        err = GBEMU_BAD_FILE;
+        goto close;
+    }
+
+    /* there's at least the two fixed banks */
+    if (st.st_size < 0x8000) {
+        LOG(LOG_ERR, "ROM file is too small");
+        err = GBEMU_BAD_FILE;
+        goto close;
+    }
+
+    /* try allocating */
+    rom_t *rom = malloc(sizeof(rom_t));
+    if (!rom)
+        gb_die(errno);
+    rom->size = st.st_size;
+    atomic_init(&rom->refs, 1);
+
+    /* map the whole file. nothing is read until it's touched, and every
+     * instance of the same game ends up on the same pages */
+    rom->data = mmap(NULL, rom->size, PROT_READ, MAP_SHARED, fd, 0);
+    rom->mapped = rom->data != MAP_FAILED;
+    if (!rom->mapped && !_rom_read(rom, fd)) {
+        LOG(LOG_ERR, "can't read ROM from file");
+        free(rom);
+        err = GBEMU_BAD_FILE;
+        goto close;
+    }
+
+    /* the mapping stays valid without the file */
+    close(fd);
+    *prom = rom;
+    return GBEMU_SUCCESS;
+
+close:
+    close(fd);
+    return err;
+}
+
+rom_t *
+rom_ref(rom_t *rom)
+{
+    atomic_fetch_add(&rom->refs, 1);
+    return rom;
+}
+
+void
+rom_unref(rom_t *rom)
+{
+    /* the last one out unmaps the image */
+    if (atomic_fetch_sub(&rom->refs, 1) != 1)
+        return;
+
+    if (rom->mapped)
+        munmap(rom->data, rom->size);
+    else
+        free(rom->data);
+    free(rom);
+}
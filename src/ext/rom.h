@@ -0,0 +1,23 @@
+#ifndef __ROM_H
+#define __ROM_H
+
+#include <gbemu/errors.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* a ROM image, mapped straight from its file. it is never written to, so any
+ * number of carts can share it; the last one to let go unmaps it */
+typedef struct rom {
+    uint8_t *data;
+    size_t  size;
+    bool    mapped;
+    atomic_uint refs;
+} rom_t;
+
+enum gb_err rom_open(rom_t **prom, const char *filename);
+rom_t      *rom_ref(rom_t *rom);
+void        rom_unref(rom_t *rom);
+
+#endif /* __ROM_H */
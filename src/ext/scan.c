@@ -0,0 +1,237 @@
+#include "scan.h"
+#include "log.h"
+#include "types.h"
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+enum gb_err
+scan_file(const char *path, scan_entry_t *entry)
+{
+    memset(entry, 0, sizeof(*entry));
+    entry->status = GBEMU_BAD_FILE;
+
+    /* the header is all we need */
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return entry->status;
+
+    struct stat st;
+    uint8_t header[0x150];
+    bool ok = fstat(fd, &st) == 0 && S_ISREG(st.st_mode) &&
+        pread(fd, header, sizeof(header), 0) == sizeof(header);
+    close(fd);
+    if (!ok)
+        return entry->status;
+
+    /* a bad header checksum means a bad dump (or no cart at all) */
+    cart_header_t hdr;
+    enum gb_err err = cart_parse_header(header, st.st_size, &hdr);
+    if (err == GBEMU_SUCCESS && !hdr.checksum_ok)
+        err = GBEMU_BAD_CART;
+
+    entry->size = st.st_size;
+    memcpy(entry->title, hdr.title, sizeof(entry->title));
+    entry->status = err;
+    entry->type = hdr.type;
+    entry->flags = (hdr.checksum_ok ? SCAN_CHECKSUM_OK : 0) |
+        (hdr.battery ? SCAN_BATTERY : 0) | (hdr.rtc ? SCAN_RTC : 0);
+    entry->nrams = hdr.nrams;
+    entry->nbanks = hdr.nbanks;
+    entry->global_checksum = hdr.global_checksum;
+    return err;
+}
+
+/* the work shared by the scanning threads. each one takes the next file
+ * until there are none left */
+struct scan_work {
+    const char *const *paths;
+    scan_entry_t *entries;
+    size_t count;
+    atomic_size_t next;
+};
+
+static void *
+_scan_worker(void *arg)
+{
+    struct scan_work *work = arg;
+    for (;;) {
+        size_t i = atomic_fetch_add(&work->next, 1);
+        if (i >= work->count)
+            return NULL;
+        scan_file(work->paths[i], &work->entries[i]);
+    }
+}
+
+/* qsort() can't be given the paths, so sort pointers to them */
+static int
+_scan_cmp(const void *a, const void *b)
+{
+    return strcmp(**(const char *const *const *)a,
+            **(const char *const *const *)b);
+}
+
+static bool
+_scan_write(const char *index, const char *const *paths,
+        const scan_entry_t *entries, size_t count)
+{
+    /* the entries go in path order, so that they can be searched */
+    const char *const **order = malloc(count * sizeof(*order));
+    if (!order && count)
+        gb_die(errno);
+    for (size_t i = 0; i < count; ++i)
+        order[i] = &paths[i];
+    qsort(order, count, sizeof(*order), _scan_cmp);
+
+    /* write a new file and move it over the old one, so that whoever has
+     * the old one mapped is left alone */
+    char tmp[strlen(index) + sizeof(".tmp")];
+    strcpy(tmp, index);
+    strcat(tmp, ".tmp");
+    FILE *file = fopen(tmp, "wb");
+    if (!file) {
+        free(order);
+        return false;
+    }
+
+    scan_file_header_t header = {
+        .magic = SCAN_MAGIC,
+        .version = SCAN_VERSION,
+        .count = count,
+        .strings = sizeof(header) + count * sizeof(scan_entry_t),
+    };
+    bool ok = fwrite(&header, sizeof(header), 1, file) == 1;
+
+    uint32_t offset = 0;
+    for (size_t i = 0; ok && i < count; ++i) {
+        scan_entry_t entry = entries[order[i] - paths];
+        entry.path = offset;
+        offset += strlen(*order[i]) + 1;
+        ok = fwrite(&entry, sizeof(entry), 1, file) == 1;
+    }
+    for (size_t i = 0; ok && i < count; ++i)
+        ok = fputs(*order[i], file) >= 0 && fputc('\0', file) == '\0';
+
+    free(order);
+    if (fclose(file) || !ok || rename(tmp, index)) {
+        unlink(tmp);
+        return false;
+    }
+    return true;
+}
+
+enum gb_err
+scan_library(const char *const *paths, size_t count, unsigned nthreads,
+        const char *index)
+{
+    /* one thread per CPU, unless told otherwise */
+    if (!nthreads)
+        nthreads = sysconf(_SC_NPROCESSORS_ONLN);
+    if (nthreads > count)
+        nthreads = count ? count : 1;
+
+    struct scan_work work = {
+        .paths = paths,
+        .entries = calloc(count, sizeof(scan_entry_t)),
+        .count = count,
+    };
+    if (!work.entries && count)
+        gb_die(errno);
+    atomic_init(&work.next, 0);
+
+    /* this thread works too */
+    pthread_t threads[nthreads];
+    unsigned started = 0;
+    for (unsigned i = 1; i < nthreads; ++i) {
+        if (pthread_create(&threads[started], NULL, _scan_worker, &work))
+            break;
+        ++started;
+    }
+    _scan_worker(&work);
+    for (unsigned i = 0; i < started; ++i)
+        pthread_join(threads[i], NULL);
+
+    bool ok = _scan_write(index, paths, work.entries, count);
+    free(work.entries);
+    if (!ok) {
+        LOG(LOG_ERR, "can't write the index");
+        return GBEMU_BAD_FILE;
+    }
+    return GBEMU_SUCCESS;
+}
+
+enum gb_err
+scan_index_open(scan_index_t *idx, const char *index)
+{
+    int fd = open(index, O_RDONLY);
+    if (fd < 0) {
+        LOG(LOG_ERR, "failed to open index");
+        return GBEMU_BAD_FILE;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) < 0 ||
+            (size_t)st.st_size < sizeof(scan_file_header_t)) {
+        LOG(LOG_ERR, "index is too small");
+        close(fd);
+        return GBEMU_BAD_FILE;
+    }
+
+    /* nothing is read until it's looked up */
+    idx->size = st.st_size;
+    idx->map = mmap(NULL, idx->size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (idx->map == MAP_FAILED) {
+        LOG(LOG_ERR, "can't map the index");
+        return GBEMU_BAD_FILE;
+    }
+
+    /* check that everything is where the header says */
+    const scan_file_header_t *header = idx->map;
+    if (header->magic != SCAN_MAGIC || header->version != SCAN_VERSION ||
+            header->strings != sizeof(*header) +
+                (uint64_t)header->count * sizeof(scan_entry_t) ||
+            header->strings > idx->size ||
+            (header->count && ((const char *)idx->map)[idx->size - 1])) {
+        LOG(LOG_ERR, "bad index");
+        munmap(idx->map, idx->size);
+        return GBEMU_BAD_FILE;
+    }
+
+    idx->entries = (const scan_entry_t *)(header + 1);
+    idx->strings = (const char *)idx->map + header->strings;
+    idx->count = header->count;
+    idx->strings_size = idx->size - header->strings;
+    return GBEMU_SUCCESS;
+}
+
+const scan_entry_t *
+scan_index_find(const scan_index_t *idx, const char *path)
+{
+    /* binary search on the paths. a path pointing out of the file means a
+     * broken index */
+    size_t lo = 0, hi = idx->count;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (idx->entries[mid].path >= idx->strings_size)
+            return NULL;
+        int cmp = strcmp(path, scan_index_path(idx, &idx->entries[mid]));
+        if (!cmp)
+            return &idx->entries[mid];
+        if (cmp < 0)
+            hi = mid;
+        else
+            lo = mid + 1;
+    }
+    return NULL;
+}
+
+void
+scan_index_close(scan_index_t *idx)
+{
+    munmap(idx->map, idx->size);
+}
@@ -0,0 +1,64 @@
+#ifndef __SCAN_H
+#define __SCAN_H
+
+#include "cart.h"
+
+#include <gbemu/errors.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* the ROM library index. scanning only reads the header of each ROM, many at
+ * a time, and the results go into a file that is used straight from a
+ * mapping: a header, the entries sorted by path, then the paths */
+#define SCAN_MAGIC      0x58494247  /* "GBIX" */
+#define SCAN_VERSION    1
+
+typedef struct scan_file_header {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t count;
+    uint32_t strings;   /* where the paths start */
+} scan_file_header_t;
+
+/* scan entry flags */
+#define SCAN_CHECKSUM_OK    (1 << 0)
+#define SCAN_BATTERY        (1 << 1)
+#define SCAN_RTC            (1 << 2)
+
+typedef struct scan_entry {
+    uint32_t path;      /* offset of the path among the paths */
+    uint32_t size;      /* of the file */
+    char     title[16];
+    uint8_t  status;    /* enum gb_err. only GBEMU_SUCCESS can be run */
+    uint8_t  type;
+    uint8_t  flags;
+    uint8_t  nrams;
+    uint16_t nbanks;
+    uint16_t global_checksum;
+} scan_entry_t;
+
+/* an index file, mapped */
+typedef struct scan_index {
+    void    *map;
+    size_t  size;
+    const scan_entry_t *entries;
+    const char *strings;
+    size_t  count;
+    size_t  strings_size;
+} scan_index_t;
+
+enum gb_err scan_file(const char *path, scan_entry_t *entry);
+enum gb_err scan_library(const char *const *paths, size_t count,
+                         unsigned nthreads, const char *index);
+enum gb_err scan_index_open(scan_index_t *idx, const char *index);
+const scan_entry_t *scan_index_find(const scan_index_t *idx,
+                                    const char *path);
+void        scan_index_close(scan_index_t *idx);
+
+static inline const char *
+scan_index_path(const scan_index_t *idx, const scan_entry_t *entry)
+{
+    return idx->strings + entry->path;
+}
+
+#endif /* __SCAN_H */
@@ -0,0 +1,123 @@
+#ifndef __STD_BUS_H
+#define __STD_BUS_H
+
+#include "bus.h"
+#include "log.h"
+
+/* the stock DMG buses. their layout and their read/write paths live here so
+ * that a build which only ever uses them (GBEMU_STD_BUS) can call them
+ * directly instead of through the bus_t pointers. they still fill in bus_t,
+ * so everything else can treat them like any other bus */
+
+/* this represents an external bus */
+typedef struct ext_bus {
+    uint8_t (*read)(struct ext_bus *bus, uint16_t addr, bool cs);
+    void    (*write)(struct ext_bus *bus, uint16_t addr, bool cs, uint8_t val);
+    unsigned (*bank)(struct ext_bus *bus, uint16_t addr, bool cs);
+    uint8_t *(*map)(struct ext_bus *bus, uint16_t addr, bool cs, bool write);
+    size_t  (*usage)(struct ext_bus *bus);
+    mem8k_t *ext_ram;
+    cart_t  *cart;
+} ext_bus_t;
+
+/* this represents a video bus */
+typedef struct vid_bus {
+    uint8_t (*read)(struct vid_bus *bus, uint16_t addr, bool cs);
+    void    (*write)(struct vid_bus *bus, uint16_t addr, bool cs, uint8_t val);
+    unsigned (*bank)(struct vid_bus *bus, uint16_t addr, bool cs);
+    uint8_t *(*map)(struct vid_bus *bus, uint16_t addr, bool cs, bool write);
+    size_t  (*usage)(struct vid_bus *bus);
+    mem8k_t *vram;
+} vid_bus_t;
+
+/* quick shortcuts */
+#define A15(addr) (addr & 0x8000)
+#define A14(addr) (addr & 0x4000)
+#define A13(addr) (addr & 0x2000)
+
+static inline uint8_t
+_ext_bus_read(ext_bus_t *bus, uint16_t addr, bool cs)
+{
+    /* if A15 is low (ROM) */
+    if (cs && !A15(addr))
+        return bus->cart->read_rom(bus->cart, addr);
+
+    /* if #cs is low and A14 is up (ext RAM). by placing this before cart RAM,
+     * we make Echo RAM possible. notice however that if A14 and A15 are up at
+     * the same time, the PC should explode */
+    if (!cs && A14(addr))
+        return mem8k_read(bus->ext_ram, addr);
+
+    /* if #cs is low and A13 is up (cart RAM) */
+    if (!cs && A13(addr))
+        return bus->cart->read_ram(bus->cart, addr);
+
+    /* this is not supposed to happen */
+    LOG(LOG_ERR, "bad read issued to external bus");
+    return 0xFF;
+}
+
+static inline void
+_ext_bus_write(ext_bus_t *bus, uint16_t addr, bool cs, uint8_t val)
+{
+    /* if A15 is low (ROM) */
+    if (cs && !A15(addr)) {
+        bus->cart->write_rom(bus->cart, addr, val);
+        return;
+    }
+
+    /* if #cs is low and A14 is up (ext RAM). by placing this before cart RAM,
+     * we make Echo RAM possible. notice however that if A14 and A15 are up at
+     * the same time, the PC should explode */
+    if (!cs && A14(addr)) {
+        mem8k_write(bus->ext_ram, addr, val);
+        return;
+    }
+
+    /* if #cs is low and A13 is up (cart RAM) */
+    if (!cs && A13(addr)) {
+        bus->cart->write_ram(bus->cart, addr, val);
+        return;
+    }
+
+    /* not supposed to happen */
+    LOG(LOG_ERR, "bad write issued to external bus");
+}
+
+static inline unsigned
+_ext_bus_bank(ext_bus_t *bus, uint16_t addr, bool cs)
+{
+    /* the external RAM is never switched, only the cart can be */
+    if (!cs && A14(addr))
+        return 0;
+
+    return bus->cart->bank(bus->cart, addr);
+}
+
+static inline uint8_t
+_vid_bus_read(vid_bus_t *bus, uint16_t addr, bool cs)
+{
+    /* if the only chip is not selected (VRAM), error */
+    if (cs) {
+        LOG(LOG_ERR, "bad read issued to video bus");
+        return 0xFF;
+    }
+
+    /* just return the vram data */
+    return mem8k_read(bus->vram, addr);
+}
+
+static inline void
+_vid_bus_write(vid_bus_t *bus, uint16_t addr, bool cs, uint8_t val)
+{
+    /* if the only chip is not selected (VRAM), error */
+    if (cs) {
+        LOG(LOG_ERR, "bad write issued to video bus");
+        return;
+    }
+
+    /* set value */
+    mem8k_write(bus->vram, addr, val);
+}
+
+#endif /* __STD_BUS_H */
@@ -1,42 +1,33 @@
-#include "bus.h"
+#include "std_bus.h"
 #include "log.h"
 #include "types.h"
 
-/* this represents a video bus */
-typedef struct vid_bus {
-    uint8_t (*read)(struct vid_bus *bus, uint16_t addr, bool cs);
-    void    (*write)(struct vid_bus *bus, uint16_t addr, bool cs, uint8_t val);
-    mem64_t *vram;
-} vid_bus_t;
+static unsigned
+_vid_bus_bank(vid_bus_t *bus, uint16_t addr, bool cs)
+{
+    /* there's only one VRAM bank on the DMG */
+    return 0;
+}
 
-static uint8_t
-_vid_bus_read(vid_bus_t *bus, uint16_t addr, bool cs)
+static uint8_t *
+_vid_bus_map(vid_bus_t *bus, uint16_t addr, bool cs, bool write)
 {
-    /* if the only chip is not selected (VRAM), error */
-    if (cs) {
-        LOG(LOG_ERR, "bad read issued to video bus");
-        return 0xFF;
-    }
-
-    /* just return the vram data */
-    return bus->vram->data[addr];
+    /* VRAM is the only chip, and it's plain memory */
+    if (cs)
+        return NULL;
+
+    return mem8k_page(bus->vram, addr);
 }
 
-static void
-_vid_bus_write(vid_bus_t *bus, uint16_t addr, bool cs, uint8_t val)
+static size_t
+_vid_bus_usage(vid_bus_t *bus)
 {
-    /* if the only chip is not selected (VRAM), error */
-    if (cs) {
-        LOG(LOG_ERR, "bad write issued to video bus");
-        return;
-    }
-
-    /* set value */
-    bus->vram->data[addr] = val;
+    /* the bus itself and the VRAM */
+    return sizeof(*bus) + sizeof(*bus->vram);
 }
 
 bus_t *
-vid_bus_create(mem64_t *vram)
+vid_bus_create(mem8k_t *vram)
 {
     /* try to allocate bus */
     vid_bus_t *vid_bus = malloc(sizeof(vid_bus_t));
@@ -46,7 +37,18 @@ vid_bus_create(mem64_t *vram)
     /* fill struct */
     vid_bus->read = _vid_bus_read;
     vid_bus->write = _vid_bus_write;
+    vid_bus->bank = _vid_bus_bank;
+    vid_bus->map = _vid_bus_map;
+    vid_bus->usage = _vid_bus_usage;
     vid_bus->vram = vram;
 
     return (bus_t *)vid_bus;
 }
+
+bool
+vid_bus_is_std(bus_t *bus)
+{
+    /* only our own buses read through this */
+    return bus->read ==
+        (uint8_t (*)(bus_t *, uint16_t, bool))_vid_bus_read;
+}
@@ -0,0 +1,58 @@
+#include "soc/soc.h"
+#include "log.h"
+#include "types.h"
+
+/* the image generated by gbemu-aot. it is only there if it has been linked in */
+extern const aot_image_t aot_image __attribute__((weak));
+
+const aot_image_t *
+aot_match(bus_t *ext_bus)
+{
+    /* nothing has been linked in */
+    const aot_image_t *image = &aot_image;
+    if (!image)
+        return NULL;
+
+    /* the image must have been compiled from this very ROM */
+    for (size_t i = 0; i < sizeof(image->title); ++i)
+        if (ext_bus->read(ext_bus, 0x0134 + i, true) != (uint8_t)image->title[i])
+            return NULL;
+
+    uint16_t global_checksum = ext_bus->read(ext_bus, 0x014E, true) << 8 |
+        ext_bus->read(ext_bus, 0x014F, true);
+    if (ext_bus->read(ext_bus, 0x014D, true) != image->header_checksum ||
+            global_checksum != image->global_checksum)
+        return NULL;
+
+    LOG(LOG_INFO, "using %zu blocks compiled ahead of time", image->nblocks);
+    return image;
+}
+
+void
+aot_attach(const aot_image_t *image, bcache_block_t *block)
+{
+    /* binary search by bank and PC */
+    size_t lo = 0, hi = image->nblocks;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        const aot_block_t *aot = &image->blocks[mid];
+        if (aot->bank < block->bank ||
+                (aot->bank == block->bank && aot->pc < block->pc)) {
+            lo = mid + 1;
+        } else if (aot->bank == block->bank && aot->pc == block->pc) {
+            /* the tool builds blocks the same way we do. if they don't match,
+             * better not trust it */
+            if (aot->len != block->len || aot->end != block->end) {
+                LOG(LOG_ERR, "AOT block at 0x%04X:%u doesn't match",
+                        block->pc, block->bank);
+                return;
+            }
+
+            block->native = aot->fn;
+            block->native_cycles = aot->cycles;
+            return;
+        } else {
+            hi = mid;
+        }
+    }
+}
@@ -0,0 +1,330 @@
+#include "soc/instr/instrs.h"
+#include "soc/soc.h"
+#include "log.h"
+#include "types.h"
+
+/* the areas code can be cached from. a block never crosses one of these, so
+ * that it always sits on a single bank of a single chip */
+static inline bool
+_bcache_get_area(uint16_t addr, uint16_t *start, uint16_t *end)
+{
+    /* 0x0000 - 0x3FFF fixed ROM bank */
+    if (addr < 0x4000) {
+        *start = 0x0000;
+        *end = 0x4000;
+        return true;
+    }
+
+    /* 0x4000 - 0x7FFF switchable ROM bank */
+    if (addr < 0x8000) {
+        *start = 0x4000;
+        *end = 0x8000;
+        return true;
+    }
+
+    /* 0x8000 - 0x9FFF VRAM is too tangled with the PPU */
+    if (addr < 0xA000)
+        return false;
+
+    /* 0xA000 - 0xBFFF cart RAM */
+    if (addr < 0xC000) {
+        *start = 0xA000;
+        *end = 0xC000;
+        return true;
+    }
+
+    /* 0xC000 - 0xDFFF WRAM */
+    if (addr < 0xE000) {
+        *start = 0xC000;
+        *end = 0xE000;
+        return true;
+    }
+
+    /* 0xE000 - 0xFDFF echo RAM */
+    if (addr < 0xFE00) {
+        *start = 0xE000;
+        *end = 0xFE00;
+        return true;
+    }
+
+    /* 0xFF80 - 0xFFFE HRAM (OAM and I/O are never cached) */
+    if (addr >= 0xFF80 && addr < 0xFFFF) {
+        *start = 0xFF80;
+        *end = 0xFFFF;
+        return true;
+    }
+
+    return false;
+}
+
+static inline unsigned
+_bcache_get_bank(bcache_t *bcache, uint16_t addr)
+{
+    /* HRAM is inside the SoC */
+    if (addr >= 0xFF80)
+        return 0;
+
+    return _soc_ext_bank(bcache->soc, addr, addr < 0x8000);
+}
+
+uint8_t
+bcache_peek(bcache_t *bcache, uint16_t addr)
+{
+    /* read the code without going through the bus priorities, this is not a
+     * real access */
+    if (addr >= 0xFF80)
+        return bcache->soc->hram[addr & 0xFF];
+
+    return _soc_ext_read(bcache->soc, addr, addr < 0x8000);
+}
+
+/* what every slot holds before a block is built there. it is never valid */
+static bcache_block_t _bcache_empty;
+
+static inline unsigned
+_bcache_get_slot_idx(uint16_t pc, unsigned bank)
+{
+    return (pc ^ (bank << 5)) & (BCACHE_BLOCKS - 1);
+}
+
+static inline bcache_block_t *
+_bcache_get_slot(bcache_t *bcache, uint16_t pc, unsigned bank)
+{
+    return bcache->blocks[_bcache_get_slot_idx(pc, bank)];
+}
+
+static bcache_block_t *
+_bcache_alloc(bcache_t *bcache)
+{
+    /* a new chunk is only needed when the last one is used up */
+    unsigned chunk = bcache->nblocks / BCACHE_CHUNK;
+    unsigned idx = bcache->nblocks % BCACHE_CHUNK;
+    assert(chunk < BCACHE_BLOCKS / BCACHE_CHUNK);
+    if (!idx) {
+        bcache->chunks[chunk] = malloc(BCACHE_CHUNK * sizeof(bcache_block_t));
+        if (!bcache->chunks[chunk])
+            gb_die(errno);
+    }
+
+    ++bcache->nblocks;
+    return &bcache->chunks[chunk][idx];
+}
+
+static void
+_bcache_mark_ram(bcache_t *bcache, bcache_block_t *block)
+{
+    /* only RAM can change under our feet */
+    if (block->pc < BCACHE_RAM_START)
+        return;
+
+    for (uint16_t addr = block->pc; addr != block->end; ++addr) {
+        unsigned idx = _bcache_ram_idx(addr);
+        bcache->code[idx >> 3] |= 1 << (idx & 7);
+    }
+}
+
+static bcache_block_t *
+_bcache_build(bcache_t *bcache, uint16_t pc, unsigned bank)
+{
+    /* the block must stay inside a single area */
+    uint16_t start, end;
+    if (!_bcache_get_area(pc, &start, &end))
+        return NULL;
+
+    /* evict whatever was there. the first block in a slot gets allocated */
+    unsigned slot = _bcache_get_slot_idx(pc, bank);
+    bcache_block_t *block = bcache->blocks[slot];
+    if (block == &_bcache_empty) {
+        block = _bcache_alloc(bcache);
+        bcache->blocks[slot] = block;
+    }
+    block->valid = false;
+    block->ext = pc < 0xFF80;
+    block->pc = pc;
+    block->bank = bank;
+    block->len = 0;
+    block->native = NULL;
+    block->native_cycles = 0;
+#ifdef GBEMU_JIT
+    block->hits = 0;
+    block->nojit = false;
+#endif
+
+    /* decode until we get to a jump or the block is full */
+    uint16_t addr = pc;
+    while (block->len < BCACHE_BLOCK_LEN) {
+        uint8_t ir = bcache_peek(bcache, addr);
+        unsigned len = cpu_instr_len(ir);
+
+        /* the whole instruction must fit the area */
+        if (end - addr < len)
+            break;
+
+        /* decode the instruction and its CB part, if any */
+        cpu_op_t *op = &block->ops[block->len];
+        cpu_decode(op, ir);
+        if (ir == 0xCB)
+            cpu_decode_cb(op, bcache_peek(bcache, addr + 1));
+
+        block->pcs[block->len++] = addr;
+        addr += len;
+
+        if (cpu_instr_ends_block(ir) || addr == end)
+            break;
+    }
+
+    /* nothing could be decoded */
+    if (!block->len)
+        return NULL;
+
+    /* look for the sequences that run as one */
+    cpu_fuse(block->ops, block->len);
+
+    /* the block is ready */
+    block->end = addr;
+    block->valid = true;
+    _bcache_mark_ram(bcache, block);
+
+    /* ROM blocks might have been compiled ahead of time */
+    if (bcache->soc->aot && pc < 0x8000)
+        aot_attach(bcache->soc->aot, block);
+
+    return block;
+}
+
+void
+_bcache_invalidate(bcache_t *bcache, uint16_t addr)
+{
+    /* self-modifying code is rare, so just go through the whole cache */
+    unsigned idx = _bcache_ram_idx(addr);
+    for (size_t i = 0; i < BCACHE_BLOCKS; ++i) {
+        bcache_block_t *block = bcache->blocks[i];
+        if (!block->valid || block->pc < BCACHE_RAM_START)
+            continue;
+
+        unsigned first = _bcache_ram_idx(block->pc);
+        if (idx >= first && idx < first + (uint16_t)(block->end - block->pc))
+            block->valid = false;
+    }
+
+    /* the current block might be gone */
+    bcache->cur = NULL;
+
+    /* blocks might overlap and evicted ones leave their marks behind, so
+     * rebuild the map from the remaining blocks */
+    memset(bcache->code, 0, sizeof(bcache->code));
+    for (size_t i = 0; i < BCACHE_BLOCKS; ++i)
+        if (bcache->blocks[i]->valid)
+            _bcache_mark_ram(bcache, bcache->blocks[i]);
+}
+
+bcache_block_t *
+bcache_probe(bcache_t *bcache, uint16_t pc)
+{
+    /* look for a block starting right at PC, without building one */
+    uint16_t start, end;
+    if (!_bcache_get_area(pc, &start, &end))
+        return NULL;
+
+    unsigned bank = _bcache_get_bank(bcache, pc);
+    bcache_block_t *block = _bcache_get_slot(bcache, pc, bank);
+    if (!block->valid || block->pc != pc || block->bank != bank)
+        return NULL;
+
+    return block;
+}
+
+const cpu_op_t *
+bcache_fetch(bcache_t *bcache, uint16_t pc)
+{
+    bcache_block_t *block = bcache->cur;
+
+    /* most of the time, we're just moving through the current block */
+    if (!block || bcache->idx >= block->len || block->pcs[bcache->idx] != pc) {
+        /* look the block up by its PC and bank */
+        uint16_t start, end;
+        if (!_bcache_get_area(pc, &start, &end)) {
+            bcache->cur = NULL;
+            return NULL;
+        }
+
+        unsigned bank = _bcache_get_bank(bcache, pc);
+        block = _bcache_get_slot(bcache, pc, bank);
+        if (!block->valid || block->pc != pc || block->bank != bank)
+            block = _bcache_build(bcache, pc, bank);
+
+        bcache->cur = block;
+        bcache->idx = 0;
+        if (!block)
+            return NULL;
+    }
+
+    /* if DMA is holding the external bus, the CPU would read garbage. let the
+     * real bus handle that */
+    if (block->ext && bcache->soc->ext_prio != PRIO_CPU)
+        return NULL;
+
+    return &block->ops[bcache->idx++];
+}
+
+unsigned
+bcache_run_native(bcache_t *bcache, cpu_t *cpu)
+{
+    soc_t *soc = bcache->soc;
+
+#ifndef GBEMU_JIT
+    /* without the JIT, only an AOT image brings native code */
+    if (!soc->aot)
+        return 0;
+#endif
+
+    /* only whole blocks are compiled */
+    bcache_block_t *block = bcache_probe(bcache, cpu->pc.val);
+    if (!block)
+        return 0;
+
+#ifdef GBEMU_JIT
+    /* the JIT compiles the block once it gets hot */
+    if (!block->native)
+        jit_enter(soc->jit, block);
+#endif
+
+    if (!block->native || !soc_can_run_ahead(soc, block->native_cycles))
+        return 0;
+
+    unsigned ret = block->native(cpu, block->ops);
+    unsigned cycles = ret >> 8, idx = ret & 0xFF;
+
+    /* the interpreter resumes inside the block if it stopped halfway */
+    if (idx < block->len) {
+        bcache->cur = block;
+        bcache->idx = idx;
+    } else {
+        bcache->cur = NULL;
+    }
+
+    return cycles;
+}
+
+void
+bcache_init(bcache_t *bcache, soc_t *soc)
+{
+    /* set up SoC */
+    bcache->soc = soc;
+
+    /* the cache starts empty */
+    bcache->cur = NULL;
+    bcache->idx = 0;
+    memset(bcache->code, 0, sizeof(bcache->code));
+    for (size_t i = 0; i < BCACHE_BLOCKS; ++i)
+        bcache->blocks[i] = &_bcache_empty;
+    bcache->nblocks = 0;
+}
+
+void
+bcache_deinit(bcache_t *bcache)
+{
+    /* free the chunks that have been allocated */
+    for (unsigned i = 0; i * BCACHE_CHUNK < bcache->nblocks; ++i)
+        free(bcache->chunks[i]);
+}
@@ -7,6 +7,13 @@
 bool
 _cpu_read_byte(cpu_t *cpu, uint8_t *dst, uint16_t addr)
 {
+    /* plain memory on a bus the CPU owns is a single load away */
+    const uint8_t *page = cpu->soc->map.cpu_read[addr >> 8];
+    if (page) {
+        *dst = page[addr & 0xFF];
+        return true;
+    }
+
     /* 0x0000 - 0x7FFF External bus, CS=1 (cart ROM) */
     if (addr < 0x8000) {
         *dst = soc_ext_bus_read(cpu->soc, PRIO_CPU, addr, true);
@@ -43,25 +50,44 @@ _cpu_read_byte(cpu_t *cpu, uint8_t *dst, uint16_t addr)
 void
 _cpu_write_byte(cpu_t *cpu, uint16_t addr, uint8_t val)
 {
+    /* same for writes, but RAM might hold cached code and VRAM decoded
+     * tiles */
+    uint8_t *page = cpu->soc->map.cpu_write[addr >> 8];
+    if (page) {
+        if (addr >= BCACHE_RAM_START)
+            bcache_write(cpu->soc->bcache, addr);
+        else
+            ppu_vram_write(cpu->soc->ppu, addr);
+        page[addr & 0xFF] = val;
+        return;
+    }
+
     /* 0x0000 - 0x7FFF External bus, CS=1 (cart ROM) */
-    if (addr < 0x8000)
+    if (addr < 0x8000) {
+        bcache_write(cpu->soc->bcache, addr);
         return soc_ext_bus_write(cpu->soc, PRIO_CPU, addr, true, val);
+    }
 
     /* 0x8000 - 0x9FFF Video bus, CS=0 */
     if (addr < 0xA000)
         return soc_vid_bus_write(cpu->soc, PRIO_CPU, addr, false, val);
 
     /* 0xA000 - 0xFDFF External bus, CS=0 (rams) */
-    if (addr < 0xFE00)
+    if (addr < 0xFE00) {
+        bcache_write(cpu->soc->bcache, addr);
         return soc_ext_bus_write(cpu->soc, PRIO_CPU, addr, false, val);
+    }
 
     /* 0xFE00 - 0xFEFF OAM + unused area */
     if (addr < 0xFF00)
         return soc_oam_write(cpu->soc, PRIO_CPU, addr & 0xFF, val);
 
     /* 0xFF00 - 0xFFFE High area (HRAM and registers) */
-    if (addr < 0xFFFF)
+    if (addr < 0xFFFF) {
+        if (addr >= 0xFF80)
+            bcache_write(cpu->soc->bcache, addr);
         return soc_internal_write(cpu->soc, addr & 0xFF, val);
+    }
 
     /* 0xFFFF - IE register */
     cpu->ie = val;
@@ -76,12 +102,543 @@ _cpu_read_imm8(cpu_t *cpu, uint8_t *dst)
     return ret;
 }
 
+static inline bool
+_cpu_plain_write(cpu_t *cpu, uint16_t addr)
+{
+    /* ROM writes go to the MBC and might switch the bank under us */
+    if (!((addr >= 0xA000 && addr < 0xFE00) ||
+                (addr >= 0xFF80 && addr < 0xFFFF)))
+        return false;
+
+    /* writes to cached code invalidate blocks, possibly the running one */
+    unsigned idx = _bcache_ram_idx(addr);
+    return !(cpu->soc->bcache->code[idx >> 3] & (1 << (idx & 7)));
+}
+
+int
+cpu_native_read(cpu_t *cpu, uint32_t addr)
+{
+    uint8_t val;
+    if (!_cpu_plain_read(addr))
+        return -1;
+
+    _cpu_read_byte(cpu, &val, addr);
+    return val;
+}
+
+int
+cpu_native_write(cpu_t *cpu, uint32_t addr, uint32_t val)
+{
+    if (!_cpu_plain_write(cpu, addr))
+        return -1;
+
+    _cpu_write_byte(cpu, addr, val);
+    return 0;
+}
+
+int
+cpu_native_write_vram(cpu_t *cpu, uint32_t addr, uint32_t val,
+        unsigned mcycles)
+{
+    /* VRAM is as good as plain memory for a short run, as long as the PPU
+     * stays away from it until the end. the write marks its tile to be
+     * decoded again like any other */
+    if (addr < 0x8000 || addr >= 0xA000)
+        return cpu_native_write(cpu, addr, val);
+
+    if (cpu->soc->vid_prio != PRIO_CPU ||
+            !ppu_vram_idle(cpu->soc->ppu, 4 * mcycles))
+        return -1;
+
+    _cpu_write_byte(cpu, addr, val);
+    return 0;
+}
+
+int
+cpu_native_push(cpu_t *cpu, uint32_t sp, uint32_t val)
+{
+    /* both bytes must be fine before anything is written */
+    uint16_t hi = sp - 1, lo = sp - 2;
+    if (!_cpu_plain_write(cpu, hi) || !_cpu_plain_write(cpu, lo))
+        return -1;
+
+    _cpu_write_byte(cpu, hi, val >> 8);
+    _cpu_write_byte(cpu, lo, val & 0xFF);
+    return 0;
+}
+
+int
+cpu_native_pop(cpu_t *cpu, uint32_t sp)
+{
+    uint8_t lo, hi;
+    uint16_t next = sp + 1;
+    if (!_cpu_plain_read(sp) || !_cpu_plain_read(next))
+        return -1;
+
+    _cpu_read_byte(cpu, &lo, sp);
+    _cpu_read_byte(cpu, &hi, next);
+    return (hi << 8) | lo;
+}
+
+int
+cpu_native_read_z(cpu_t *cpu, uint32_t addr)
+{
+    /* this is _read_ihl_into_z(), for the handlers that work on Z */
+    if (!_cpu_plain_read(addr))
+        return -1;
+
+    _cpu_read_byte(cpu, &cpu->wz.lo, addr);
+    return 0;
+}
+
+int
+cpu_native_flags(cpu_t *cpu)
+{
+    /* F as PUSH AF sees it */
+    return _cpu_flags(cpu);
+}
+
+int
+cpu_native_set_flags(cpu_t *cpu, uint32_t val)
+{
+    /* F as POP AF leaves it */
+    _cpu_set_flags(cpu, val);
+    return 0;
+}
+
+int
+cpu_native_rmw(cpu_t *cpu, uint32_t addr, void (*fn)(cpu_t *))
+{
+    /* read into Z and let the handler write it back */
+    if (!_cpu_plain_read(addr) || !_cpu_plain_write(cpu, addr))
+        return -1;
+
+    _cpu_read_byte(cpu, &cpu->wz.lo, addr);
+    fn(cpu);
+    return 0;
+}
+
+static inline bool
+_cpu_plain_access(cpu_t *cpu, uint16_t addr, bool write)
+{
+    return write ? _cpu_plain_write(cpu, addr) : _cpu_plain_read(addr);
+}
+
+static bool
+_cpu_operands_plain(cpu_t *cpu, const cpu_op_t *op)
+{
+    /* the operands follow the opcode, which has already been read */
+    uint16_t pc = cpu->pc.val;
+    unsigned len = cpu_instr_len(op->ir);
+    for (unsigned i = 1; i < len; ++i)
+        if (!_cpu_plain_read((uint16_t)(pc + i - 1)))
+            return false;
+
+    return true;
+}
+
+static uint16_t
+_cpu_access_addr(cpu_t *cpu, const cpu_op_t *op)
+{
+    /* only some of the operands matter here */
+    uint16_t pc = cpu->pc.val;
+    uint8_t lo = 0, hi = 0;
+    if (op->access == ACCESS_HIGH_N || op->access == ACCESS_INN ||
+            op->access == ACCESS_INN_SP) {
+        _cpu_read_byte(cpu, &lo, pc);
+        if (cpu_instr_len(op->ir) > 2)
+            _cpu_read_byte(cpu, &hi, (uint16_t)(pc + 1));
+    }
+
+    /* the stack ones have two addresses, the caller knows them */
+    switch (op->access) {
+        case ACCESS_IHL:
+            return cpu->hl.val;
+        case ACCESS_IRR:
+            return cpu_op_rr(cpu, op->ir)->val;
+        case ACCESS_HIGH_N:
+            return 0xFF00 | lo;
+        case ACCESS_HIGH_C:
+            return 0xFF00 | cpu->bc.lo;
+        case ACCESS_INN:
+        case ACCESS_INN_SP:
+            return hi << 8 | lo;
+        default:
+            return 0;
+    }
+}
+
+static bool
+_cpu_whole_is_plain(cpu_t *cpu, const cpu_op_t *op)
+{
+    if (op->access == ACCESS_CYCLED || !_cpu_operands_plain(cpu, op))
+        return false;
+
+    /* the prefix decodes the byte again, make sure it's the one we know */
+    if (op->ir == 0xCB) {
+        uint8_t cb;
+        _cpu_read_byte(cpu, &cb, cpu->pc.val);
+        if (cb != op->cb_ir)
+            return false;
+    }
+
+    uint16_t addr = _cpu_access_addr(cpu, op), sp = cpu->sp.val;
+    switch (op->access) {
+        case ACCESS_NONE:
+            return true;
+        case ACCESS_INN_SP:
+            return _cpu_plain_write(cpu, addr) &&
+                _cpu_plain_write(cpu, (uint16_t)(addr + 1));
+        case ACCESS_PUSH:
+            return _cpu_plain_write(cpu, (uint16_t)(sp - 1)) &&
+                _cpu_plain_write(cpu, (uint16_t)(sp - 2));
+        case ACCESS_POP:
+            return _cpu_plain_read(sp) && _cpu_plain_read((uint16_t)(sp + 1));
+        default:
+            return _cpu_plain_access(cpu, addr, op->writes);
+    }
+}
+
+static unsigned
+_cpu_run_whole(cpu_t *cpu)
+{
+    /* an instruction that only touches plain memory can run all of its
+     * micro-ops right away: nobody else would see the difference. a single
+     * cycle one has nothing to gain */
+    const cpu_op_t *op = cpu->op;
+    if (op->mcycles < 2 || !_cpu_whole_is_plain(cpu, op) ||
+            !soc_can_run_ahead(cpu->soc, op->mcycles))
+        return 0;
+
+    /* the micro-ops still move the state themselves (conditions and the CB
+     * prefix), so walk the list as cpu_cycle() would */
+    unsigned mcycles = 0;
+    cpu->curlist = cpu_op_list(op);
+    cpu->state = FETCH;
+    while (cpu->curlist[cpu->state].fn) {
+        LOG(LOG_VERBOSE, "executing %s in PC 0x%04X",
+                cpu->curlist[cpu->state].name, cpu->curpc.val);
+        cpu->curlist[cpu->state++].fn(cpu);
+        ++mcycles;
+    }
+
+    cpu->state = FETCH;
+    return mcycles;
+}
+
+static unsigned
+_cpu_run_fused(cpu_t *cpu)
+{
+    /* a fused sequence runs ahead just like a single instruction. the block
+     * cache then moves past the instructions it took */
+    const cpu_op_t *op = cpu->op;
+    if (!op->fused || !soc_can_run_ahead(cpu->soc, op->fused_mcycles))
+        return 0;
+
+    LOG(LOG_VERBOSE, "running %u fused instructions in PC 0x%04X",
+            op->fused, cpu->pc.val - 1);
+    unsigned mcycles = cpu_run_fused(cpu, op);
+    if (mcycles)
+        cpu->soc->bcache->idx += op->fused - 1;
+    return mcycles;
+}
+
+static unsigned
+_cpu_idle_stable(cpu_t *cpu, const cpu_op_t *op)
+{
+    /* the cycles for which the instruction would do the same thing. it may
+     * only read, and only memory nobody but the CPU changes or IO registers
+     * that stay put for a while */
+    if (!_cpu_operands_plain(cpu, op))
+        return 0;
+
+    switch (op->access) {
+        case ACCESS_NONE:
+            return NO_EVENT;
+        case ACCESS_IHL:
+        case ACCESS_IRR:
+        case ACCESS_HIGH_N:
+        case ACCESS_HIGH_C:
+        case ACCESS_INN:
+            if (op->writes)
+                return 0;
+            break;
+        default:
+            return 0;
+    }
+
+    uint16_t addr = _cpu_access_addr(cpu, op);
+    if (_cpu_plain_read(addr))
+        return NO_EVENT;
+    if (addr >= 0xFF00 && addr < 0xFF80)
+        return soc_io_stable(cpu->soc, addr & 0xFF);
+    return 0;
+}
+
+static inline bool
+_cpu_jumped_back(cpu_t *cpu)
+{
+    /* a jump that has just been taken to a little before itself */
+    fn_list_t list = cpu_op_group(cpu->op);
+    if (list != jr_e && list != jr_cc_e && list != jp_nn && list != jp_cc_nn)
+        return false;
+
+    return cpu->pc.val <= cpu->curpc.val &&
+        cpu->curpc.val - cpu->pc.val < CPU_IDLE_LOOP_LEN;
+}
+
+static unsigned
+_cpu_run_idle(cpu_t *cpu, unsigned done)
+{
+    /* a short loop the CPU has just jumped back into usually waits for
+     * something: it polls an IO register or counts a register down. as long
+     * as it only reads memory that stays the same, it runs ahead just like a
+     * single instruction. done is what the jump itself took */
+    unsigned horizon = soc_idle_horizon(cpu->soc);
+    uint16_t head = cpu->pc.val;
+    _cpu_flags(cpu);
+    reg_t af = cpu->af, bc = cpu->bc, de = cpu->de, hl = cpu->hl;
+    reg_t sp = cpu->sp;
+    unsigned mcycles = 0, round = 0;
+
+    for (unsigned i = 0; i < CPU_IDLE_MAX_INSTRS; ++i) {
+        /* decode the next instruction without going through the fetch */
+        uint16_t pc = cpu->pc.val;
+        uint8_t ir, cb;
+        if (!_cpu_plain_read(pc))
+            break;
+        _cpu_read_byte(cpu, &ir, pc);
+        cpu_decode(&cpu->scratch, ir);
+        if (ir == 0xCB) {
+            if (!_cpu_plain_read((uint16_t)(pc + 1)))
+                break;
+            _cpu_read_byte(cpu, &cb, (uint16_t)(pc + 1));
+            cpu_decode_cb(&cpu->scratch, cb);
+        }
+
+        /* the operands are looked at as if the opcode had been read */
+        const cpu_op_t *op = &cpu->scratch;
+        cpu->pc.val = pc + 1;
+        unsigned stable = _cpu_idle_stable(cpu, op);
+        if (stable < horizon)
+            horizon = stable;
+
+        /* every read has to happen before anything changes */
+        if (4 * (done + mcycles + op->mcycles) >= horizon) {
+            cpu->pc.val = pc;
+            break;
+        }
+
+        /* run it like _cpu_run_whole() would, conditions included. the IO
+         * reads are served right away */
+        LOG(LOG_VERBOSE, "running 0x%02X in PC 0x%04X ahead", ir, pc);
+        cpu->ir = ir;
+        cpu->op = op;
+        cpu->curlist = cpu_op_list(op);
+        cpu->state = FETCH;
+        while (cpu->curlist[cpu->state].fn) {
+            cpu->curlist[cpu->state++].fn(cpu);
+            soc_finish_io_read(cpu->soc);
+            ++mcycles;
+        }
+        cpu->state = FETCH;
+
+        /* a whole round that changed nothing will be the same until the
+         * horizon, so skip all the rounds that fit */
+        if (cpu->pc.val == head) {
+            _cpu_flags(cpu);
+            if (cpu->af.val == af.val && cpu->bc.val == bc.val &&
+                    cpu->de.val == de.val && cpu->hl.val == hl.val &&
+                    cpu->sp.val == sp.val) {
+                unsigned len = mcycles - round;
+                unsigned left = (horizon - 1) / 4 - done - mcycles;
+                mcycles += left - left % len;
+                break;
+            }
+
+            /* otherwise, the next round starts from here */
+            af = cpu->af, bc = cpu->bc, de = cpu->de, hl = cpu->hl;
+            sp = cpu->sp;
+            round = mcycles;
+        }
+
+        /* it went somewhere else */
+        if ((uint16_t)(cpu->pc.val - head) >= CPU_IDLE_LOOP_LEN)
+            break;
+    }
+
+    return mcycles;
+}
+
+static inline unsigned
+_cpu_fetch(cpu_t *cpu)
+{
+    /* a block compiled to native code runs in one go */
+    unsigned mcycles = bcache_run_native(cpu->soc->bcache, cpu);
+    if (mcycles)
+        goto ran_ahead;
+
+    /* a cached instruction comes already decoded. the opcode would be read
+     * from plain memory, so just move PC as the read would */
+    const cpu_op_t *op = bcache_fetch(cpu->soc->bcache, cpu->pc.val);
+    if (op) {
+        cpu->ir = op->ir;
+        cpu->op = op;
+        _idu_write(cpu, cpu->pc.val++);
+    } else {
+        /* otherwise, read it from the bus and decode it on the fly */
+        _cpu_read_imm8(cpu, &cpu->ir);
+        cpu_decode(&cpu->scratch, cpu->ir);
+        cpu->op = &cpu->scratch;
+    }
+
+    /* so does an instruction that doesn't need its machine cycles, or a
+     * common sequence that starts with it */
+    mcycles = _cpu_run_fused(cpu);
+    if (!mcycles)
+        mcycles = _cpu_run_whole(cpu);
+    if (!mcycles)
+        return 0;
+
+    /* if it jumped a little back, it might have closed a loop */
+    if (_cpu_jumped_back(cpu))
+        mcycles += _cpu_run_idle(cpu, mcycles);
+
+ran_ahead:
+    /* the CPU then sits in a NOP for the machine cycles it took, so that the
+     * other components catch up */
+    cpu->ir = 0x00;
+    cpu_decode(&cpu->scratch, cpu->ir);
+    cpu->op = &cpu->scratch;
+    return 4 * (mcycles - 1);
+}
+
+#ifdef GBEMU_THREADED
+/* threaded dispatch (GCC's labels as values). every step of every opcode, CB
+ * opcode and the ISR gets its own site in cpu_cycle(), which runs the step's
+ * micro-op and leaves the address of the next step's site to the CPU, or goes
+ * to the fetch if it was the last one. how many steps an opcode takes is known
+ * here, so the end of the instruction isn't looked up in its list, and the
+ * micro-op call of each site always goes to the same place */
+
+/* the steps each opcode takes, as f(opcode, steps). they are the lengths of
+ * the lists in instrs.c, conditions taken */
+#define _ROW(f, h, s0, s1, s2, s3, s4, s5, s6, s7, s8, s9, sA, sB, sC, sD,    \
+        sE, sF)                                                             \
+    f(h##0, s0) f(h##1, s1) f(h##2, s2) f(h##3, s3)                         \
+    f(h##4, s4) f(h##5, s5) f(h##6, s6) f(h##7, s7)                         \
+    f(h##8, s8) f(h##9, s9) f(h##A, sA) f(h##B, sB)                         \
+    f(h##C, sC) f(h##D, sD) f(h##E, sE) f(h##F, sF)
+#define _OPS(f)                                                             \
+    _ROW(f, 0, 1, 3, 2, 2, 1, 1, 2, 1, 5, 2, 2, 2, 1, 1, 2, 1)              \
+    _ROW(f, 1, 1, 3, 2, 2, 1, 1, 2, 1, 3, 2, 2, 2, 1, 1, 2, 1)              \
+    _ROW(f, 2, 3, 3, 2, 2, 1, 1, 2, 1, 3, 2, 2, 2, 1, 1, 2, 1)              \
+    _ROW(f, 3, 3, 3, 2, 2, 3, 3, 3, 1, 3, 2, 2, 2, 1, 1, 2, 1)              \
+    _ROW(f, 4, 1, 1, 1, 1, 1, 1, 2, 1, 1, 1, 1, 1, 1, 1, 2, 1)              \
+    _ROW(f, 5, 1, 1, 1, 1, 1, 1, 2, 1, 1, 1, 1, 1, 1, 1, 2, 1)              \
+    _ROW(f, 6, 1, 1, 1, 1, 1, 1, 2, 1, 1, 1, 1, 1, 1, 1, 2, 1)              \
+    _ROW(f, 7, 2, 2, 2, 2, 2, 2, 2, 2, 1, 1, 1, 1, 1, 1, 2, 1)              \
+    _ROW(f, 8, 1, 1, 1, 1, 1, 1, 2, 1, 1, 1, 1, 1, 1, 1, 2, 1)              \
+    _ROW(f, 9, 1, 1, 1, 1, 1, 1, 2, 1, 1, 1, 1, 1, 1, 1, 2, 1)              \
+    _ROW(f, A, 1, 1, 1, 1, 1, 1, 2, 1, 1, 1, 1, 1, 1, 1, 2, 1)              \
+    _ROW(f, B, 1, 1, 1, 1, 1, 1, 2, 1, 1, 1, 1, 1, 1, 1, 2, 1)              \
+    _ROW(f, C, 5, 3, 4, 4, 6, 4, 2, 4, 5, 4, 4, 1, 6, 6, 2, 4)              \
+    _ROW(f, D, 5, 3, 4, 1, 6, 4, 2, 4, 5, 4, 4, 1, 6, 1, 2, 4)              \
+    _ROW(f, E, 3, 3, 2, 1, 1, 4, 2, 4, 4, 1, 4, 1, 1, 1, 2, 4)              \
+    _ROW(f, F, 3, 3, 2, 1, 1, 4, 2, 4, 3, 2, 4, 1, 1, 1, 2, 4)
+
+/* the same for the CB opcodes, the prefix being their first step. (HL) takes
+ * two more steps, or one for BIT b, (HL) */
+#define _CB_ROW(f, h, ihl)                                                  \
+    _ROW(f, h, 2, 2, 2, 2, 2, 2, ihl, 2, 2, 2, 2, 2, 2, 2, ihl, 2)
+#define _CB_OPS(f)                                                          \
+    _CB_ROW(f, 0, 4) _CB_ROW(f, 1, 4) _CB_ROW(f, 2, 4) _CB_ROW(f, 3, 4)     \
+    _CB_ROW(f, 4, 3) _CB_ROW(f, 5, 3) _CB_ROW(f, 6, 3) _CB_ROW(f, 7, 3)     \
+    _CB_ROW(f, 8, 4) _CB_ROW(f, 9, 4) _CB_ROW(f, A, 4) _CB_ROW(f, B, 4)     \
+    _CB_ROW(f, C, 4) _CB_ROW(f, D, 4) _CB_ROW(f, E, 4) _CB_ROW(f, F, 4)
+
+/* whether step k of the opcode tests a condition (JR, RET, JP and CALL cc). a
+ * false one skips the rest of the instruction */
+#define _STEP_COND(op, k)                                                   \
+    ((((op) & 0xE7) == 0x20 && (k) == 1) ||                                 \
+     (((op) & 0xE7) == 0xC0 && (k) == 1) ||                                 \
+     (((op) & 0xE7) == 0xC2 && (k) == 2) ||                                 \
+     (((op) & 0xE7) == 0xC4 && (k) == 2))
+
+/* the sites, named stem_k. op is the opcode, or -1 for the CB opcodes and the
+ * ISR. the CB prefix moves to its second byte's sites once it's read */
+#define _STEP(stem, op, k, next)                                            \
+    stem##_##k:                                                             \
+        cpu->state = (k) + 1;                                               \
+        cpu->curlist[k].fn(cpu);                                            \
+        if (_STEP_COND(op, k) && cpu->state != (k) + 1)                     \
+            goto fetch;                                                     \
+        cpu->site = &&stem##_##next;                                        \
+        goto executed;
+#define _LAST(stem, op, k)                                                  \
+    stem##_##k:                                                             \
+        cpu->state = (k) + 1;                                               \
+        cpu->curlist[k].fn(cpu);                                            \
+        if ((op) == 0xCB) {                                                 \
+            cpu->site = cb_sites[cpu->ir];                                  \
+            goto executed;                                                  \
+        }                                                                   \
+        goto fetch;
+
+#define _STEPS_1(s, op)     _LAST(s, op, 0)
+#define _STEPS_2(s, op)     _STEP(s, op, 0, 1) _LAST(s, op, 1)
+#define _STEPS_3(s, op)     _STEP(s, op, 0, 1) _STEPS_2_3(s, op)
+#define _STEPS_4(s, op)     _STEP(s, op, 0, 1) _STEPS_2_4(s, op)
+#define _STEPS_5(s, op)     _STEP(s, op, 0, 1) _STEPS_2_5(s, op)
+#define _STEPS_6(s, op)     _STEP(s, op, 0, 1) _STEPS_2_6(s, op)
+
+/* from the second step on, which is where CB opcodes start */
+#define _STEPS_2_2(s, op)   _LAST(s, op, 1)
+#define _STEPS_2_3(s, op)   _STEP(s, op, 1, 2) _LAST(s, op, 2)
+#define _STEPS_2_4(s, op)                                                   \
+    _STEP(s, op, 1, 2) _STEP(s, op, 2, 3) _LAST(s, op, 3)
+#define _STEPS_2_5(s, op)                                                   \
+    _STEP(s, op, 1, 2) _STEP(s, op, 2, 3) _STEP(s, op, 3, 4) _LAST(s, op, 4)
+#define _STEPS_2_6(s, op)                                                   \
+    _STEP(s, op, 1, 2) _STEP(s, op, 2, 3) _STEP(s, op, 3, 4)                \
+    _STEP(s, op, 4, 5) _LAST(s, op, 5)
+
+#define _SITES(op, n)       _STEPS_##n(site_##op, 0x##op)
+#define _CB_SITES(op, n)    _STEPS_2_##n(cb_site_##op, -1)
+
+/* the dispatch tables, with the first step of each opcode */
+#define _SITE_ADDR(op, n)       [0x##op] = &&site_##op##_0,
+#define _CB_SITE_ADDR(op, n)    [0x##op] = &&cb_site_##op##_1,
+#endif /* GBEMU_THREADED */
+
 void
 cpu_cycle(cpu_t *cpu)
 {
+    /* extra cycles the fetch might have taken */
+    unsigned extra = 0;
+
     /* if we have pending cycles exhaust them */
     WASTE_CYCLES(cpu);
 
+#ifdef GBEMU_THREADED
+    static const void *const sites[256] = { _OPS(_SITE_ADDR) };
+    static const void *const cb_sites[256] = { _CB_OPS(_CB_SITE_ADDR) };
+
+    /* the very first instruction was set up by cpu_init() */
+    if (!cpu->site)
+        cpu->site = sites[cpu->op->ir];
+
+    /* execute the current step from its own site */
+    goto *cpu->site;
+    _OPS(_SITES)
+    _CB_OPS(_CB_SITES)
+    _STEPS_5(site_isr, -1)
+
+    /* the last step overlaps with a fetch */
+fetch:
+    cpu->state = FETCH;
+executed:
+#else
     /* make sure we have a valid instruction list and a valid function */
     assert(cpu->curlist && cpu->curlist[cpu->state].fn);
 
@@ -94,6 +651,7 @@ cpu_cycle(cpu_t *cpu)
      * executed function with a fetch */
     if (!cpu->curlist[cpu->state].fn)
         cpu->state = FETCH;
+#endif
 
     /* check for EI instruction */
     switch (cpu->ei_state) {
@@ -113,8 +671,10 @@ cpu_cycle(cpu_t *cpu)
         /* this is mostly for debug */
         cpu->curpc = cpu->pc;
 
-        /* get the current interrupts */
+        /* get the current interrupts. whether they are serviced depends on IME
+         * as it is now: an instruction run in one go (RETI) might set it */
         uint8_t ints = _pending_interrupts(cpu);
+        bool service = cpu->ime && ints;
 
         /* the actual instruction we fetch depends on whether we're halted. note
          * that we're just filling the instruction register - we might jump to
@@ -137,26 +697,40 @@ cpu_cycle(cpu_t *cpu)
 
                 /* always disable the halt bug after the first cycle */
                 cpu->halt_bug = false;
+
+                /* nothing happens until an interrupt comes up, so wait for it
+                 * in one go */
+                extra = soc_halt_wait(cpu->soc);
             }
+
+            /* decode whatever we got */
+            cpu_decode(&cpu->scratch, cpu->ir);
+            cpu->op = &cpu->scratch;
         } else {
             /* if not halted, normal fetch is executed */
-            _cpu_read_imm8(cpu, &cpu->ir);
+            extra = _cpu_fetch(cpu);
         }
 
         /* the next step depends on whether we're interrupted. if we are, we
          * jump directly to ISR. otherwise, we execute the currently fetched
          * instruction */
-        if (cpu->ime && ints) {
+        if (service) {
             cpu->ime = false;
             cpu->curlist = isr;
+#ifdef GBEMU_THREADED
+            cpu->site = &&site_isr_0;
+#endif
         } else {
             /* set up the new instruction */
-            cpu->curlist = *instructions[cpu->ir];
+            cpu->curlist = cpu_op_list(cpu->op);
+#ifdef GBEMU_THREADED
+            cpu->site = sites[cpu->op->ir];
+#endif
         }
     }
 
     /* get ready for a new round of cycle wasting */
-    cpu->cycles_to_waste = 3;
+    cpu->cycles_to_waste = 3 + extra;
 }
 
 void
@@ -176,7 +750,7 @@ cpu_init(cpu_t *cpu, soc_t *soc)
 
     /* default reg values */
     cpu->af.hi = 0x01;
-    cpu->af.lo = 0x00;
+    _cpu_set_flags(cpu, 0x00);
     cpu->bc.hi = 0xFF;
     cpu->bc.lo = 0x13;
     cpu->de.hi = 0x00;
@@ -191,6 +765,11 @@ cpu_init(cpu_t *cpu, soc_t *soc)
     /* we start with the fetch state */
     cpu->curlist = nop;
     cpu->state = FETCH;
+#ifdef GBEMU_THREADED
+    cpu->site = NULL;
+#endif
+    cpu_decode(&cpu->scratch, cpu->ir);
+    cpu->op = &cpu->scratch;
 
     /* misc */
     cpu->curpc = cpu->pc;
@@ -6,202 +6,176 @@
 #include <stdbool.h>
 #include <stdint.h>
 
+/* the flags are not written to F as the ALU goes, most of them would be
+ * overwritten before anybody looks at them. the ALU records what it did
+ * instead, and F is worked out when it is read as a whole (PUSH AF, DAA) */
+static inline uint8_t
+_cpu_flags(cpu_t *cpu)
+{
+    cpu_flags_t *f = &cpu->flags;
+    uint8_t nh;
+    switch (f->op) {
+        case FLAGS_ADD:
+            nh = (((f->x & 0xf) + (f->y & 0xf) + f->cin) & 0x10) << 1;
+            break;
+        case FLAGS_SUB:
+            nh = BIT(6) | (((f->x & 0xf) - (f->y & 0xf) - f->cin) & 0x10) << 1;
+            break;
+        case FLAGS_INC:
+            nh = (f->res & 0xf) == 0x0 ? BIT(5) : 0;
+            break;
+        case FLAGS_DEC:
+            nh = BIT(6) | ((f->res & 0xf) == 0xf ? BIT(5) : 0);
+            break;
+        case FLAGS_NH:
+        default:
+            nh = f->nh;
+            break;
+    }
+
+    cpu->af.lo = !f->res << 7 | nh | f->carry << 4;
+    return cpu->af.lo;
+}
+
+/* F has been written as a whole (POP AF) */
+static inline void
+_cpu_set_flags(cpu_t *cpu, uint8_t val)
+{
+    cpu->flags.op = FLAGS_NH;
+    cpu->flags.nh = val & (BIT(6) | BIT(5));
+    cpu->flags.res = !(val & BIT(7));
+    cpu->flags.carry = (val & BIT(4)) >> 4;
+    cpu->af.lo = val & 0xF0;
+}
+
+/* an operation whose N and H don't depend on the operands. res decides Z, pass
+ * cpu->flags.res to keep it */
+static inline void
+_cpu_flags_nh(cpu_t *cpu, uint8_t res, uint8_t nh, uint8_t carry)
+{
+    cpu->flags.op = FLAGS_NH;
+    cpu->flags.nh = nh;
+    cpu->flags.res = res;
+    cpu->flags.carry = carry;
+}
+
+static inline uint8_t
+_cpu_alu_add(cpu_t *cpu, uint8_t x, uint8_t y, uint8_t cin)
+{
+    unsigned res = x + y + cin;
+    cpu->flags.op = FLAGS_ADD;
+    cpu->flags.x = x;
+    cpu->flags.y = y;
+    cpu->flags.cin = cin;
+    cpu->flags.res = res;
+    cpu->flags.carry = res >> 8;
+    return res;
+}
+
+static inline uint8_t
+_cpu_alu_sub(cpu_t *cpu, uint8_t x, uint8_t y, uint8_t cin)
+{
+    unsigned res = x - y - cin;
+    cpu->flags.op = FLAGS_SUB;
+    cpu->flags.x = x;
+    cpu->flags.y = y;
+    cpu->flags.cin = cin;
+    cpu->flags.res = res;
+    cpu->flags.carry = (res >> 8) & 1;
+    return res;
+}
+
 /* ALU flag macros */
-#define FLAG(n) \
-    ((cpu->af.lo & BIT(n)) >> n)
-#define SET_FLAG(n) \
-    cpu->af.lo = BIT(n) | cpu->af.lo
-#define UNSET_FLAG(n) \
-    cpu->af.lo = ~(BIT(n) | ~cpu->af.lo)
-#define FLAG_ZERO()     FLAG(7)
-#define SET_ZERO()      SET_FLAG(7)
-#define UNSET_ZERO()    UNSET_FLAG(7)
-#define FLAG_SUB()      FLAG(6)
-#define SET_SUB()       SET_FLAG(6)
-#define UNSET_SUB()     UNSET_FLAG(6)
-#define FLAG_HALF()     FLAG(5)
-#define SET_HALF()      SET_FLAG(5)
-#define UNSET_HALF()    UNSET_FLAG(5)
-#define FLAG_CARRY()    FLAG(4)
-#define SET_CARRY()     SET_FLAG(4)
-#define UNSET_CARRY()   UNSET_FLAG(4)
+#define FLAG_ZERO()     (!cpu->flags.res)
+#define FLAG_SUB()      ((_cpu_flags(cpu) & BIT(6)) >> 6)
+#define FLAG_HALF()     ((_cpu_flags(cpu) & BIT(5)) >> 5)
+#define FLAG_CARRY()    (cpu->flags.carry)
+
+/* Z only looks at the recorded result */
+#define UNSET_ZERO()    cpu->flags.res = 1
 
 /* ALU operation macros */
 #define INC8(x) \
-    if ((((x) & 0xf) + 1) & 0x10) SET_HALF(); \
-    else UNSET_HALF(); \
     (x)++; \
-    if ((x) == 0) SET_ZERO(); \
-    else UNSET_ZERO(); \
-    UNSET_SUB()
+    cpu->flags.op = FLAGS_INC; \
+    cpu->flags.res = (x)
 
 #define DEC8(x) \
-    if ((((x) & 0xf) - 1) & 0x10) SET_HALF(); \
-    else UNSET_HALF(); \
     (x)--; \
-    if ((x) == 0) SET_ZERO(); \
-    else UNSET_ZERO(); \
-    SET_SUB()
+    cpu->flags.op = FLAGS_DEC; \
+    cpu->flags.res = (x)
 
 #define ADD8(x, y) \
-    if ((((x) & 0xf) + ((y) & 0xf)) & 0x10) SET_HALF(); \
-    else UNSET_HALF(); \
-    if ((((x) & 0xff) + ((y) & 0xff)) & 0x100) SET_CARRY(); \
-    else UNSET_CARRY(); \
-    (x) += (y); \
-    if ((x) == 0) SET_ZERO(); \
-    else UNSET_ZERO(); \
-    UNSET_SUB()
+    (x) = _cpu_alu_add(cpu, (x), (y), 0)
 
 #define ADC8(x, y, tmp) \
     (tmp) = FLAG_CARRY(); \
-    if ((((x) & 0xf) + ((y) & 0xf) + (tmp)) & 0x10) SET_HALF(); \
-    else UNSET_HALF(); \
-    if ((((x) & 0xff) + ((y) & 0xff) + (tmp)) & 0x100) SET_CARRY(); \
-    else UNSET_CARRY(); \
-    (x) += (y) + (tmp); \
-    if ((x) == 0) SET_ZERO(); \
-    else UNSET_ZERO(); \
-    UNSET_SUB()
+    (x) = _cpu_alu_add(cpu, (x), (y), (tmp))
 
 #define SUB8(x, y) \
-    if ((((x) & 0xf) - ((y) & 0xf)) & 0x10) SET_HALF(); \
-    else UNSET_HALF(); \
-    if ((((x) & 0xff) - ((y) & 0xff)) & 0x100) SET_CARRY(); \
-    else UNSET_CARRY(); \
-    (x) -= y; \
-    if ((x) == 0) SET_ZERO(); \
-    else UNSET_ZERO(); \
-    SET_SUB()
+    (x) = _cpu_alu_sub(cpu, (x), (y), 0)
 
 #define SBC8(x, y, tmp) \
     (tmp) = FLAG_CARRY(); \
-    if ((((x) & 0xf) - ((y) & 0xf) - (tmp)) & 0x10) SET_HALF(); \
-    else UNSET_HALF(); \
-    if ((((x) & 0xff) - ((y) & 0xff) - (tmp)) & 0x100) SET_CARRY(); \
-    else UNSET_CARRY(); \
-    (x) -= (y) + (tmp); \
-    if ((x) == 0) SET_ZERO(); \
-    else UNSET_ZERO(); \
-    SET_SUB()
+    (x) = _cpu_alu_sub(cpu, (x), (y), (tmp))
 
 #define AND8(x, y) \
     (x) &= (y); \
-    if ((x) == 0) SET_ZERO(); \
-    else UNSET_ZERO(); \
-    UNSET_SUB(); \
-    SET_HALF(); \
-    UNSET_CARRY()
+    _cpu_flags_nh(cpu, (x), BIT(5), 0)
 
 #define XOR8(x, y) \
     (x) ^= (y); \
-    if ((x) == 0) SET_ZERO(); \
-    else UNSET_ZERO(); \
-    UNSET_SUB(); \
-    UNSET_HALF(); \
-    UNSET_CARRY()
+    _cpu_flags_nh(cpu, (x), 0, 0)
 
 #define OR8(x, y) \
     (x) |= (y); \
-    if ((x) == 0) SET_ZERO(); \
-    else UNSET_ZERO(); \
-    UNSET_SUB(); \
-    UNSET_HALF(); \
-    UNSET_CARRY()
+    _cpu_flags_nh(cpu, (x), 0, 0)
 
 #define CP8(x, y) \
-    if ((x) == (y)) SET_ZERO(); \
-    else UNSET_ZERO(); \
-    if ((((x) & 0xff) - ((y) & 0xff)) & 0x100) SET_CARRY(); \
-    else UNSET_CARRY(); \
-    if ((((x) & 0xf) - ((y) & 0xf)) & 0x10) SET_HALF(); \
-    else UNSET_HALF(); \
-    SET_SUB()
+    _cpu_alu_sub(cpu, (x), (y), 0)
 
 #define RLC8(x, tmp) \
     (tmp) = (x) >> 7; \
     (x) = ((x) << 1) | (tmp); \
-    if ((tmp)) SET_CARRY(); \
-    else UNSET_CARRY(); \
-    if ((x) == 0) SET_ZERO(); \
-    else UNSET_ZERO(); \
-    UNSET_SUB(); \
-    UNSET_HALF()
+    _cpu_flags_nh(cpu, (x), 0, (tmp))
 
 #define RRC8(x, tmp) \
     (tmp) = (x) & 1; \
     (x) = ((x) >> 1) | ((tmp) << 7); \
-    if ((tmp)) SET_CARRY(); \
-    else UNSET_CARRY(); \
-    if ((x) == 0) SET_ZERO(); \
-    else UNSET_ZERO(); \
-    UNSET_SUB(); \
-    UNSET_HALF()
+    _cpu_flags_nh(cpu, (x), 0, (tmp))
 
 #define RL8(x, tmp) \
     (tmp) = (x) >> 7; \
     (x) = ((x) << 1) | FLAG_CARRY(); \
-    if ((tmp)) SET_CARRY(); \
-    else UNSET_CARRY(); \
-    if ((x) == 0) SET_ZERO(); \
-    else UNSET_ZERO(); \
-    UNSET_SUB(); \
-    UNSET_HALF()
+    _cpu_flags_nh(cpu, (x), 0, (tmp))
 
 #define RR8(x, tmp) \
     (tmp) = (x) & 1; \
     (x) = ((x) >> 1) | (FLAG_CARRY() << 7); \
-    if ((tmp)) SET_CARRY(); \
-    else UNSET_CARRY(); \
-    if ((x) == 0) SET_ZERO(); \
-    else UNSET_ZERO(); \
-    UNSET_SUB(); \
-    UNSET_HALF()
+    _cpu_flags_nh(cpu, (x), 0, (tmp))
 
 #define SLA8(x, tmp) \
     (tmp) = (x) >> 7; \
     (x) = (x) << 1; \
-    if ((tmp)) SET_CARRY(); \
-    else UNSET_CARRY(); \
-    if ((x) == 0) SET_ZERO(); \
-    else UNSET_ZERO(); \
-    UNSET_SUB(); \
-    UNSET_HALF()
+    _cpu_flags_nh(cpu, (x), 0, (tmp))
 
 #define SRA8(x, tmp) \
     (tmp) = (x) & 1; \
     (x) = ((x) >> 1) | ((x) & 0x80); \
-    if ((tmp)) SET_CARRY(); \
-    else UNSET_CARRY(); \
-    if ((x) == 0) SET_ZERO(); \
-    else UNSET_ZERO(); \
-    UNSET_SUB(); \
-    UNSET_HALF()
+    _cpu_flags_nh(cpu, (x), 0, (tmp))
 
 #define SWAP8(x, tmp) \
     (tmp) = (x) & 0xf; \
     (x) = ((x) >> 4) | ((tmp) << 4); \
-    if ((x) == 0) SET_ZERO(); \
-    else UNSET_ZERO(); \
-    UNSET_SUB(); \
-    UNSET_HALF(); \
-    UNSET_CARRY()
+    _cpu_flags_nh(cpu, (x), 0, 0)
 
 #define SRL8(x, tmp) \
     (tmp) = (x) & 1; \
     (x) = (x) >> 1; \
-    if ((tmp)) SET_CARRY(); \
-    else UNSET_CARRY(); \
-    if ((x) == 0) SET_ZERO(); \
-    else UNSET_ZERO(); \
-    UNSET_SUB(); \
-    UNSET_HALF()
+    _cpu_flags_nh(cpu, (x), 0, (tmp))
 
 #define BIT8(b, x) \
-    if (!((x) & (1 << b))) SET_ZERO(); \
-    else UNSET_ZERO(); \
-    UNSET_SUB(); \
-    SET_HALF()
+    _cpu_flags_nh(cpu, (x) & (1 << b), BIT(5), FLAG_CARRY())
 
 #define RES8(b, x) \
     (x) &= ~(1 << b)
@@ -216,6 +190,30 @@ void _cpu_write_byte(cpu_t *cpu, uint16_t addr, uint8_t val);
 /* read immediate (cpu.c) */
 bool _cpu_read_imm8(cpu_t *cpu, uint8_t *dst);
 
+/* memory that behaves the same whenever the CPU accesses it, as long as it
+ * owns the external bus: ROM, cart RAM, WRAM and HRAM. VRAM, OAM and I/O are
+ * timed against the PPU and the other components */
+static inline bool
+_cpu_plain_read(uint16_t addr)
+{
+    return addr < 0x8000 || (addr >= 0xA000 && addr < 0xFE00) ||
+        (addr >= 0xFF80 && addr < 0xFFFF);
+}
+
+/* memory accesses for native blocks, which run ahead of the other components.
+ * they only go through on plain memory and return -1 otherwise. a run of
+ * mcycles may also write to VRAM while the PPU leaves it alone (cpu.c) */
+int cpu_native_read(cpu_t *cpu, uint32_t addr);
+int cpu_native_write(cpu_t *cpu, uint32_t addr, uint32_t val);
+int cpu_native_write_vram(cpu_t *cpu, uint32_t addr, uint32_t val,
+                          unsigned mcycles);
+int cpu_native_push(cpu_t *cpu, uint32_t sp, uint32_t val);
+int cpu_native_pop(cpu_t *cpu, uint32_t sp);
+int cpu_native_read_z(cpu_t *cpu, uint32_t addr);
+int cpu_native_flags(cpu_t *cpu);
+int cpu_native_set_flags(cpu_t *cpu, uint32_t val);
+int cpu_native_rmw(cpu_t *cpu, uint32_t addr, void (*fn)(cpu_t *));
+
 /* the IDU performed a write. this is used for the OAM bug */
 static inline void
 _idu_write(cpu_t *cpu, uint16_t val)
@@ -3,6 +3,12 @@
 static uint8_t
 _dma_mem_read(dma_t *dma, uint16_t addr)
 {
+    /* DMA owns whichever bus it reads from, so plain memory is a single load
+     * away */
+    const uint8_t *page = dma->soc->map.bus_read[addr >> 8];
+    if (page)
+        return page[addr & 0xFF];
+
     /* 0x0000 - 0x7FFF - External bus, CS=1 (cart ROM) */
     if (addr < 0x8000)
         return soc_ext_bus_read(dma->soc, PRIO_DMA, addr, true);
@@ -23,6 +29,7 @@ dma_cycle(dma_t *dma)
      * cycle after the instruction that issued it (8 clock cycles) */
     if (dma->requested && !(--dma->requested)) {
         dma->pending = 160;
+        soc_bus_transition(dma->soc);
         return;
     }
 
@@ -43,8 +50,9 @@ dma_cycle(dma_t *dma)
     /* write to OAM */
     soc_oam_write(dma->soc, PRIO_DMA, oam_addr, val);
 
-    /* decrease pending cycles */
-    --dma->pending;
+    /* decrease pending cycles. the last one gives the buses back */
+    if (!--dma->pending)
+        soc_bus_transition(dma->soc);
 
     /* get ready for a new round of cycle wasting */
     dma->cycles_to_waste = 3;
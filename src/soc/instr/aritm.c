@@ -2,50 +2,6 @@
 #include "soc/instr/instrs.h"
 #include "types.h"
 
-static inline uint8_t *
-_get_r(cpu_t *cpu, uint8_t val)
-{
-    /* based on value, choose a register */
-    assert(val <= 7 && val != 6);
-    switch (val) {
-        case 0x00:
-            return &cpu->bc.hi;
-        case 0x01:
-            return &cpu->bc.lo;
-        case 0x02:
-            return &cpu->de.hi;
-        case 0x03:
-            return &cpu->de.lo;
-        case 0x04:
-            return &cpu->hl.hi;
-        case 0x05:
-            return &cpu->hl.lo;
-        case 0x07:
-            return &cpu->af.hi;
-        default:
-            unreachable();
-    }
-}
-
-static inline reg_t *
-_get_rr(cpu_t *cpu, uint8_t val)
-{
-    /* based on value, choose a register */
-    assert(val <= 3);
-    switch (val) {
-        case 0x00:
-            return &cpu->bc;
-        case 0x01:
-            return &cpu->de;
-        case 0x02:
-            return &cpu->hl;
-        case 0x03:
-            return &cpu->sp;
-        default:
-            unreachable();
-    }
-}
-
 static void
 _read_imm8_into_z(cpu_t *cpu)
 {
@@ -60,83 +16,92 @@ _read_ihl_into_z(cpu_t *cpu)
     _cpu_read_byte(cpu, &cpu->wz.lo, cpu->hl.val);
 }
 
-static void
-_add_r(cpu_t *cpu)
+/* the ALU ops of the r forms, on A */
+static inline void
+_alu_add(cpu_t *cpu, uint8_t val)
 {
-    uint8_t *reg = _get_r(cpu, cpu->ir & 0x07);
-    ADD8(cpu->af.hi, *reg);
+    ADD8(cpu->af.hi, val);
 }
 
-static void
-_add_z(cpu_t *cpu)
+static inline void
+_alu_adc(cpu_t *cpu, uint8_t val)
 {
-    /* use Z register (previously read) */
-    ADD8(cpu->af.hi, cpu->wz.lo);
+    uint8_t tmp;
+    ADC8(cpu->af.hi, val, tmp);
 }
 
-static void
-_adc_r(cpu_t *cpu)
+static inline void
+_alu_sub(cpu_t *cpu, uint8_t val)
 {
-    uint8_t *reg = _get_r(cpu, cpu->ir & 0x07), tmp;
-    ADC8(cpu->af.hi, *reg, tmp);
+    SUB8(cpu->af.hi, val);
 }
 
-static void
-_adc_z(cpu_t *cpu)
+static inline void
+_alu_sbc(cpu_t *cpu, uint8_t val)
 {
-    /* use Z register (previously read) */
     uint8_t tmp;
-    ADC8(cpu->af.hi, cpu->wz.lo, tmp);
+    SBC8(cpu->af.hi, val, tmp);
 }
 
-static void
-_sub_r(cpu_t *cpu)
+static inline void
+_alu_cp(cpu_t *cpu, uint8_t val)
 {
-    uint8_t *reg = _get_r(cpu, cpu->ir & 0x07);
-    SUB8(cpu->af.hi, *reg);
+    CP8(cpu->af.hi, val);
 }
 
-static void
-_sub_z(cpu_t *cpu)
+static inline void
+_alu_and(cpu_t *cpu, uint8_t val)
 {
-    /* use Z register (previously read) */
-    SUB8(cpu->af.hi, cpu->wz.lo);
+    AND8(cpu->af.hi, val);
+}
+
+static inline void
+_alu_or(cpu_t *cpu, uint8_t val)
+{
+    OR8(cpu->af.hi, val);
+}
+
+static inline void
+_alu_xor(cpu_t *cpu, uint8_t val)
+{
+    XOR8(cpu->af.hi, val);
 }
 
 static void
-_sbc_r(cpu_t *cpu)
+_add_z(cpu_t *cpu)
 {
-    uint8_t *reg = _get_r(cpu, cpu->ir & 0x07), tmp;
-    SBC8(cpu->af.hi, *reg, tmp);
+    /* use Z register (previously read) */
+    ADD8(cpu->af.hi, cpu->wz.lo);
 }
 
 static void
-_sbc_z(cpu_t *cpu)
+_adc_z(cpu_t *cpu)
 {
     /* use Z register (previously read) */
     uint8_t tmp;
-    SBC8(cpu->af.hi, cpu->wz.lo, tmp);
+    ADC8(cpu->af.hi, cpu->wz.lo, tmp);
 }
 
 static void
-_cp_r(cpu_t *cpu)
+_sub_z(cpu_t *cpu)
 {
-    uint8_t *reg = _get_r(cpu, cpu->ir & 0x07);
-    CP8(cpu->af.hi, *reg);
+    /* use Z register (previously read) */
+    SUB8(cpu->af.hi, cpu->wz.lo);
 }
 
 static void
-_cp_z(cpu_t *cpu)
+_sbc_z(cpu_t *cpu)
 {
     /* use Z register (previously read) */
-    CP8(cpu->af.hi, cpu->wz.lo);
+    uint8_t tmp;
+    SBC8(cpu->af.hi, cpu->wz.lo, tmp);
 }
 
 static void
-_inc_r(cpu_t *cpu)
+_cp_z(cpu_t *cpu)
 {
-    uint8_t *reg = _get_r(cpu, (cpu->ir & 0x38) >> 3);
-    INC8(*reg);
+    /* use Z register (previously read) */
+    CP8(cpu->af.hi, cpu->wz.lo);
 }
 
 static void
@@ -148,13 +113,6 @@ _inc_z_into_ihl(cpu_t *cpu)
     _cpu_write_byte(cpu, cpu->hl.val, z);
 }
 
-static void
-_dec_r(cpu_t *cpu)
-{
-    uint8_t *reg = _get_r(cpu, (cpu->ir & 0x38) >> 3);
-    DEC8(*reg);
-}
-
 static void
 _dec_z_into_ihl(cpu_t *cpu)
 {
@@ -163,13 +121,6 @@ _dec_z_into_ihl(cpu_t *cpu)
     _cpu_write_byte(cpu, cpu->hl.val, z);
 }
 
-static void
-_and_r(cpu_t *cpu)
-{
-    uint8_t *reg = _get_r(cpu, cpu->ir & 0x07);
-    AND8(cpu->af.hi, *reg);
-}
-
 static void
 _and_z(cpu_t *cpu)
 {
@@ -177,13 +128,6 @@ _and_z(cpu_t *cpu)
     AND8(cpu->af.hi, cpu->wz.lo);
 }
 
-static void
-_or_r(cpu_t *cpu)
-{
-    uint8_t *reg = _get_r(cpu, cpu->ir & 0x07);
-    OR8(cpu->af.hi, *reg);
-}
-
 static void
 _or_z(cpu_t *cpu)
 {
@@ -191,13 +135,6 @@ _or_z(cpu_t *cpu)
     OR8(cpu->af.hi, cpu->wz.lo);
 }
 
-static void
-_xor_r(cpu_t *cpu)
-{
-    uint8_t *reg = _get_r(cpu, cpu->ir & 0x07);
-    XOR8(cpu->af.hi, *reg);
-}
-
 static void
 _xor_z(cpu_t *cpu)
 {
@@ -208,122 +145,45 @@ _xor_z(cpu_t *cpu)
 static void
 _ccf(cpu_t *cpu)
 {
-    UNSET_SUB();
-    UNSET_HALF();
-    if (FLAG_CARRY())
-        UNSET_CARRY();
-    else
-        SET_CARRY();
+    /* the zero flag is unaffected */
+    _cpu_flags_nh(cpu, cpu->flags.res, 0, !FLAG_CARRY());
 }
 
 static void
 _scf(cpu_t *cpu)
 {
-    UNSET_SUB();
-    UNSET_HALF();
-    SET_CARRY();
+    _cpu_flags_nh(cpu, cpu->flags.res, 0, 1);
 }
 
 static void
 _daa(cpu_t *cpu)
 {
-    if (!FLAG_SUB()) {
-        if (FLAG_CARRY() || cpu->af.hi > 0x99) {
+    /* this one needs every flag */
+    uint8_t sub = FLAG_SUB(), half = FLAG_HALF(), carry = FLAG_CARRY();
+    if (!sub) {
+        if (carry || cpu->af.hi > 0x99) {
             cpu->af.hi += 0x60;
-            SET_CARRY();
+            carry = 1;
         }
-        if (FLAG_HALF() || (cpu->af.hi & 0x0F) > 0x09)
+        if (half || (cpu->af.hi & 0x0F) > 0x09)
             cpu->af.hi += 0x06;
     } else {
-        if (FLAG_CARRY())
+        if (carry)
             cpu->af.hi -= 0x60;
-        if (FLAG_HALF())
+        if (half)
             cpu->af.hi -= 0x06;
     }
 
-    if (cpu->af.hi == 0)
-        SET_ZERO();
-    else
-        UNSET_ZERO();
-
-    UNSET_HALF();
+    _cpu_flags_nh(cpu, cpu->af.hi, sub << 6, carry);
 }
 
 static void
 _cpl(cpu_t *cpu)
 {
     cpu->af.hi = ~cpu->af.hi;
-    SET_SUB();
-    SET_HALF();
-}
-
-static void
-_inc_rr(cpu_t *cpu)
-{
-    /* inc reg with IDU */
-    reg_t *reg = _get_rr(cpu, (cpu->ir & 0x30) >> 4);
-    _idu_write(cpu, reg->val++);
-}
-
-static void
-_dec_rr(cpu_t *cpu)
-{
-    /* dec reg with IDU */
-    reg_t *reg = _get_rr(cpu, (cpu->ir & 0x30) >> 4);
-    _idu_write(cpu, reg->val--);
+    _cpu_flags_nh(cpu, cpu->flags.res, BIT(6) | BIT(5), FLAG_CARRY());
 }
 
-static void
-_add_lr_to_l(cpu_t *cpu)
-{
-    /* add low register to L */
-    reg_t *reg = _get_rr(cpu, (cpu->ir & 0x30) >> 4);
-
-    /* the zero flag is unaffected. this means we must not use the comfortable
-     * ADD8() macro for a normal ALU op */
-    if (((cpu->hl.lo & 0xf) + (reg->lo & 0xf)) & 0x10)
-        SET_HALF();
-    else
-        UNSET_HALF();
-
-    if (((cpu->hl.lo & 0xff) + (reg->lo & 0xff)) & 0x100)
-        SET_CARRY();
-    else
-        UNSET_CARRY();
-
-    UNSET_SUB();
-
-    /* perform the op */
-    cpu->hl.lo += reg->lo;
-}
-
-static void
-_add_hr_to_h(cpu_t *cpu)
-{
-    /* add high register to H with carry */
-    reg_t *reg = _get_rr(cpu, (cpu->ir & 0x30) >> 4);
-
-    /* the zero flag is unaffected. this means we must not use the comfortable
-     * ADD8() macro for a normal ALU op */
-    uint8_t carry = FLAG_CARRY();
-
-    if (((cpu->hl.hi & 0xf) + (reg->hi & 0xf) + carry) & 0x10)
-        SET_HALF();
-    else
-        UNSET_HALF();
-
-    if (((cpu->hl.hi & 0xff) + (reg->hi & 0xff) + carry) & 0x100)
-        SET_CARRY();
-    else
-        UNSET_CARRY();
-
-    UNSET_SUB();
-
-    /* perform the op */
-    cpu->hl.hi += reg->hi + carry;
-}
-
-
 static void
 _write_pe_to_z(cpu_t *cpu)
 {
@@ -334,22 +194,10 @@ _write_pe_to_z(cpu_t *cpu)
      * to overwrite it), therefore we will temporarily borrow the sub flag to
      * carry the sign of the offset. after calculating our adjustment, we make
      * sure to unset it. */
-    if (((cpu->sp.lo & 0xf) + (cpu->wz.lo & 0xf)) & 0x10)
-        SET_HALF();
-    else
-        UNSET_HALF();
-
-    if (((cpu->sp.lo & 0xff) + (cpu->wz.lo & 0xff)) & 0x100)
-        SET_CARRY();
-    else
-        UNSET_CARRY();
-
-    if (cpu->wz.lo & 0x80)
-        SET_SUB();
-    else
-        UNSET_SUB();
-
-    UNSET_ZERO();
+    uint8_t half = (((cpu->sp.lo & 0xf) + (cpu->wz.lo & 0xf)) & 0x10) << 1;
+    uint8_t sign = (cpu->wz.lo & 0x80) >> 1;
+    _cpu_flags_nh(cpu, 1, sign | half,
+            ((cpu->sp.lo + cpu->wz.lo) & 0x100) >> 8);
 
     /* perform the op */
     cpu->wz.lo = cpu->sp.lo + cpu->wz.lo;
@@ -365,7 +213,7 @@ _write_se_to_w(cpu_t *cpu)
     uint8_t adj = 0;
     if (FLAG_SUB())
         adj = -1;
-    UNSET_SUB();
+    _cpu_flags_nh(cpu, cpu->flags.res, FLAG_HALF() << 5, FLAG_CARRY());
 
     /* perform the op */
     cpu->wz.hi = cpu->sp.hi + adj + FLAG_CARRY();
@@ -378,11 +226,22 @@ _write_wz_to_sp(cpu_t *cpu)
     cpu->sp.val = cpu->wz.val;
 }
 
+/* 10xxxyyy - ALU r, one list per register */
+#define _ALU_R(r, name, src, op, mnemonic) \
+    static void \
+    _##op##_##r(cpu_t *cpu) \
+    { \
+        _alu_##op(cpu, (src)); \
+    } \
+    \
+    fn_row_array op##_##r = { \
+        { mnemonic " " name " [M2]", _##op##_##r }, \
+        { NULL,                     NULL } \
+    };
+
 /* 10000xxx - ADD r */
-fn_row_array add_r = {
-    { "ADD r [M2]",             _add_r },
-    { NULL,                     NULL }
-};
+INSTR_R(_ALU_R, add, "ADD")
+_ALU_R(r, "r", OP_SRC(cpu->op->ir), add, "ADD")
 
 /* 10000110 - ADD (HL) */
 fn_row_array add_ihl = {
@@ -399,10 +258,8 @@ fn_row_array add_n = {
 };
 
 /* 10001xxx - ADC r */
-fn_row_array adc_r = {
-    { "ADC r [M2]",             _adc_r },
-    { NULL,                     NULL }
-};
+INSTR_R(_ALU_R, adc, "ADC")
+_ALU_R(r, "r", OP_SRC(cpu->op->ir), adc, "ADC")
 
 /* 10001110 - ADC (HL) */
 fn_row_array adc_ihl = {
@@ -419,10 +276,8 @@ fn_row_array adc_n = {
 };
 
 /* 10010xxx - SUB r */
-fn_row_array sub_r = {
-    { "SUB r [M2]",             _sub_r },
-    { NULL,                     NULL }
-};
+INSTR_R(_ALU_R, sub, "SUB")
+_ALU_R(r, "r", OP_SRC(cpu->op->ir), sub, "SUB")
 
 /* 10010110 - SUB (HL) */
 fn_row_array sub_ihl = {
@@ -439,10 +294,8 @@ fn_row_array sub_n = {
 };
 
 /* 10011xxx - SBC r */
-fn_row_array sbc_r = {
-    { "SBC r [M2]",             _sbc_r },
-    { NULL,                     NULL }
-};
+INSTR_R(_ALU_R, sbc, "SBC")
+_ALU_R(r, "r", OP_SRC(cpu->op->ir), sbc, "SBC")
 
 /* 10011110 - SBC (HL) */
 fn_row_array sbc_ihl = {
@@ -459,10 +312,8 @@ fn_row_array sbc_n = {
 };
 
 /* 10111xxx - CP r */
-fn_row_array cp_r = {
-    { "CP r [M2]",              _cp_r },
-    { NULL,                     NULL }
-};
+INSTR_R(_ALU_R, cp, "CP")
+_ALU_R(r, "r", OP_SRC(cpu->op->ir), cp, "CP")
 
 /* 10111110 - CP (HL) */
 fn_row_array cp_ihl = {
@@ -478,11 +329,21 @@ fn_row_array cp_n = {
     { NULL,                     NULL }
 };
 
-/* 00xxx100 - INC r */
-fn_row_array inc_r = {
-    { "INC r [M2]",             _inc_r },
-    { NULL,                     NULL }
-};
+/* 00xxx100 - INC r and 00xxx101 - DEC r */
+#define _INC_DEC_R(r, name, reg, op, OP) \
+    static void \
+    _##op##_##r(cpu_t *cpu) \
+    { \
+        OP##8(reg); \
+    } \
+    \
+    fn_row_array op##_##r = { \
+        { #OP " " name " [M2]",      _##op##_##r }, \
+        { NULL,                     NULL } \
+    };
+
+INSTR_R(_INC_DEC_R, inc, INC)
+_INC_DEC_R(r, "r", OP_DST(cpu->op->ir), inc, INC)
 
 /* 00110100 - INC (HL) */
 fn_row_array inc_ihl = {
@@ -493,10 +354,8 @@ fn_row_array inc_ihl = {
 };
 
 /* 00xxx101 - DEC r */
-fn_row_array dec_r = {
-    { "DEC r [M2]",             _dec_r },
-    { NULL,                     NULL }
-};
+INSTR_R(_INC_DEC_R, dec, DEC)
+_INC_DEC_R(r, "r", OP_DST(cpu->op->ir), dec, DEC)
 
 /* 00110101 - DEC (HL) */
 fn_row_array dec_ihl = {
@@ -507,10 +366,8 @@ fn_row_array dec_ihl = {
 };
 
 /* 10100xxx - AND r */
-fn_row_array and_r = {
-    { "AND r [M2]",             _and_r },
-    { NULL,                     NULL }
-};
+INSTR_R(_ALU_R, and, "AND")
+_ALU_R(r, "r", OP_SRC(cpu->op->ir), and, "AND")
 
 /* 10100110 - AND (HL) */
 fn_row_array and_ihl = {
@@ -527,10 +384,8 @@ fn_row_array and_n = {
 };
 
 /* 10110xxx - OR r */
-fn_row_array or_r = {
-    { "OR r [M2]",              _or_r },
-    { NULL,                     NULL }
-};
+INSTR_R(_ALU_R, or, "OR")
+_ALU_R(r, "r", OP_SRC(cpu->op->ir), or, "OR")
 
 /* 10110110 - OR (HL) */
 fn_row_array or_ihl = {
@@ -547,10 +402,8 @@ fn_row_array or_n = {
 };
 
 /* 10101xxx - XOR r */
-fn_row_array xor_r = {
-    { "XOR r [M2]",             _xor_r },
-    { NULL,                     NULL }
-};
+INSTR_R(_ALU_R, xor, "XOR")
+_ALU_R(r, "r", OP_SRC(cpu->op->ir), xor, "XOR")
 
 /* 10101110 - XOR (HL) */
 fn_row_array xor_ihl = {
@@ -590,26 +443,61 @@ fn_row_array cpl = {
     { NULL,                     NULL }
 };
 
-/* 00xx0011 - INC rr */
-fn_row_array inc_rr =  {
-    { "INC rr [M2]",            _inc_rr },
-    { "INC rr [M3]",            _nothing },
-    { NULL,                     NULL }
-};
-
-/* 00xx1011 - DEC rr */
-fn_row_array dec_rr = {
-    { "DEC rr [M2]",            _dec_rr },
-    { "DEC rr [M3]",            _nothing },
-    { NULL,                     NULL }
-};
+/* 00xx0011 - INC rr and 00xx1011 - DEC rr */
+#define _INC_DEC_RR(rr, name, reg, op, OP, step) \
+    static void \
+    _##op##_##rr(cpu_t *cpu) \
+    { \
+        /* step the register with IDU */ \
+        _idu_write(cpu, (reg).val); \
+        (reg).val step; \
+    } \
+    \
+    fn_row_array op##_##rr = { \
+        { #OP " " name " [M2]",     _##op##_##rr }, \
+        { #OP " " name " [M3]",     _nothing }, \
+        { NULL,                     NULL } \
+    };
+
+INSTR_RR(_INC_DEC_RR, inc, INC, ++)
+_INC_DEC_RR(rr, "rr", OP_RR(cpu->op->ir), inc, INC, ++)
+INSTR_RR(_INC_DEC_RR, dec, DEC, --)
+_INC_DEC_RR(rr, "rr", OP_RR(cpu->op->ir), dec, DEC, --)
 
 /* 00xx1001 - ADD HL, rr */
-fn_row_array add_hl_rr = {
-    { "ADD HL, rr [M2]",        _add_lr_to_l },
-    { "ADD HL, rr [M3]",        _add_hr_to_h },
-    { NULL,                     NULL }
-};
+#define _ADD_HL_RR(rr, name, reg, unused) \
+    static void \
+    _add_##rr##_lo_to_l(cpu_t *cpu) \
+    { \
+        /* add low register to L. the zero flag is unaffected, so no ADD8() \
+         * here */ \
+        uint8_t lo = (reg).lo; \
+        uint8_t half = (((cpu->hl.lo & 0xf) + (lo & 0xf)) & 0x10) << 1; \
+        uint8_t carry = ((cpu->hl.lo + lo) & 0x100) >> 8; \
+        _cpu_flags_nh(cpu, cpu->flags.res, half, carry); \
+        cpu->hl.lo += lo; \
+    } \
+    \
+    static void \
+    _add_##rr##_hi_to_h(cpu_t *cpu) \
+    { \
+        /* add high register to H with carry, Z unaffected again */ \
+        uint8_t hi = (reg).hi, carry = FLAG_CARRY(); \
+        uint8_t half = \
+            (((cpu->hl.hi & 0xf) + (hi & 0xf) + carry) & 0x10) << 1; \
+        _cpu_flags_nh(cpu, cpu->flags.res, half, \
+                ((cpu->hl.hi + hi + carry) & 0x100) >> 8); \
+        cpu->hl.hi += hi + carry; \
+    } \
+    \
+    fn_row_array add_hl_##rr = { \
+        { "ADD HL, " name " [M2]",  _add_##rr##_lo_to_l }, \
+        { "ADD HL, " name " [M3]",  _add_##rr##_hi_to_h }, \
+        { NULL,                     NULL } \
+    };
+
+INSTR_RR(_ADD_HL_RR, )
+_ADD_HL_RR(rr, "rr", OP_RR(cpu->op->ir), )
 
 /* 11101000 - ADD SP, smm8 */
 fn_row_array add_sp_e = {
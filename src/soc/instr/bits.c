@@ -9,30 +9,6 @@ _read_ihl_into_z(cpu_t *cpu)
     _cpu_read_byte(cpu, &cpu->wz.lo, cpu->hl.val);
 }
 
-static uint8_t *
-_get_r(cpu_t *cpu, uint8_t val)
-{
-    assert(val <= 7 && val != 6);
-    switch (val) {
-        case 0x00:
-            return &cpu->bc.hi;
-        case 0x01:
-            return &cpu->bc.lo;
-        case 0x02:
-            return &cpu->de.hi;
-        case 0x03:
-            return &cpu->de.lo;
-        case 0x04:
-            return &cpu->hl.hi;
-        case 0x05:
-            return &cpu->hl.lo;
-        case 0x07:
-            return &cpu->af.hi;
-        default:
-            unreachable();
-    }
-}
-
 static void
 _rlca(cpu_t *cpu)
 {
@@ -73,13 +49,6 @@ _rra(cpu_t *cpu)
     UNSET_ZERO();
 }
 
-static void
-_rlc_r(cpu_t *cpu)
-{
-    uint8_t *reg = _get_r(cpu, cpu->ir & 0x07), tmp;
-    RLC8(*reg, tmp);
-}
-
 static void
 _rlc_z_into_ihl(cpu_t *cpu)
 {
@@ -88,13 +57,6 @@ _rlc_z_into_ihl(cpu_t *cpu)
     _cpu_write_byte(cpu, cpu->hl.val, res);
 }
 
-static void
-_rrc_r(cpu_t *cpu)
-{
-    uint8_t *reg = _get_r(cpu, cpu->ir & 0x07), tmp;
-    RRC8(*reg, tmp);
-}
-
 static void
 _rrc_z_into_ihl(cpu_t *cpu)
 {
@@ -103,13 +65,6 @@ _rrc_z_into_ihl(cpu_t *cpu)
     _cpu_write_byte(cpu, cpu->hl.val, res);
 }
 
-static void
-_rl_r(cpu_t *cpu)
-{
-    uint8_t *reg = _get_r(cpu, cpu->ir & 0x07), tmp;
-    RL8(*reg, tmp);
-}
-
 static void
 _rl_z_into_ihl(cpu_t *cpu)
 {
@@ -118,13 +73,6 @@ _rl_z_into_ihl(cpu_t *cpu)
     _cpu_write_byte(cpu, cpu->hl.val, res);
 }
 
-static void
-_rr_r(cpu_t *cpu)
-{
-    uint8_t *reg = _get_r(cpu, cpu->ir & 0x07), tmp;
-    RR8(*reg, tmp);
-}
-
 static void
 _rr_z_into_ihl(cpu_t *cpu)
 {
@@ -133,13 +81,6 @@ _rr_z_into_ihl(cpu_t *cpu)
     _cpu_write_byte(cpu, cpu->hl.val, res);
 }
 
-static void
-_sla_r(cpu_t *cpu)
-{
-    uint8_t *reg = _get_r(cpu, cpu->ir & 0x07), tmp;
-    SLA8(*reg, tmp);
-}
-
 static void
 _sla_z_into_ihl(cpu_t *cpu)
 {
@@ -148,13 +89,6 @@ _sla_z_into_ihl(cpu_t *cpu)
     _cpu_write_byte(cpu, cpu->hl.val, res);
 }
 
-static void
-_sra_r(cpu_t *cpu)
-{
-    uint8_t *reg = _get_r(cpu, cpu->ir & 0x07), tmp;
-    SRA8(*reg, tmp);
-}
-
 static void
 _sra_z_into_ihl(cpu_t *cpu)
 {
@@ -163,13 +97,6 @@ _sra_z_into_ihl(cpu_t *cpu)
     _cpu_write_byte(cpu, cpu->hl.val, res);
 }
 
-static void
-_swap_r(cpu_t *cpu)
-{
-    uint8_t *reg = _get_r(cpu, cpu->ir & 0x07), tmp;
-    SWAP8(*reg, tmp);
-}
-
 static void
 _swap_z_into_ihl(cpu_t *cpu)
 {
@@ -178,13 +105,6 @@ _swap_z_into_ihl(cpu_t *cpu)
     _cpu_write_byte(cpu, cpu->hl.val, res);
 }
 
-static void
-_srl_r(cpu_t *cpu)
-{
-    uint8_t *reg = _get_r(cpu, cpu->ir & 0x07), tmp;
-    SRL8(*reg, tmp);
-}
-
 static void
 _srl_z_into_ihl(cpu_t *cpu)
 {
@@ -193,55 +113,6 @@ _srl_z_into_ihl(cpu_t *cpu)
     _cpu_write_byte(cpu, cpu->hl.val, res);
 }
 
-static void
-_bit_b_r(cpu_t *cpu)
-{
-    uint8_t *reg = _get_r(cpu, cpu->ir & 0x07);
-    uint8_t bit = (cpu->ir & 0x38) >> 3;
-    BIT8(bit, *reg);
-}
-
-static void
-_bit_b_z(cpu_t *cpu)
-{
-    uint8_t bit = (cpu->ir & 0x38) >> 3;
-    BIT8(bit, cpu->wz.lo);
-}
-
-static void
-_res_b_r(cpu_t *cpu)
-{
-    uint8_t *reg = _get_r(cpu, cpu->ir & 0x07);
-    uint8_t bit = (cpu->ir & 0x38) >> 3;
-    RES8(bit, *reg);
-}
-
-static void
-_res_b_z_into_ihl(cpu_t *cpu)
-{
-    uint8_t res = cpu->wz.lo;
-    uint8_t bit = (cpu->ir & 0x38) >> 3;
-    RES8(bit, res);
-    _cpu_write_byte(cpu, cpu->hl.val, res);
-}
-
-static void
-_set_b_r(cpu_t *cpu)
-{
-    uint8_t *reg = _get_r(cpu, cpu->ir & 0x07);
-    uint8_t bit = (cpu->ir & 0x38) >> 3;
-    SET8(bit, *reg);
-}
-
-static void
-_set_b_z_into_ihl(cpu_t *cpu)
-{
-    uint8_t res = cpu->wz.lo;
-    uint8_t bit = (cpu->ir & 0x38) >> 3;
-    SET8(bit, res);
-    _cpu_write_byte(cpu, cpu->hl.val, res);
-}
-
 fn_row_array rlca = {
     { "RLCA [M3]",              _rlca },
     { NULL,                     NULL }
@@ -262,11 +133,23 @@ fn_row_array rra = {
     { NULL,                     NULL }
 };
 
-fn_row_array rlc_r = {
-    { NULL,                     NULL },
-    { "RLC r [M3]",             _rlc_r },
-    { NULL,                     NULL }
-};
+/* the rotates and shifts of the CB r forms, one list per register */
+#define _ROT_R(r, name, reg, op, OP) \
+    static void \
+    _##op##_##r(cpu_t *cpu) \
+    { \
+        uint8_t tmp; \
+        OP##8(reg, tmp); \
+    } \
+    \
+    fn_row_array op##_##r = { \
+        { NULL,                     NULL }, \
+        { #OP " " name " [M3]",     _##op##_##r }, \
+        { NULL,                     NULL } \
+    };
+
+INSTR_R(_ROT_R, rlc, RLC)
+_ROT_R(r, "r", OP_SRC(cpu->op->cb_ir), rlc, RLC)
 
 fn_row_array rlc_ihl = {
     { NULL,                     NULL },
@@ -276,11 +159,8 @@ fn_row_array rlc_ihl = {
     { NULL,                     NULL }
 };
 
-fn_row_array rrc_r = {
-    { NULL,                     NULL },
-    { "RRC r [M3]",             _rrc_r },
-    { NULL,                     NULL }
-};
+INSTR_R(_ROT_R, rrc, RRC)
+_ROT_R(r, "r", OP_SRC(cpu->op->cb_ir), rrc, RRC)
 
 fn_row_array rrc_ihl = {
     { NULL,                     NULL },
@@ -290,11 +170,8 @@ fn_row_array rrc_ihl = {
     { NULL,                     NULL }
 };
 
-fn_row_array rl_r = {
-    { NULL,                     NULL },
-    { "RL r [M3]",              _rl_r },
-    { NULL,                     NULL }
-};
+INSTR_R(_ROT_R, rl, RL)
+_ROT_R(r, "r", OP_SRC(cpu->op->cb_ir), rl, RL)
 
 fn_row_array rl_ihl = {
     { NULL,                     NULL },
@@ -304,11 +181,8 @@ fn_row_array rl_ihl = {
     { NULL,                     NULL }
 };
 
-fn_row_array rr_r = {
-    { NULL,                     NULL },
-    { "RR r [M3]",              _rr_r },
-    { NULL,                     NULL }
-};
+INSTR_R(_ROT_R, rr, RR)
+_ROT_R(r, "r", OP_SRC(cpu->op->cb_ir), rr, RR)
 
 fn_row_array rr_ihl = {
     { NULL,                     NULL },
@@ -318,11 +192,8 @@ fn_row_array rr_ihl = {
     { NULL,                     NULL }
 };
 
-fn_row_array sla_r = {
-    { NULL,                     NULL },
-    { "SLA r [M3]",             _sla_r },
-    { NULL,                     NULL }
-};
+INSTR_R(_ROT_R, sla, SLA)
+_ROT_R(r, "r", OP_SRC(cpu->op->cb_ir), sla, SLA)
 
 fn_row_array sla_ihl = {
     { NULL,                     NULL },
@@ -332,11 +203,8 @@ fn_row_array sla_ihl = {
     { NULL,                     NULL }
 };
 
-fn_row_array sra_r = {
-    { NULL,                     NULL },
-    { "SRA r [M3]",             _sra_r },
-    { NULL,                     NULL }
-};
+INSTR_R(_ROT_R, sra, SRA)
+_ROT_R(r, "r", OP_SRC(cpu->op->cb_ir), sra, SRA)
 
 fn_row_array sra_ihl = {
     { NULL,                     NULL },
@@ -346,11 +214,8 @@ fn_row_array sra_ihl = {
     { NULL,                     NULL }
 };
 
-fn_row_array swap_r = {
-    { NULL,                     NULL },
-    { "SWAP r [M3]",            _swap_r },
-    { NULL,                     NULL }
-};
+INSTR_R(_ROT_R, swap, SWAP)
+_ROT_R(r, "r", OP_SRC(cpu->op->cb_ir), swap, SWAP)
 
 fn_row_array swap_ihl = {
     { NULL,                     NULL },
@@ -360,11 +225,8 @@ fn_row_array swap_ihl = {
     { NULL,                     NULL }
 };
 
-fn_row_array srl_r = {
-    { NULL,                     NULL },
-    { "SRL r [M3]",             _srl_r },
-    { NULL,                     NULL }
-};
+INSTR_R(_ROT_R, srl, SRL)
+_ROT_R(r, "r", OP_SRC(cpu->op->cb_ir), srl, SRL)
 
 fn_row_array srl_ihl = {
     { NULL,                     NULL },
@@ -374,43 +236,79 @@ fn_row_array srl_ihl = {
     { NULL,                     NULL }
 };
 
-fn_row_array bit_b_r = {
-    { NULL,                     NULL },
-    { "BIT b, n [M3]",          _bit_b_r },
-    { NULL,                     NULL }
-};
-
-fn_row_array bit_b_ihl = {
-    { NULL,                     NULL },
-    { "BIT b, (HL) [M3]",       _read_ihl_into_z },
-    { "BIT b, (HL) [M4]",       _bit_b_z },
-    { NULL,                     NULL }
-};
-
-fn_row_array res_b_r = {
-    { NULL,                     NULL },
-    { "RES b, n [M3]",          _res_b_r },
-    { NULL,                     NULL }
-};
-
-fn_row_array res_b_ihl = {
-    { NULL,                     NULL },
-    { "RES b, (HL) [M3]",       _read_ihl_into_z },
-    { "RES b, (HL) [M4]",       _res_b_z_into_ihl },
-    { "RES b, (HL) [M5]",       _nothing },
-    { NULL,                     NULL }
-};
-
-fn_row_array set_b_r = {
-    { NULL,                     NULL },
-    { "SET b, n [M3]",          _set_b_r },
-    { NULL,                     NULL }
-};
-
-fn_row_array set_b_ihl = {
-    { NULL,                     NULL },
-    { "SET b, (HL) [M3]",       _read_ihl_into_z },
-    { "SET b, (HL) [M4]",       _set_b_z_into_ihl },
-    { "SET b, (HL) [M5]",       _nothing },
-    { NULL,                     NULL }
-};
+/* BIT b, r and BIT b, (HL), one list per bit and register */
+#define _BIT_R(r, name, reg, b, bname, bit) \
+    static void \
+    _bit_##b##_##r(cpu_t *cpu) \
+    { \
+        BIT8((bit), reg); \
+    } \
+    \
+    fn_row_array bit_##b##_##r = { \
+        { NULL,                     NULL }, \
+        { "BIT " bname ", " name " [M3]", _bit_##b##_##r }, \
+        { NULL,                     NULL } \
+    };
+#define _BIT_IHL(b, bname, bit, unused) \
+    static void \
+    _bit_##b##_z(cpu_t *cpu) \
+    { \
+        BIT8((bit), cpu->wz.lo); \
+    } \
+    \
+    fn_row_array bit_##b##_ihl = { \
+        { NULL,                     NULL }, \
+        { "BIT " bname ", (HL) [M3]", _read_ihl_into_z }, \
+        { "BIT " bname ", (HL) [M4]", _bit_##b##_z }, \
+        { NULL,                     NULL } \
+    };
+#define _BIT_ROW(b, bname, bit, unused) \
+    INSTR_R(_BIT_R, b, bname, bit) \
+    _BIT_IHL(b, bname, bit, )
+
+INSTR_BIT(_BIT_ROW, )
+_BIT_R(r, "r", OP_SRC(cpu->op->cb_ir), b, "b",
+        OP_N(cpu->op->cb_ir))
+_BIT_IHL(b, "b", OP_N(cpu->op->cb_ir), )
+
+/* RES b, r and SET b, r, along with their (HL) forms */
+#define _RES_SET_R(r, name, reg, b, bname, bit, op, OP) \
+    static void \
+    _##op##_##b##_##r(cpu_t *cpu) \
+    { \
+        OP##8((bit), reg); \
+    } \
+    \
+    fn_row_array op##_##b##_##r = { \
+        { NULL,                     NULL }, \
+        { #OP " " bname ", " name " [M3]", _##op##_##b##_##r }, \
+        { NULL,                     NULL } \
+    };
+#define _RES_SET_IHL(b, bname, bit, op, OP) \
+    static void \
+    _##op##_##b##_z_into_ihl(cpu_t *cpu) \
+    { \
+        uint8_t res = cpu->wz.lo; \
+        OP##8((bit), res); \
+        _cpu_write_byte(cpu, cpu->hl.val, res); \
+    } \
+    \
+    fn_row_array op##_##b##_ihl = { \
+        { NULL,                     NULL }, \
+        { #OP " " bname ", (HL) [M3]", _read_ihl_into_z }, \
+        { #OP " " bname ", (HL) [M4]", _##op##_##b##_z_into_ihl }, \
+        { #OP " " bname ", (HL) [M5]", _nothing }, \
+        { NULL,                     NULL } \
+    };
+#define _RES_SET_ROW(b, bname, bit, op, OP) \
+    INSTR_R(_RES_SET_R, b, bname, bit, op, OP) \
+    _RES_SET_IHL(b, bname, bit, op, OP)
+
+INSTR_BIT(_RES_SET_ROW, res, RES)
+_RES_SET_R(r, "r", OP_SRC(cpu->op->cb_ir), b, "b",
+        OP_N(cpu->op->cb_ir), res, RES)
+_RES_SET_IHL(b, "b", OP_N(cpu->op->cb_ir), res, RES)
+INSTR_BIT(_RES_SET_ROW, set, SET)
+_RES_SET_R(r, "r", OP_SRC(cpu->op->cb_ir), b, "b",
+        OP_N(cpu->op->cb_ir), set, SET)
+_RES_SET_IHL(b, "b", OP_N(cpu->op->cb_ir), set, SET)
@@ -0,0 +1,173 @@
+#include "soc/instr/instrs.h"
+#include "types.h"
+
+/* what running an instruction takes. it only depends on the opcode, so it is
+ * worked out once */
+typedef struct decode_info {
+    uint8_t mcycles;
+    enum cpu_access access;
+    bool writes;
+} decode_info_t;
+
+static decode_info_t _info[256], _cb_info[256];
+static bool _info_ready = false;
+
+static inline uint8_t
+_decode_mcycles(fn_list_t list)
+{
+    /* every micro-op takes a machine cycle, the last one overlaps the fetch */
+    uint8_t len = 0;
+    while (list[len].fn)
+        ++len;
+    return len;
+}
+
+static void
+_decode_access(decode_info_t *info, fn_list_t list)
+{
+    info->access = ACCESS_CYCLED;
+    info->writes = false;
+
+    /* registers only */
+    if (list == nop || list == ld_r_r || list == ld_r_n || list == ld_rr_nn ||
+            list == ld_sp_hl || list == ld_hl_spe || list == add_r ||
+            list == add_n || list == adc_r || list == adc_n || list == sub_r ||
+            list == sub_n || list == sbc_r || list == sbc_n || list == cp_r ||
+            list == cp_n || list == inc_r || list == dec_r || list == and_r ||
+            list == and_n || list == or_r || list == or_n || list == xor_r ||
+            list == xor_n || list == ccf || list == scf || list == daa ||
+            list == cpl || list == inc_rr || list == dec_rr ||
+            list == add_hl_rr || list == add_sp_e || list == jp_nn ||
+            list == jp_hl || list == jp_cc_nn || list == jr_e ||
+            list == jr_cc_e || list == rlca || list == rrca || list == rla ||
+            list == rra || list == rlc_r || list == rrc_r || list == rl_r ||
+            list == rr_r || list == sla_r || list == sra_r || list == swap_r ||
+            list == srl_r || list == bit_b_r || list == res_b_r ||
+            list == set_b_r)
+        info->access = ACCESS_NONE;
+
+    /* (HL), possibly written back */
+    if (list == ld_r_ihl || list == add_ihl || list == adc_ihl ||
+            list == sub_ihl || list == sbc_ihl || list == cp_ihl ||
+            list == and_ihl || list == or_ihl || list == xor_ihl ||
+            list == bit_b_ihl)
+        info->access = ACCESS_IHL;
+    if (list == ld_ihl_r || list == ld_ihl_n || list == inc_ihl ||
+            list == dec_ihl || list == rlc_ihl || list == rrc_ihl ||
+            list == rl_ihl || list == rr_ihl || list == sla_ihl ||
+            list == sra_ihl || list == swap_ihl || list == srl_ihl ||
+            list == res_b_ihl || list == set_b_ihl) {
+        info->access = ACCESS_IHL;
+        info->writes = true;
+    }
+
+    /* the other addressing modes */
+    if (list == ld_a_irr || list == ld_irr_a)
+        info->access = ACCESS_IRR;
+    if (list == ldh_a_in || list == ldh_in_a)
+        info->access = ACCESS_HIGH_N;
+    if (list == ldh_a_ic || list == ldh_ic_a)
+        info->access = ACCESS_HIGH_C;
+    if (list == ld_a_inn || list == ld_inn_a)
+        info->access = ACCESS_INN;
+    if (list == ld_inn_sp)
+        info->access = ACCESS_INN_SP;
+    if (list == ld_irr_a || list == ldh_in_a || list == ldh_ic_a ||
+            list == ld_inn_a || list == ld_inn_sp)
+        info->writes = true;
+
+    /* the stack */
+    if (list == pop_rr || list == ret || list == ret_cc || list == reti)
+        info->access = ACCESS_POP;
+    if (list == push_rr || list == call_nn || list == call_cc_nn ||
+            list == rst_n) {
+        info->access = ACCESS_PUSH;
+        info->writes = true;
+    }
+
+    /* HALT, STOP, EI, DI and a CB prefix without its second byte are left to
+     * the machine cycles */
+}
+
+static void
+_decode_info_init(void)
+{
+    for (unsigned ir = 0; ir < 256; ++ir) {
+        _info[ir].mcycles = _decode_mcycles(*instructions[ir]);
+        _decode_access(&_info[ir], *instr_groups[ir]);
+
+        /* the prefix's cycle comes first. the CB lists start from M3 */
+        _cb_info[ir].mcycles = 1 + _decode_mcycles(*cb_instructions[ir] + 1);
+        _decode_access(&_cb_info[ir], *cb_instr_groups[ir]);
+    }
+
+    _info_ready = true;
+}
+
+void
+cpu_decode(cpu_op_t *op, uint8_t ir)
+{
+    /* the CB part is filled in by cpu_decode_cb() */
+    op->ir = ir;
+    op->cb_ir = 0x00;
+    op->cb = false;
+
+    /* what running it takes */
+    if (!_info_ready)
+        _decode_info_init();
+    op->mcycles = _info[ir].mcycles;
+    op->access = _info[ir].access;
+    op->writes = _info[ir].writes;
+
+    /* nothing is fused until the block is complete (see cpu_fuse()) */
+    op->fused = 0;
+    op->fused_mcycles = 0;
+}
+
+void
+cpu_decode_cb(cpu_op_t *op, uint8_t ir)
+{
+    /* cpu_decode() has already been called for the prefix */
+    op->cb_ir = ir;
+    op->cb = true;
+    op->mcycles = _cb_info[ir].mcycles;
+    op->access = _cb_info[ir].access;
+    op->writes = _cb_info[ir].writes;
+}
+
+unsigned
+cpu_instr_len(uint8_t ir)
+{
+    switch (ir) {
+        /* imm8 operand */
+        case 0x06: case 0x0E: case 0x16: case 0x1E:
+        case 0x26: case 0x2E: case 0x36: case 0x3E:
+        case 0x18: case 0x20: case 0x28: case 0x30: case 0x38:
+        case 0xC6: case 0xCE: case 0xD6: case 0xDE:
+        case 0xE6: case 0xEE: case 0xF6: case 0xFE:
+        case 0xE0: case 0xF0: case 0xE8: case 0xF8:
+        case 0xCB:
+            return 2;
+
+        /* imm16 operand */
+        case 0x01: case 0x11: case 0x21: case 0x31: case 0x08:
+        case 0xC2: case 0xC3: case 0xCA: case 0xD2: case 0xDA:
+        case 0xC4: case 0xCC: case 0xCD: case 0xD4: case 0xDC:
+        case 0xEA: case 0xFA:
+            return 3;
+
+        default:
+            return 1;
+    }
+}
+
+bool
+cpu_instr_ends_block(uint8_t ir)
+{
+    /* anything that might not continue with the next instruction */
+    fn_list_t list = *instr_groups[ir];
+    return list == jr_e || list == jr_cc_e || list == jp_nn ||
+        list == jp_hl || list == jp_cc_nn || list == call_nn ||
+        list == call_cc_nn || list == ret || list == ret_cc || list == reti ||
+        list == rst_n || list == halt || list == stop || list == not_impl;
+}
@@ -51,19 +51,6 @@ _write_wz_to_pc_enable_ime(cpu_t *cpu)
     cpu->ime = true;
 }
 
-static void
-_write_wz_to_pc_cc(cpu_t *cpu)
-{
-    /* check condition */
-    bool cond = _is_cond_true(cpu, (cpu->ir & 0x18) >> 3);
-
-    /* if cond is true, perform the move. otherwise, skip a cycle */
-    if (cond)
-        _write_wz_to_pc(cpu);
-    else
-        ++cpu->state;
-}
-
 static void
 _write_hl_to_pc(cpu_t *cpu)
 {
@@ -102,19 +89,6 @@ _adjust_pc_to_wz(cpu_t *cpu)
         _idu_write(cpu, cpu->pc.hi);
 }
 
-static void
-_adjust_pc_to_wz_cc(cpu_t *cpu)
-{
-    /* check condition */
-    bool cond = _is_cond_true(cpu, (cpu->ir & 0x18) >> 3);
-
-    /* if cond is true proceed normally, otherwise do nothing and skip cycle */
-    if (cond)
-        _adjust_pc_to_wz(cpu);
-    else
-        ++cpu->state;
-}
-
 static void
 _dec_sp(cpu_t *cpu)
 {
@@ -122,19 +96,6 @@ _dec_sp(cpu_t *cpu)
     _idu_write(cpu, cpu->sp.val--);
 }
 
-static void
-_call_dec_sp_cc(cpu_t *cpu)
-{
-    /* check if condition is true */
-    bool cond = _is_cond_true(cpu, (cpu->ir & 0x18) >> 3);
-
-    /* if cond is true proceed normally, otherwise skip 3 cycles */
-    if (cond)
-        _dec_sp(cpu);
-    else
-        cpu->state += 3;
-}
-
 static void
 _push_pc_1(cpu_t *cpu)
 {
@@ -151,14 +112,6 @@ _push_pc_2(cpu_t *cpu)
     cpu->pc.val = cpu->wz.val;
 }
 
-static void
-_rst_push_pc_2(cpu_t *cpu)
-{
-    /* write C (low PC) to stack and set PC to one of the RST addresses */
-    _cpu_write_byte(cpu, cpu->sp.val, cpu->pc.lo);
-    cpu->pc.val = ((cpu->ir & 0x38) >> 3) * 0x08;
-}
-
 static void
 _pop_pc_1(cpu_t *cpu)
 {
@@ -175,18 +128,51 @@ _pop_pc_2(cpu_t *cpu)
     _idu_write(cpu, cpu->sp.val++);
 }
 
-static void
-_ret_pop_pc_1_cc(cpu_t *cpu)
-{
-    /* check if cond is true */
-    bool cond = _is_cond_true(cpu, (cpu->ir & 0x18) >> 3);
-
-    /* if cond is true proceed normally, otherwise skip 3 cycles */
-    if (cond)
-        _pop_pc_1(cpu);
-    else
-        cpu->state += 3;
-}
+/* the conditional steps, one per condition. the condition is known at compile
+ * time, so only the flag test is left */
+#define _CC(c, name, cc, unused) \
+    static void \
+    _write_wz_to_pc_##c(cpu_t *cpu) \
+    { \
+        /* if cond is true, perform the move. otherwise, skip a cycle */ \
+        if (_is_cond_true(cpu, (cc))) \
+            _write_wz_to_pc(cpu); \
+        else \
+            ++cpu->state; \
+    } \
+    \
+    static void \
+    _adjust_pc_to_wz_##c(cpu_t *cpu) \
+    { \
+        /* if cond is true proceed normally, otherwise skip a cycle */ \
+        if (_is_cond_true(cpu, (cc))) \
+            _adjust_pc_to_wz(cpu); \
+        else \
+            ++cpu->state; \
+    } \
+    \
+    static void \
+    _call_dec_sp_##c(cpu_t *cpu) \
+    { \
+        /* if cond is true proceed normally, otherwise skip 3 cycles */ \
+        if (_is_cond_true(cpu, (cc))) \
+            _dec_sp(cpu); \
+        else \
+            cpu->state += 3; \
+    } \
+    \
+    static void \
+    _ret_pop_pc_1_##c(cpu_t *cpu) \
+    { \
+        /* if cond is true proceed normally, otherwise skip 3 cycles */ \
+        if (_is_cond_true(cpu, (cc))) \
+            _pop_pc_1(cpu); \
+        else \
+            cpu->state += 3; \
+    }
+
+INSTR_CC(_CC, )
+_CC(cc, "cc", OP_CC(cpu->op->ir), )
 
 /* 11000011 - JP nn */
 fn_row_array jp_nn = {
@@ -204,13 +190,17 @@ fn_row_array jp_hl = {
 };
 
 /* 110xx010 - JP cc, nn */
-fn_row_array jp_cc_nn = {
-    { "JP cc, nn [M2]",         _read_imm8_into_z },
-    { "JP cc, nn [M3]",         _read_imm8_into_w },
-    { "JP cc, nn [M4]",         _write_wz_to_pc_cc },
-    { "JP cc, nn [M5]",         _nothing },
-    { NULL,                     NULL }
-};
+#define _JP_CC_NN(c, name, cc, unused) \
+    fn_row_array jp_##c##_nn = { \
+        { "JP " name ", nn [M2]",   _read_imm8_into_z }, \
+        { "JP " name ", nn [M3]",   _read_imm8_into_w }, \
+        { "JP " name ", nn [M4]",   _write_wz_to_pc_##c }, \
+        { "JP " name ", nn [M5]",   _nothing }, \
+        { NULL,                     NULL } \
+    };
+
+INSTR_CC(_JP_CC_NN, )
+_JP_CC_NN(cc, "cc", , )
 
 /* 00011000 - JR e */
 fn_row_array jr_e = {
@@ -221,12 +211,16 @@ fn_row_array jr_e = {
 };
 
 /* 001xx000 - JR cc, e */
-fn_row_array jr_cc_e = {
-    { "JR cc, e [M2]",          _read_imm8_into_z },
-    { "JR cc, e [M3]",          _adjust_pc_to_wz_cc },
-    { "JR cc, e [M4]",          _write_wz_to_pc },
-    { NULL,                     NULL }
-};
+#define _JR_CC_E(c, name, cc, unused) \
+    fn_row_array jr_##c##_e = { \
+        { "JR " name ", e [M2]",    _read_imm8_into_z }, \
+        { "JR " name ", e [M3]",    _adjust_pc_to_wz_##c }, \
+        { "JR " name ", e [M4]",    _write_wz_to_pc }, \
+        { NULL,                     NULL } \
+    };
+
+INSTR_CC(_JR_CC_E, )
+_JR_CC_E(cc, "cc", , )
 
 /* 11001101 - CALL nn */
 fn_row_array call_nn = {
@@ -240,15 +234,19 @@ fn_row_array call_nn = {
 };
 
 /* 110xx100 - CALL cc, nn */
-fn_row_array call_cc_nn = {
-    { "CALL cc, nn [M2]",       _read_imm8_into_z },
-    { "CALL cc, nn [M3]",       _read_imm8_into_w },
-    { "CALL cc, nn [M4]",       _call_dec_sp_cc },
-    { "CALL cc, nn [M5]",       _push_pc_1 },
-    { "CALL cc, nn [M6]",       _push_pc_2 },
-    { "CALL cc, nn [M7]",       _nothing },
-    { NULL,                     NULL }
-};
+#define _CALL_CC_NN(c, name, cc, unused) \
+    fn_row_array call_##c##_nn = { \
+        { "CALL " name ", nn [M2]", _read_imm8_into_z }, \
+        { "CALL " name ", nn [M3]", _read_imm8_into_w }, \
+        { "CALL " name ", nn [M4]", _call_dec_sp_##c }, \
+        { "CALL " name ", nn [M5]", _push_pc_1 }, \
+        { "CALL " name ", nn [M6]", _push_pc_2 }, \
+        { "CALL " name ", nn [M7]", _nothing }, \
+        { NULL,                     NULL } \
+    };
+
+INSTR_CC(_CALL_CC_NN, )
+_CALL_CC_NN(cc, "cc", , )
 
 /* 11001001 - RET */
 fn_row_array ret = {
@@ -260,14 +258,18 @@ fn_row_array ret = {
 };
 
 /* 110xx000 - RET cc */
-fn_row_array ret_cc = {
-    { "RET cc [M2]",            _nothing },
-    { "RET cc [M3]",            _ret_pop_pc_1_cc },
-    { "RET cc [M4]",            _pop_pc_2 },
-    { "RET cc [M5]",            _write_wz_to_pc },
-    { "RET cc [M6]",            _nothing },
-    { NULL,                     NULL }
-};
+#define _RET_CC(c, name, cc, unused) \
+    fn_row_array ret_##c = { \
+        { "RET " name " [M2]",      _nothing }, \
+        { "RET " name " [M3]",      _ret_pop_pc_1_##c }, \
+        { "RET " name " [M4]",      _pop_pc_2 }, \
+        { "RET " name " [M5]",      _write_wz_to_pc }, \
+        { "RET " name " [M6]",      _nothing }, \
+        { NULL,                     NULL } \
+    };
+
+INSTR_CC(_RET_CC, )
+_RET_CC(cc, "cc", , )
 
 /* 11011001 - RETI */
 fn_row_array reti = {
@@ -279,10 +281,22 @@ fn_row_array reti = {
 };
 
 /* 11xxx111 - RST n */
-fn_row_array rst_n = {
-    { "RST n [M2]",             _dec_sp },
-    { "RST n [M3]",             _push_pc_1 },
-    { "RST n [M4]",             _rst_push_pc_2 },
-    { "RST n [M5]",             _nothing },
-    { NULL,                     NULL }
-};
+#define _RST_N(n, name, vec, unused) \
+    static void \
+    _rst_##n##_push_pc_2(cpu_t *cpu) \
+    { \
+        /* write C (low PC) to stack and set PC to the RST address */ \
+        _cpu_write_byte(cpu, cpu->sp.val, cpu->pc.lo); \
+        cpu->pc.val = (vec); \
+    } \
+    \
+    fn_row_array rst_##n = { \
+        { "RST " name " [M2]",      _dec_sp }, \
+        { "RST " name " [M3]",      _push_pc_1 }, \
+        { "RST " name " [M4]",      _rst_##n##_push_pc_2 }, \
+        { "RST " name " [M5]",      _nothing }, \
+        { NULL,                     NULL } \
+    };
+
+INSTR_RST(_RST_N, )
+_RST_N(n, "n", OP_N(cpu->op->ir) * 0x08, )
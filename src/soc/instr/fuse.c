@@ -0,0 +1,146 @@
+#include "soc/cpu_common.h"
+#include "soc/instr/instrs.h"
+#include "log.h"
+#include "types.h"
+
+/* a few short sequences make up most of what games spend their time in:
+ * copy loops, counters and compare-and-branch. the block cache finds them
+ * when a block is built and runs each as a single handler. the handlers do
+ * what the micro-ops would, in the same order and with the same machine
+ * cycles, so the rest of the SoC can't tell the difference */
+
+static inline int
+_fuse_hl_step(uint8_t ir)
+{
+    /* LD A, (HL+/-) and LD (HL+/-), A step HL after the access */
+    switch ((ir & 0x30) >> 4) {
+        case 0x02:
+            return 1;
+        case 0x03:
+            return -1;
+        default:
+            return 0;
+    }
+}
+
+static inline void
+_fuse_finish(cpu_t *cpu, const cpu_op_t *ops, uint16_t pc)
+{
+    /* leave the CPU on the last instruction of the sequence, so that the
+     * jump checks in _cpu_fetch() still see it */
+    const cpu_op_t *last = &ops[ops->fused - 1];
+    cpu->ir = last->ir;
+    cpu->op = last;
+    cpu->curpc.val = pc;
+}
+
+static unsigned
+_fuse_jr_z(cpu_t *cpu, const cpu_op_t *ops)
+{
+    /* JR Z/NZ, e right after whatever set the flags. PC sits on its opcode */
+    const cpu_op_t *jr = &ops[ops->fused - 1];
+    _fuse_finish(cpu, ops, cpu->pc.val++);
+    _cpu_read_imm8(cpu, &cpu->wz.lo);
+    if (FLAG_ZERO() != OP_CC(jr->ir))
+        return jr->mcycles - 1;
+
+    cpu->wz.val = cpu->pc.val + (int8_t)cpu->wz.lo;
+    cpu->pc.val = cpu->wz.val;
+    return jr->mcycles;
+}
+
+static unsigned
+_fuse_copy(cpu_t *cpu, const cpu_op_t *ops)
+{
+    /* LD A, (rr) ; LD (rr'), A and maybe INC/DEC rr''. both accesses must go
+     * through before anything changes. the copy may go to VRAM, which is what
+     * loading screens do most */
+    int val = cpu_native_read(cpu, OP_RR(ops[0].ir).val);
+    if (val < 0 || cpu_native_write_vram(cpu, OP_RR(ops[1].ir).val, val,
+                ops->fused_mcycles) < 0)
+        return 0;
+
+    cpu->af.hi = val;
+    cpu->hl.val += _fuse_hl_step(ops[0].ir);
+    cpu->hl.val += _fuse_hl_step(ops[1].ir);
+    unsigned mcycles = ops[0].mcycles + ops[1].mcycles;
+    if (ops->fused > 2) {
+        OP_RR(ops[2].ir).val += cpu_op_group(&ops[2]) == inc_rr ? 1 : -1;
+        mcycles += ops[2].mcycles;
+    }
+
+    /* every one of them is a single byte */
+    cpu->pc.val += ops->fused - 1;
+    _fuse_finish(cpu, ops, cpu->pc.val - 1);
+    return mcycles;
+}
+
+static unsigned
+_fuse_dec_jr(cpu_t *cpu, const cpu_op_t *ops)
+{
+    /* DEC r ; JR Z/NZ, e */
+    DEC8(OP_DST(ops[0].ir));
+    return ops[0].mcycles + _fuse_jr_z(cpu, ops);
+}
+
+static unsigned
+_fuse_cp_jr(cpu_t *cpu, const cpu_op_t *ops)
+{
+    /* CP n ; JR Z/NZ, e */
+    _cpu_read_imm8(cpu, &cpu->wz.lo);
+    CP8(cpu->af.hi, cpu->wz.lo);
+    return ops[0].mcycles + _fuse_jr_z(cpu, ops);
+}
+
+static inline void
+_fuse(cpu_op_t *ops, unsigned n)
+{
+    ops->fused = n;
+    ops->fused_mcycles = 0;
+    for (unsigned i = 0; i < n; ++i)
+        ops->fused_mcycles += ops[i].mcycles;
+}
+
+void
+cpu_fuse(cpu_op_t *ops, unsigned len)
+{
+    /* every instruction may start a sequence, even inside another one: a jump
+     * can land in the middle */
+    for (unsigned i = 0; i + 1 < len; ++i) {
+        cpu_op_t *op = &ops[i];
+        fn_list_t first = cpu_op_group(&op[0]);
+        fn_list_t second = cpu_op_group(&op[1]);
+
+        if (first == ld_a_irr && second == ld_irr_a) {
+            /* the copy loop. the destination is taken before HL moves, so
+             * both can't be HL */
+            if (_fuse_hl_step(op[0].ir) && _fuse_hl_step(op[1].ir))
+                continue;
+
+            /* usually, the destination is moved right after */
+            unsigned n = 2;
+            fn_list_t third = i + 2 < len ? cpu_op_group(&op[2]) : NULL;
+            if (third == inc_rr || third == dec_rr)
+                n = 3;
+            _fuse(op, n);
+        } else if (second == jr_cc_e && OP_CC(op[1].ir) < 2 &&
+                (first == dec_r || first == cp_n)) {
+            /* counters and compares */
+            _fuse(op, 2);
+        }
+    }
+}
+
+unsigned
+cpu_run_fused(cpu_t *cpu, const cpu_op_t *ops)
+{
+    /* the first instruction tells the sequences apart */
+    fn_list_t first = cpu_op_group(ops);
+    if (first == ld_a_irr)
+        return _fuse_copy(cpu, ops);
+    if (first == dec_r)
+        return _fuse_dec_jr(cpu, ops);
+    if (first == cp_n)
+        return _fuse_cp_jr(cpu, ops);
+    unreachable();
+}
@@ -8,8 +8,8 @@ _nothing(cpu_t *cpu)
      * basically, */
 }
 
-/* big matrix ahead */
-fn_row_array_ptrs instructions = {
+/* the generic lists. the operands come from the decoded instruction */
+fn_row_array_ptrs instr_groups = {
 /*  0x00         0x01         0x02         0x03         0x04         0x05         0x06         0x07  */
     &nop,        &ld_rr_nn,   &ld_irr_a,   &inc_rr,     &inc_r,      &dec_r,      &ld_r_n,     &rlca,
 /*  0x08         0x09         0x0A         0x0B         0x0C         0x0D         0x0E         0x0F  */
@@ -71,27 +71,27 @@ fn_row_array_ptrs instructions = {
     &cp_r,       &cp_r,       &cp_r,       &cp_r,       &cp_r,       &cp_r,       &cp_ihl,     &cp_r,
 
 /*  0xC0         0xC1         0xC2         0xC3         0xC4         0xC5         0xC6         0xC7  */
-    &ret_cc,     &pop,        &jp_cc_nn,   &jp_nn,      &call_cc_nn, &push,       &add_n,      &rst_n,
+    &ret_cc,     &pop_rr,     &jp_cc_nn,   &jp_nn,      &call_cc_nn, &push_rr,     &add_n,      &rst_n,
 /*  0xC8         0xC9         0xCA         0xCB         0xCC         0xCD         0xCE         0xCF  */
     &ret_cc,     &ret,        &jp_cc_nn,   &prefix,     &call_cc_nn, &call_nn,    &adc_n,      &rst_n,
 
 /*  0xD0         0xD1         0xD2         0xD3         0xD4         0xD5         0xD6         0xD7  */
-    &ret_cc,     &pop,        &jp_cc_nn,   &not_impl,   &call_cc_nn, &push,       &sub_n,      &rst_n,
+    &ret_cc,     &pop_rr,     &jp_cc_nn,   &not_impl,   &call_cc_nn, &push_rr,     &sub_n,      &rst_n,
 /*  0xD8         0xD9         0xDA         0xDB         0xDC         0xDD         0xDE         0xDF  */
     &ret_cc,     &reti,       &jp_cc_nn,   &not_impl,   &call_cc_nn, &not_impl,   &sbc_n,      &rst_n,
 
 /*  0xE0         0xE1         0xE2         0xE3         0xE4         0xE5         0xE6         0xE7  */
-    &ldh_in_a ,  &pop,        &ldh_ic_a,   &not_impl,   &not_impl,   &push,       &and_n,      &rst_n,
+    &ldh_in_a ,  &pop_rr,     &ldh_ic_a,   &not_impl,   &not_impl,   &push_rr,     &and_n,      &rst_n,
 /*  0xE8         0xE9         0xEA         0xEB         0xEC         0xED         0xEE         0xEF  */
     &add_sp_e,   &jp_hl,      &ld_inn_a,   &not_impl,   &not_impl,   &not_impl,   &xor_n,      &rst_n,
 
 /*  0xF0         0xF1         0xF2         0xF3         0xF4         0xF5         0xF6         0xF7  */
-    &ldh_a_in ,  &pop,        &ldh_a_ic,   &di,         &not_impl,   &push,       &or_n,       &rst_n,
+    &ldh_a_in ,  &pop_rr,     &ldh_a_ic,   &di,         &not_impl,   &push_rr,     &or_n,       &rst_n,
 /*  0xF8         0xF9         0xFA         0xFB         0xFC         0xFD         0xFE         0xFF  */
     &ld_hl_spe,  &ld_sp_hl,   &ld_a_inn,   &ei,         &not_impl,   &not_impl,   &cp_n,       &rst_n,
 };
 
-fn_row_array_ptrs cb_instructions = {
+fn_row_array_ptrs cb_instr_groups = {
 /*  0x00         0x01         0x02         0x03         0x04         0x05         0x06         0x07  */
     &rlc_r,      &rlc_r,      &rlc_r,      &rlc_r,      &rlc_r,      &rlc_r,      &rlc_ihl,    &rlc_r,
 /*  0x08         0x09         0x0A         0x0B         0x0C         0x0D         0x0E         0x0F  */
@@ -172,3 +172,168 @@ fn_row_array_ptrs cb_instructions = {
 /*  0xF8         0xF9         0xFA         0xFB         0xFC         0xFD         0xFE         0xFF  */
     &set_b_r,    &set_b_r,    &set_b_r,    &set_b_r,    &set_b_r,    &set_b_r,    &set_b_ihl,  &set_b_r,
 };
+
+/* big matrix ahead. every opcode runs a list of its own */
+fn_row_array_ptrs instructions = {
+/*  0x00         0x01         0x02         0x03         0x04         0x05         0x06         0x07  */
+    &nop,        &ld_bc_nn,   &ld_ibc_a,   &inc_bc,     &inc_b,      &dec_b,      &ld_b_n,     &rlca,
+/*  0x08         0x09         0x0A         0x0B         0x0C         0x0D         0x0E         0x0F  */
+    &ld_inn_sp,  &add_hl_bc,  &ld_a_ibc,   &dec_bc,     &inc_c,      &dec_c,      &ld_c_n,     &rrca,
+
+/*  0x10         0x11         0x12         0x13         0x14         0x15         0x16         0x17  */
+    &stop,       &ld_de_nn,   &ld_ide_a,   &inc_de,     &inc_d,      &dec_d,      &ld_d_n,     &rla,
+/*  0x18         0x19         0x1A         0x1B         0x1C         0x1D         0x1E         0x1F  */
+    &jr_e,       &add_hl_de,  &ld_a_ide,   &dec_de,     &inc_e,      &dec_e,      &ld_e_n,     &rra,
+
+/*  0x20         0x21         0x22         0x23         0x24         0x25         0x26         0x27  */
+    &jr_nz_e,    &ld_hl_nn,   &ld_ihli_a,  &inc_hl,     &inc_h,      &dec_h,      &ld_h_n,     &daa,
+/*  0x28         0x29         0x2A         0x2B         0x2C         0x2D         0x2E         0x2F  */
+    &jr_z_e,     &add_hl_hl,  &ld_a_ihli,  &dec_hl,     &inc_l,      &dec_l,      &ld_l_n,     &cpl,
+
+/*  0x30         0x31         0x32         0x33         0x34         0x35         0x36         0x37  */
+    &jr_nc_e,    &ld_sp_nn,   &ld_ihld_a,  &inc_sp,     &inc_ihl,    &dec_ihl,    &ld_ihl_n,   &scf,
+/*  0x38         0x39         0x3A         0x3B         0x3C         0x3D         0x3E         0x3F  */
+    &jr_c_e,     &add_hl_sp,  &ld_a_ihld,  &dec_sp,     &inc_a,      &dec_a,      &ld_a_n,     &ccf,
+
+/*  0x40         0x41         0x42         0x43         0x44         0x45         0x46         0x47  */
+    &ld_b_b,     &ld_b_c,     &ld_b_d,     &ld_b_e,     &ld_b_h,     &ld_b_l,     &ld_b_ihl,   &ld_b_a,
+/*  0x48         0x49         0x4A         0x4B         0x4C         0x4D         0x4E         0x4F  */
+    &ld_c_b,     &ld_c_c,     &ld_c_d,     &ld_c_e,     &ld_c_h,     &ld_c_l,     &ld_c_ihl,   &ld_c_a,
+
+/*  0x50         0x51         0x52         0x53         0x54         0x55         0x56         0x57  */
+    &ld_d_b,     &ld_d_c,     &ld_d_d,     &ld_d_e,     &ld_d_h,     &ld_d_l,     &ld_d_ihl,   &ld_d_a,
+/*  0x58         0x59         0x5A         0x5B         0x5C         0x5D         0x5E         0x5F  */
+    &ld_e_b,     &ld_e_c,     &ld_e_d,     &ld_e_e,     &ld_e_h,     &ld_e_l,     &ld_e_ihl,   &ld_e_a,
+
+/*  0x60         0x61         0x62         0x63         0x64         0x65         0x66         0x67  */
+    &ld_h_b,     &ld_h_c,     &ld_h_d,     &ld_h_e,     &ld_h_h,     &ld_h_l,     &ld_h_ihl,   &ld_h_a,
+/*  0x68         0x69         0x6A         0x6B         0x6C         0x6D         0x6E         0x6F  */
+    &ld_l_b,     &ld_l_c,     &ld_l_d,     &ld_l_e,     &ld_l_h,     &ld_l_l,     &ld_l_ihl,   &ld_l_a,
+
+/*  0x70         0x71         0x72         0x73         0x74         0x75         0x76         0x77  */
+    &ld_ihl_b,   &ld_ihl_c,   &ld_ihl_d,   &ld_ihl_e,   &ld_ihl_h,   &ld_ihl_l,   &halt,       &ld_ihl_a,
+/*  0x78         0x79         0x7A         0x7B         0x7C         0x7D         0x7E         0x7F  */
+    &ld_a_b,     &ld_a_c,     &ld_a_d,     &ld_a_e,     &ld_a_h,     &ld_a_l,     &ld_a_ihl,   &ld_a_a,
+
+/*  0x80         0x81         0x82         0x83         0x84         0x85         0x86         0x87  */
+    &add_b,      &add_c,      &add_d,      &add_e,      &add_h,      &add_l,      &add_ihl,    &add_a,
+/*  0x88         0x89         0x8A         0x8B         0x8C         0x8D         0x8E         0x8F  */
+    &adc_b,      &adc_c,      &adc_d,      &adc_e,      &adc_h,      &adc_l,      &adc_ihl,    &adc_a,
+
+/*  0x90         0x91         0x92         0x93         0x94         0x95         0x96         0x97  */
+    &sub_b,      &sub_c,      &sub_d,      &sub_e,      &sub_h,      &sub_l,      &sub_ihl,    &sub_a,
+/*  0x98         0x99         0x9A         0x9B         0x9C         0x9D         0x9E         0x9F  */
+    &sbc_b,      &sbc_c,      &sbc_d,      &sbc_e,      &sbc_h,      &sbc_l,      &sbc_ihl,    &sbc_a,
+
+/*  0xA0         0xA1         0xA2         0xA3         0xA4         0xA5         0xA6         0xA7  */
+    &and_b,      &and_c,      &and_d,      &and_e,      &and_h,      &and_l,      &and_ihl,    &and_a,
+/*  0xA8         0xA9         0xAA         0xAB         0xAC         0xAD         0xAE         0xAF  */
+    &xor_b,      &xor_c,      &xor_d,      &xor_e,      &xor_h,      &xor_l,      &xor_ihl,    &xor_a,
+
+/*  0xB0         0xB1         0xB2         0xB3         0xB4         0xB5         0xB6         0xB7  */
+    &or_b,       &or_c,       &or_d,       &or_e,       &or_h,       &or_l,       &or_ihl,     &or_a,
+/*  0xB8         0xB9         0xBA         0xBB         0xBC         0xBD         0xBE         0xBF  */
+    &cp_b,       &cp_c,       &cp_d,       &cp_e,       &cp_h,       &cp_l,       &cp_ihl,     &cp_a,
+
+/*  0xC0         0xC1         0xC2         0xC3         0xC4         0xC5         0xC6         0xC7  */
+    &ret_nz,     &pop_bc,     &jp_nz_nn,   &jp_nn,      &call_nz_nn, &push_bc,    &add_n,      &rst_00,
+/*  0xC8         0xC9         0xCA         0xCB         0xCC         0xCD         0xCE         0xCF  */
+    &ret_z,      &ret,        &jp_z_nn,    &prefix,     &call_z_nn,  &call_nn,    &adc_n,      &rst_08,
+
+/*  0xD0         0xD1         0xD2         0xD3         0xD4         0xD5         0xD6         0xD7  */
+    &ret_nc,     &pop_de,     &jp_nc_nn,   &not_impl,   &call_nc_nn, &push_de,    &sub_n,      &rst_10,
+/*  0xD8         0xD9         0xDA         0xDB         0xDC         0xDD         0xDE         0xDF  */
+    &ret_c,      &reti,       &jp_c_nn,    &not_impl,   &call_c_nn,  &not_impl,   &sbc_n,      &rst_18,
+
+/*  0xE0         0xE1         0xE2         0xE3         0xE4         0xE5         0xE6         0xE7  */
+    &ldh_in_a,   &pop_hl,     &ldh_ic_a,   &not_impl,   &not_impl,   &push_hl,    &and_n,      &rst_20,
+/*  0xE8         0xE9         0xEA         0xEB         0xEC         0xED         0xEE         0xEF  */
+    &add_sp_e,   &jp_hl,      &ld_inn_a,   &not_impl,   &not_impl,   &not_impl,   &xor_n,      &rst_28,
+
+/*  0xF0         0xF1         0xF2         0xF3         0xF4         0xF5         0xF6         0xF7  */
+    &ldh_a_in,   &pop_af,     &ldh_a_ic,   &di,         &not_impl,   &push_af,    &or_n,       &rst_30,
+/*  0xF8         0xF9         0xFA         0xFB         0xFC         0xFD         0xFE         0xFF  */
+    &ld_hl_spe,  &ld_sp_hl,   &ld_a_inn,   &ei,         &not_impl,   &not_impl,   &cp_n,       &rst_38,
+};
+
+fn_row_array_ptrs cb_instructions = {
+/*  0x00         0x01         0x02         0x03         0x04         0x05         0x06         0x07  */
+    &rlc_b,      &rlc_c,      &rlc_d,      &rlc_e,      &rlc_h,      &rlc_l,      &rlc_ihl,    &rlc_a,
+/*  0x08         0x09         0x0A         0x0B         0x0C         0x0D         0x0E         0x0F  */
+    &rrc_b,      &rrc_c,      &rrc_d,      &rrc_e,      &rrc_h,      &rrc_l,      &rrc_ihl,    &rrc_a,
+
+/*  0x10         0x11         0x12         0x13         0x14         0x15         0x16         0x17  */
+    &rl_b,       &rl_c,       &rl_d,       &rl_e,       &rl_h,       &rl_l,       &rl_ihl,     &rl_a,
+/*  0x18         0x19         0x1A         0x1B         0x1C         0x1D         0x1E         0x1F  */
+    &rr_b,       &rr_c,       &rr_d,       &rr_e,       &rr_h,       &rr_l,       &rr_ihl,     &rr_a,
+
+/*  0x20         0x21         0x22         0x23         0x24         0x25         0x26         0x27  */
+    &sla_b,      &sla_c,      &sla_d,      &sla_e,      &sla_h,      &sla_l,      &sla_ihl,    &sla_a,
+/*  0x28         0x29         0x2A         0x2B         0x2C         0x2D         0x2E         0x2F  */
+    &sra_b,      &sra_c,      &sra_d,      &sra_e,      &sra_h,      &sra_l,      &sra_ihl,    &sra_a,
+
+/*  0x30         0x31         0x32         0x33         0x34         0x35         0x36         0x37  */
+    &swap_b,     &swap_c,     &swap_d,     &swap_e,     &swap_h,     &swap_l,     &swap_ihl,   &swap_a,
+/*  0x38         0x39         0x3A         0x3B         0x3C         0x3D         0x3E         0x3F  */
+    &srl_b,      &srl_c,      &srl_d,      &srl_e,      &srl_h,      &srl_l,      &srl_ihl,    &srl_a,
+
+/*  0x40         0x41         0x42         0x43         0x44         0x45         0x46         0x47  */
+    &bit_0_b,    &bit_0_c,    &bit_0_d,    &bit_0_e,    &bit_0_h,    &bit_0_l,    &bit_0_ihl,  &bit_0_a,
+/*  0x48         0x49         0x4A         0x4B         0x4C         0x4D         0x4E         0x4F  */
+    &bit_1_b,    &bit_1_c,    &bit_1_d,    &bit_1_e,    &bit_1_h,    &bit_1_l,    &bit_1_ihl,  &bit_1_a,
+
+/*  0x50         0x51         0x52         0x53         0x54         0x55         0x56         0x57  */
+    &bit_2_b,    &bit_2_c,    &bit_2_d,    &bit_2_e,    &bit_2_h,    &bit_2_l,    &bit_2_ihl,  &bit_2_a,
+/*  0x58         0x59         0x5A         0x5B         0x5C         0x5D         0x5E         0x5F  */
+    &bit_3_b,    &bit_3_c,    &bit_3_d,    &bit_3_e,    &bit_3_h,    &bit_3_l,    &bit_3_ihl,  &bit_3_a,
+
+/*  0x60         0x61         0x62         0x63         0x64         0x65         0x66         0x67  */
+    &bit_4_b,    &bit_4_c,    &bit_4_d,    &bit_4_e,    &bit_4_h,    &bit_4_l,    &bit_4_ihl,  &bit_4_a,
+/*  0x68         0x69         0x6A         0x6B         0x6C         0x6D         0x6E         0x6F  */
+    &bit_5_b,    &bit_5_c,    &bit_5_d,    &bit_5_e,    &bit_5_h,    &bit_5_l,    &bit_5_ihl,  &bit_5_a,
+
+/*  0x70         0x71         0x72         0x73         0x74         0x75         0x76         0x77  */
+    &bit_6_b,    &bit_6_c,    &bit_6_d,    &bit_6_e,    &bit_6_h,    &bit_6_l,    &bit_6_ihl,  &bit_6_a,
+/*  0x78         0x79         0x7A         0x7B         0x7C         0x7D         0x7E         0x7F  */
+    &bit_7_b,    &bit_7_c,    &bit_7_d,    &bit_7_e,    &bit_7_h,    &bit_7_l,    &bit_7_ihl,  &bit_7_a,
+
+/*  0x80         0x81         0x82         0x83         0x84         0x85         0x86         0x87  */
+    &res_0_b,    &res_0_c,    &res_0_d,    &res_0_e,    &res_0_h,    &res_0_l,    &res_0_ihl,  &res_0_a,
+/*  0x88         0x89         0x8A         0x8B         0x8C         0x8D         0x8E         0x8F  */
+    &res_1_b,    &res_1_c,    &res_1_d,    &res_1_e,    &res_1_h,    &res_1_l,    &res_1_ihl,  &res_1_a,
+
+/*  0x90         0x91         0x92         0x93         0x94         0x95         0x96         0x97  */
+    &res_2_b,    &res_2_c,    &res_2_d,    &res_2_e,    &res_2_h,    &res_2_l,    &res_2_ihl,  &res_2_a,
+/*  0x98         0x99         0x9A         0x9B         0x9C         0x9D         0x9E         0x9F  */
+    &res_3_b,    &res_3_c,    &res_3_d,    &res_3_e,    &res_3_h,    &res_3_l,    &res_3_ihl,  &res_3_a,
+
+/*  0xA0         0xA1         0xA2         0xA3         0xA4         0xA5         0xA6         0xA7  */
+    &res_4_b,    &res_4_c,    &res_4_d,    &res_4_e,    &res_4_h,    &res_4_l,    &res_4_ihl,  &res_4_a,
+/*  0xA8         0xA9         0xAA         0xAB         0xAC         0xAD         0xAE         0xAF  */
+    &res_5_b,    &res_5_c,    &res_5_d,    &res_5_e,    &res_5_h,    &res_5_l,    &res_5_ihl,  &res_5_a,
+
+/*  0xB0         0xB1         0xB2         0xB3         0xB4         0xB5         0xB6         0xB7  */
+    &res_6_b,    &res_6_c,    &res_6_d,    &res_6_e,    &res_6_h,    &res_6_l,    &res_6_ihl,  &res_6_a,
+/*  0xB8         0xB9         0xBA         0xBB         0xBC         0xBD         0xBE         0xBF  */
+    &res_7_b,    &res_7_c,    &res_7_d,    &res_7_e,    &res_7_h,    &res_7_l,    &res_7_ihl,  &res_7_a,
+
+/*  0xC0         0xC1         0xC2         0xC3         0xC4         0xC5         0xC6         0xC7  */
+    &set_0_b,    &set_0_c,    &set_0_d,    &set_0_e,    &set_0_h,    &set_0_l,    &set_0_ihl,  &set_0_a,
+/*  0xC8         0xC9         0xCA         0xCB         0xCC         0xCD         0xCE         0xCF  */
+    &set_1_b,    &set_1_c,    &set_1_d,    &set_1_e,    &set_1_h,    &set_1_l,    &set_1_ihl,  &set_1_a,
+
+/*  0xD0         0xD1         0xD2         0xD3         0xD4         0xD5         0xD6         0xD7  */
+    &set_2_b,    &set_2_c,    &set_2_d,    &set_2_e,    &set_2_h,    &set_2_l,    &set_2_ihl,  &set_2_a,
+/*  0xD8         0xD9         0xDA         0xDB         0xDC         0xDD         0xDE         0xDF  */
+    &set_3_b,    &set_3_c,    &set_3_d,    &set_3_e,    &set_3_h,    &set_3_l,    &set_3_ihl,  &set_3_a,
+
+/*  0xE0         0xE1         0xE2         0xE3         0xE4         0xE5         0xE6         0xE7  */
+    &set_4_b,    &set_4_c,    &set_4_d,    &set_4_e,    &set_4_h,    &set_4_l,    &set_4_ihl,  &set_4_a,
+/*  0xE8         0xE9         0xEA         0xEB         0xEC         0xED         0xEE         0xEF  */
+    &set_5_b,    &set_5_c,    &set_5_d,    &set_5_e,    &set_5_h,    &set_5_l,    &set_5_ihl,  &set_5_a,
+
+/*  0xF0         0xF1         0xF2         0xF3         0xF4         0xF5         0xF6         0xF7  */
+    &set_6_b,    &set_6_c,    &set_6_d,    &set_6_e,    &set_6_h,    &set_6_l,    &set_6_ihl,  &set_6_a,
+/*  0xF8         0xF9         0xFA         0xFB         0xFC         0xFD         0xFE         0xFF  */
+    &set_7_b,    &set_7_c,    &set_7_d,    &set_7_e,    &set_7_h,    &set_7_l,    &set_7_ihl,  &set_7_a,
+};
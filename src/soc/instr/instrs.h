@@ -3,9 +3,163 @@
 
 #include "soc/soc.h"
 
+/* every opcode has a list of its own with its operands built in, so that
+ * running it doesn't go through the decoded instruction (see instrs.c). the
+ * lists are stamped out from the tables below, as X(name, string, operand,
+ * ...). instantiated with the operands of cpu->op instead, the same macros give
+ * the generic lists of each group */
+
+/* 8-bit registers in bits 0-2 and 3-5. (HL) has lists of its own */
+#define INSTR_R(X, ...) \
+    X(b, "B", cpu->bc.hi, __VA_ARGS__) \
+    X(c, "C", cpu->bc.lo, __VA_ARGS__) \
+    X(d, "D", cpu->de.hi, __VA_ARGS__) \
+    X(e, "E", cpu->de.lo, __VA_ARGS__) \
+    X(h, "H", cpu->hl.hi, __VA_ARGS__) \
+    X(l, "L", cpu->hl.lo, __VA_ARGS__) \
+    X(a, "A", cpu->af.hi, __VA_ARGS__)
+
+/* the same, for use inside INSTR_R() */
+#define INSTR_R2(X, ...) \
+    X(b, "B", cpu->bc.hi, __VA_ARGS__) \
+    X(c, "C", cpu->bc.lo, __VA_ARGS__) \
+    X(d, "D", cpu->de.hi, __VA_ARGS__) \
+    X(e, "E", cpu->de.lo, __VA_ARGS__) \
+    X(h, "H", cpu->hl.hi, __VA_ARGS__) \
+    X(l, "L", cpu->hl.lo, __VA_ARGS__) \
+    X(a, "A", cpu->af.hi, __VA_ARGS__)
+
+/* 16-bit registers in bits 4-5 */
+#define INSTR_RR(X, ...) \
+    X(bc, "BC", cpu->bc, __VA_ARGS__) \
+    X(de, "DE", cpu->de, __VA_ARGS__) \
+    X(hl, "HL", cpu->hl, __VA_ARGS__) \
+    X(sp, "SP", cpu->sp, __VA_ARGS__)
+
+/* PUSH and POP have AF in place of SP */
+#define INSTR_RR_STACK(X, ...) \
+    X(bc, "BC", cpu->bc, __VA_ARGS__) \
+    X(de, "DE", cpu->de, __VA_ARGS__) \
+    X(hl, "HL", cpu->hl, __VA_ARGS__) \
+    X(af, "AF", cpu->af, __VA_ARGS__)
+
+/* LD (rr), A and LD A, (rr) step HL after the access */
+#define INSTR_IRR(X, ...) \
+    X(bc, "BC", cpu->bc, 0, __VA_ARGS__) \
+    X(de, "DE", cpu->de, 0, __VA_ARGS__) \
+    X(hli, "HL+", cpu->hl, 1, __VA_ARGS__) \
+    X(hld, "HL-", cpu->hl, -1, __VA_ARGS__)
+
+/* conditions in bits 3-4 */
+#define INSTR_CC(X, ...) \
+    X(nz, "NZ", 0, __VA_ARGS__) \
+    X(z, "Z", 1, __VA_ARGS__) \
+    X(nc, "NC", 2, __VA_ARGS__) \
+    X(c, "C", 3, __VA_ARGS__)
+
+/* bit numbers in bits 3-5 */
+#define INSTR_BIT(X, ...) \
+    X(0, "0", 0, __VA_ARGS__) \
+    X(1, "1", 1, __VA_ARGS__) \
+    X(2, "2", 2, __VA_ARGS__) \
+    X(3, "3", 3, __VA_ARGS__) \
+    X(4, "4", 4, __VA_ARGS__) \
+    X(5, "5", 5, __VA_ARGS__) \
+    X(6, "6", 6, __VA_ARGS__) \
+    X(7, "7", 7, __VA_ARGS__)
+
+/* RST vectors in bits 3-5 */
+#define INSTR_RST(X, ...) \
+    X(00, "00H", 0x00, __VA_ARGS__) \
+    X(08, "08H", 0x08, __VA_ARGS__) \
+    X(10, "10H", 0x10, __VA_ARGS__) \
+    X(18, "18H", 0x18, __VA_ARGS__) \
+    X(20, "20H", 0x20, __VA_ARGS__) \
+    X(28, "28H", 0x28, __VA_ARGS__) \
+    X(30, "30H", 0x30, __VA_ARGS__) \
+    X(38, "38H", 0x38, __VA_ARGS__)
+
+/* declare the lists named pre##x##post */
+#define _INSTR_DECLARE(x, str, operand, pre, post) \
+    extern fn_row_array pre##x##post;
+#define _INSTR_DECLARE_IRR(x, str, operand, step, pre, post) \
+    extern fn_row_array pre##x##post;
+#define _INSTR_DECLARE_LD_R(x, str, operand, unused) \
+    INSTR_R2(_INSTR_DECLARE, ld_##x##_, )
+#define _INSTR_DECLARE_B_R(x, str, operand, pre) \
+    INSTR_R(_INSTR_DECLARE, pre##x##_, ) \
+    extern fn_row_array pre##x##_ihl;
+
 /* a function that does nothing */
 void _nothing(cpu_t *cpu);
 
+/* decode.c */
+void cpu_decode(cpu_op_t *op, uint8_t ir);
+void cpu_decode_cb(cpu_op_t *op, uint8_t ir);
+unsigned cpu_instr_len(uint8_t ir);
+bool cpu_instr_ends_block(uint8_t ir);
+
+/* fuse.c */
+void cpu_fuse(cpu_op_t *ops, unsigned len);
+unsigned cpu_run_fused(cpu_t *cpu, const cpu_op_t *ops);
+
+/* what an instruction turns into in native code. the JIT and gbemu-aot only
+ * differ in how they emit it (see translate.c) */
+enum xlat_kind {
+    XLAT_NOP,           /* NOP */
+    XLAT_LD_R_R,        /* LD r, r' */
+    XLAT_LD_R_N,        /* LD r, imm8 */
+    XLAT_LD_R_IHL,      /* LD r, (HL) */
+    XLAT_LD_IHL_R,      /* LD (HL), r */
+    XLAT_LD_IHL_N,      /* LD (HL), imm8 */
+    XLAT_LD_A_IRR,      /* LD A, (rr), then HL moves by step */
+    XLAT_LD_IRR_A,      /* LD (rr), A, then HL moves by step */
+    XLAT_LD_A_ADDR,     /* LDH A, (imm8) and LD A, (imm16), from addr */
+    XLAT_LD_ADDR_A,     /* LDH (imm8), A and LD (imm16), A, to addr */
+    XLAT_LD_RR_NN,      /* LD rr, imm16 */
+    XLAT_LD_SP_HL,      /* LD SP, HL */
+    XLAT_PUSH,          /* PUSH rr */
+    XLAT_POP,           /* POP rr */
+    XLAT_ADD_RR,        /* INC rr and DEC rr, by step */
+    XLAT_HANDLERS,      /* the micro-ops of list, from first on */
+    XLAT_HANDLERS_N,    /* the same, with imm8 in Z */
+    XLAT_HANDLERS_IHL,  /* the same, with (HL) in Z */
+    XLAT_RMW_IHL,       /* (HL) through the micro-op at list[first] */
+
+    /* the ones below leave the block */
+    XLAT_JUMP,          /* JR and JP (imm16), to addr */
+    XLAT_JUMP_HL,       /* JP HL */
+    XLAT_CALL,          /* CALL and RST, to addr */
+    XLAT_RET            /* RET */
+};
+
+typedef struct xlat {
+    enum xlat_kind kind;
+
+    /* the micro-ops the handler kinds run */
+    fn_list_t list;
+    unsigned first;
+
+    /* the machine cycles it takes (the longest path) and the ones it takes
+     * if the condition fails */
+    unsigned mcycles, skip_mcycles;
+
+    /* the condition (see OP_CC()), -1 if there's none */
+    int cc;
+
+    /* the address it accesses or jumps to, the one after it and how much HL
+     * or rr move */
+    uint16_t addr, next;
+    int step;
+
+    /* whether the block is left */
+    bool ends;
+} xlat_t;
+
+/* translate.c. false if the instruction is left to the interpreter */
+bool cpu_translate(const cpu_op_t *op, uint16_t pc, uint8_t n, uint16_t nn,
+        xlat_t *xlat);
+
 /* ld.c */
 extern fn_row_array ld_r_r;     /* LD r, r' */
 extern fn_row_array ld_ihl_r;   /* LD (HL), r */
@@ -22,8 +176,8 @@ extern fn_row_array ld_inn_a;   /* LD (imm16), A */
 extern fn_row_array ld_a_inn;   /* LD A, (imm16) */
 extern fn_row_array ld_rr_nn;   /* LD rr, imm16 */
 extern fn_row_array ld_inn_sp;  /* LD (imm16), SP */
-extern fn_row_array push;       /* PUSH */
-extern fn_row_array pop;        /* POP */
+extern fn_row_array push_rr;    /* PUSH rr */
+extern fn_row_array pop_rr;     /* POP rr */
 extern fn_row_array ld_sp_hl;   /* LD SP, HL */
 extern fn_row_array ld_hl_spe;  /* LD HL, SP+smm8 */
 
@@ -118,10 +272,143 @@ extern fn_row_array set_b_ihl;  /* SET b, (HL) */
 /* isr.c */
 extern fn_row_array isr;        /* Interrupt Service Routine */
 
-/* main instructions array */
+/* the lists of each opcode */
+INSTR_R(_INSTR_DECLARE_LD_R, )
+INSTR_R(_INSTR_DECLARE, ld_ihl_, )
+INSTR_R(_INSTR_DECLARE, ld_, _ihl)
+INSTR_R(_INSTR_DECLARE, ld_, _n)
+INSTR_IRR(_INSTR_DECLARE_IRR, ld_i, _a)
+INSTR_IRR(_INSTR_DECLARE_IRR, ld_a_i, )
+INSTR_RR(_INSTR_DECLARE, ld_, _nn)
+INSTR_RR_STACK(_INSTR_DECLARE, push_, )
+INSTR_RR_STACK(_INSTR_DECLARE, pop_, )
+INSTR_R(_INSTR_DECLARE, add_, )
+INSTR_R(_INSTR_DECLARE, adc_, )
+INSTR_R(_INSTR_DECLARE, sub_, )
+INSTR_R(_INSTR_DECLARE, sbc_, )
+INSTR_R(_INSTR_DECLARE, cp_, )
+INSTR_R(_INSTR_DECLARE, and_, )
+INSTR_R(_INSTR_DECLARE, or_, )
+INSTR_R(_INSTR_DECLARE, xor_, )
+INSTR_R(_INSTR_DECLARE, inc_, )
+INSTR_R(_INSTR_DECLARE, dec_, )
+INSTR_RR(_INSTR_DECLARE, inc_, )
+INSTR_RR(_INSTR_DECLARE, dec_, )
+INSTR_RR(_INSTR_DECLARE, add_hl_, )
+INSTR_CC(_INSTR_DECLARE, jp_, _nn)
+INSTR_CC(_INSTR_DECLARE, jr_, _e)
+INSTR_CC(_INSTR_DECLARE, call_, _nn)
+INSTR_CC(_INSTR_DECLARE, ret_, )
+INSTR_RST(_INSTR_DECLARE, rst_, )
+INSTR_R(_INSTR_DECLARE, rlc_, )
+INSTR_R(_INSTR_DECLARE, rrc_, )
+INSTR_R(_INSTR_DECLARE, rl_, )
+INSTR_R(_INSTR_DECLARE, rr_, )
+INSTR_R(_INSTR_DECLARE, sla_, )
+INSTR_R(_INSTR_DECLARE, sra_, )
+INSTR_R(_INSTR_DECLARE, swap_, )
+INSTR_R(_INSTR_DECLARE, srl_, )
+INSTR_BIT(_INSTR_DECLARE_B_R, bit_)
+INSTR_BIT(_INSTR_DECLARE_B_R, res_)
+INSTR_BIT(_INSTR_DECLARE_B_R, set_)
+
+/* main instructions array, one list per opcode */
 extern fn_row_array_ptrs instructions;
 
 /* CB instructions array */
 extern fn_row_array_ptrs cb_instructions;
 
+/* the generic list of each opcode's group. they tell instructions apart */
+extern fn_row_array_ptrs instr_groups;
+extern fn_row_array_ptrs cb_instr_groups;
+
+/* the lists of a decoded instruction: its own and its group's, and the same
+ * for the second byte of a CB instruction */
+static inline fn_list_t
+cpu_op_list(const cpu_op_t *op)
+{
+    return *instructions[op->ir];
+}
+
+static inline fn_list_t
+cpu_op_group(const cpu_op_t *op)
+{
+    return *instr_groups[op->ir];
+}
+
+static inline fn_list_t
+cpu_op_cb_list(const cpu_op_t *op)
+{
+    return *cb_instructions[op->cb_ir];
+}
+
+static inline fn_list_t
+cpu_op_cb_group(const cpu_op_t *op)
+{
+    return *cb_instr_groups[op->cb_ir];
+}
+
+/* the 8-bit register in 3 bits of the opcode. (HL) has none */
+static inline uint8_t *
+cpu_op_r(cpu_t *cpu, uint8_t val)
+{
+    assert(val <= 7);
+    switch (val) {
+        case 0x00:
+            return &cpu->bc.hi;
+        case 0x01:
+            return &cpu->bc.lo;
+        case 0x02:
+            return &cpu->de.hi;
+        case 0x03:
+            return &cpu->de.lo;
+        case 0x04:
+            return &cpu->hl.hi;
+        case 0x05:
+            return &cpu->hl.lo;
+        case 0x06:
+            return NULL;
+        case 0x07:
+            return &cpu->af.hi;
+        default:
+            unreachable();
+    }
+}
+
+/* the 16-bit register in bits 4-5 of the opcode */
+static inline reg_t *
+cpu_op_rr(cpu_t *cpu, uint8_t ir)
+{
+    /* the meaning of the two bits depends on the instruction group */
+    switch ((ir & 0x30) >> 4) {
+        case 0x00:
+            return &cpu->bc;
+        case 0x01:
+            return &cpu->de;
+        case 0x02:
+            return &cpu->hl;
+        case 0x03:
+            /* PUSH and POP use AF */
+            if ((ir & 0xCB) == 0xC1)
+                return &cpu->af;
+
+            /* LD (HL-), A and LD A, (HL-) use HL */
+            if (ir < 0x40 && (ir & 0x07) == 0x02)
+                return &cpu->hl;
+
+            /* everything else uses SP */
+            return &cpu->sp;
+        default:
+            unreachable();
+    }
+}
+
+/* the operands of the generic lists, from the opcode or the second byte of a
+ * CB instruction */
+#define OP_SRC(ir)      (*cpu_op_r(cpu, (ir) & 0x07))
+#define OP_DST(ir)      (*cpu_op_r(cpu, ((ir) & 0x38) >> 3))
+#define OP_RR(ir)       (*cpu_op_rr(cpu, (ir)))
+#define OP_N(ir)        (((ir) & 0x38) >> 3)
+#define OP_CC(ir)       (((ir) & 0x18) >> 3)
+
 #endif /* __INSTRS_H */
@@ -2,101 +2,20 @@
 #include "soc/instr/instrs.h"
 #include "types.h"
 
-static inline uint8_t *
-_ld8_get_r(cpu_t *cpu, uint8_t val)
+static inline int
+_hl_step(cpu_t *cpu)
 {
-    /* based on value, choose a register */
-    assert(val <= 7 && val != 6);
-    switch (val) {
-        case 0x00:
-            return &cpu->bc.hi;
-        case 0x01:
-            return &cpu->bc.lo;
-        case 0x02:
-            return &cpu->de.hi;
-        case 0x03:
-            return &cpu->de.lo;
-        case 0x04:
-            return &cpu->hl.hi;
-        case 0x05:
-            return &cpu->hl.lo;
-        case 0x07:
-            return &cpu->af.hi;
-        default:
-            unreachable();
-    }
-}
-
-static inline reg_t *
-_ld8_get_rr(cpu_t *cpu, uint8_t val)
-{
-    assert(val <= 3);
-    switch (val) {
-        case 0x00:
-            return &cpu->bc;
-        case 0x01:
-            return &cpu->de;
-        case 0x02:
-        case 0x03:
-            return &cpu->hl;
-        default:
-            unreachable();
-    }
-}
-
-static inline reg_t *
-_ld16_get_rr(cpu_t *cpu, uint8_t val)
-{
-    assert(val <= 3);
-    switch (val) {
-        case 0x00:
-            return &cpu->bc;
-        case 0x01:
-            return &cpu->de;
-        case 0x02:
-            return &cpu->hl;
-        case 0x03:
-            return &cpu->sp;
-        default:
-            unreachable();
-    }
-}
-
-static inline reg_t *
-_push_pop_get_rr(cpu_t *cpu, uint8_t val)
-{
-    assert(val <= 3);
-    switch (val) {
-        case 0x00:
-            return &cpu->bc;
-        case 0x01:
-            return &cpu->de;
+    /* HL+ and HL- move HL after the access, the others leave it */
+    switch ((cpu->ir & 0x30) >> 4) {
         case 0x02:
-            return &cpu->hl;
+            return 1;
         case 0x03:
-            return &cpu->af;
+            return -1;
         default:
-            unreachable();
+            return 0;
     }
 }
 
-static void
-_ld_r_r(cpu_t *cpu)
-{
-    /* get the two registers and move them */
-    uint8_t *src = _ld8_get_r(cpu, cpu->ir & 0x07);
-    uint8_t *dst = _ld8_get_r(cpu, (cpu->ir & 0x38) >> 3);
-    *dst = *src;
-}
-
-static void
-_ld_ihl_r_write_mem(cpu_t *cpu)
-{
-    /* get src reg and write it to mem */
-    uint8_t *src = _ld8_get_r(cpu, cpu->ir & 0x07);
-    _cpu_write_byte(cpu, cpu->hl.val, *src);
-}
-
 static void
 _read_ihl_to_z(cpu_t *cpu)
 {
@@ -104,54 +23,6 @@ _read_ihl_to_z(cpu_t *cpu)
     _cpu_read_byte(cpu, &cpu->wz.lo, cpu->hl.val);
 }
 
-static void
-_ld_r_ihl_set_mem(cpu_t *cpu)
-{
-    /* set the read memory from Z to register */
-    uint8_t *dst = _ld8_get_r(cpu, (cpu->ir & 0x38) >> 3);
-    *dst = cpu->wz.lo;
-}
-
-static void
-_ld_irr_a(cpu_t *cpu)
-{
-    /* get the dst and write mem into it */
-    reg_t *dst = _ld8_get_rr(cpu, (cpu->ir & 0x30) >> 4);
-    _cpu_write_byte(cpu, dst->val, cpu->af.hi);
-
-    /* increment or decrement HL if we need to */
-    switch ((cpu->ir & 0x30) >> 4) {
-        case 0x02:
-            _idu_write(cpu, (cpu->hl.val)++);
-            break;
-        case 0x03:
-            _idu_write(cpu, cpu->hl.val--);
-            break;
-        default:
-            break;
-    }
-}
-
-static void
-_ld_a_irr(cpu_t *cpu)
-{
-    /* get the src and read mem into it */
-    reg_t *src = _ld8_get_rr(cpu, (cpu->ir & 0x30) >> 4);
-    _cpu_read_byte(cpu, &cpu->af.hi, src->val);
-
-    /* increment or decrement HL if we need to */
-    switch ((cpu->ir & 0x30) >> 4) {
-        case 0x02:
-            _idu_write(cpu, cpu->hl.val++);
-            break;
-        case 0x03:
-            _idu_write(cpu, cpu->hl.val--);
-            break;
-        default:
-            break;
-    }
-}
-
 static void
 _read_imm8_into_z(cpu_t *cpu)
 {
@@ -180,14 +51,6 @@ _read_iwz_into_z(cpu_t *cpu)
     _cpu_read_byte(cpu, &cpu->wz.lo, cpu->wz.val);
 }
 
-static void
-_ld_r_n_set_imm(cpu_t *cpu)
-{
-    /* set the immediate */
-    uint8_t *dst = _ld8_get_r(cpu, (cpu->ir & 0x38) >> 3);
-    *dst = cpu->wz.lo;
-}
-
 static void
 _write_z_to_ihl(cpu_t *cpu)
 {
@@ -230,14 +93,6 @@ _read_hiz_into_z(cpu_t *cpu)
     _cpu_read_byte(cpu, &cpu->wz.lo, 0xFF00 + cpu->wz.lo);
 }
 
-static void
-_ld_rr_nn(cpu_t *cpu)
-{
-    /* put WZ into one of the dst registers */
-    reg_t *dst = _ld16_get_rr(cpu, (cpu->ir & 0x30) >> 4);
-    dst->val = cpu->wz.val;
-}
-
 static void
 _write_p_to_iwz_inc(cpu_t *cpu)
 {
@@ -259,23 +114,6 @@ _dec_sp(cpu_t *cpu)
     _idu_write(cpu, cpu->sp.val--);
 }
 
-static void
-_push_hi(cpu_t *cpu)
-{
-    /* write hi reg to mem and dec SP again */
-    reg_t *reg = _push_pop_get_rr(cpu, (cpu->ir & 0x30) >> 4);
-    _cpu_write_byte(cpu, cpu->sp.val, reg->hi);
-    _idu_write(cpu, cpu->sp.val--);
-}
-
-static void
-_push_lo(cpu_t *cpu)
-{
-    /* just write lo reg to mem */
-    reg_t *reg = _push_pop_get_rr(cpu, (cpu->ir & 0x30) >> 4);
-    _cpu_write_byte(cpu, cpu->sp.val, reg->lo);
-}
-
 static void
 _pop_lo_into_z(cpu_t *cpu)
 {
@@ -292,19 +130,6 @@ _pop_hi_into_w(cpu_t *cpu)
     _idu_write(cpu, cpu->sp.val++);
 }
 
-static void
-_pop(cpu_t *cpu)
-{
-    /* write WZ into reg */
-    reg_t *reg = _push_pop_get_rr(cpu, (cpu->ir & 0x30) >> 4);
-    reg->val = cpu->wz.val;
-
-    /* this is kinda hacky but the concept is the same. when popping the AF
-     * register, we should only change the flag bits of the F register, and NOT
-     * the whole 8 bits. doing this will suffice: */
-    cpu->af.lo &= 0xF0;
-}
-
 static void
 _write_hl_to_sp(cpu_t *cpu)
 {
@@ -322,20 +147,9 @@ _write_adjusted_pe_to_l(cpu_t *cpu)
     /* write adjusted P (low SP) to L (SPL + Z) */
     cpu->hl.lo = cpu->sp.lo + cpu->wz.lo;
 
-    /* set flags */
-    if (((cpu->sp.lo & 0xf) + (cpu->wz.lo & 0xf)) & 0x10)
-        SET_HALF();
-    else
-        UNSET_HALF();
-
-    if (((cpu->sp.lo & 0xff) + (cpu->wz.lo & 0xff)) & 0x100)
-        SET_CARRY();
-    else
-        UNSET_CARRY();
-
-    /* reset these two */
-    UNSET_SUB();
-    UNSET_ZERO();
+    /* set flags, zero and sub are reset */
+    uint8_t half = (((cpu->sp.lo & 0xf) + (cpu->wz.lo & 0xf)) & 0x10) << 1;
+    _cpu_flags_nh(cpu, 1, half, ((cpu->sp.lo + cpu->wz.lo) & 0x100) >> 8);
 }
 
 static void
@@ -353,45 +167,106 @@ _write_adjusted_se_to_h(cpu_t *cpu)
 }
 
 /* 01xxxyyy - LD r, r */
-fn_row_array ld_r_r = {
-    { "LD r, r [M2]",           _ld_r_r },
-    { NULL,                     NULL },
-};
+#define _LD_R_R(s, sname, src, d, dname, dst) \
+    static void \
+    _ld_##d##_##s(cpu_t *cpu) \
+    { \
+        /* move the register */ \
+        (dst) = (src); \
+    } \
+    \
+    fn_row_array ld_##d##_##s = { \
+        { "LD " dname ", " sname " [M2]", _ld_##d##_##s }, \
+        { NULL,                     NULL }, \
+    };
+#define _LD_R_R_ROW(d, dname, dst, unused) \
+    INSTR_R2(_LD_R_R, d, dname, dst)
+
+INSTR_R(_LD_R_R_ROW, )
+_LD_R_R(r, "r", OP_SRC(cpu->op->ir), r, "r", OP_DST(cpu->op->ir))
 
 /* 01110yyy - LD (HL), r */
-fn_row_array ld_ihl_r = {
-    { "LD (HL), r [M2]",        _ld_ihl_r_write_mem },
-    { "LD (HL), r [M3]",        _nothing },
-    { NULL,                     NULL },
-};
-
-/* 01xxx110 - LD r, (HL) */
-fn_row_array ld_r_ihl = {
-    { "LD r, (HL) [M2]",        _read_ihl_to_z },
-    { "LD r, (HL) [M3]",        _ld_r_ihl_set_mem },
-    { NULL,                     NULL },
-};
-
-/* 00xx0010 - LD (rr), A */
-fn_row_array ld_irr_a = {
-    { "LD (rr), A [M2]",        _ld_irr_a },
-    { "LD (rr), A [M3]",        _nothing },
-    { NULL,                     NULL },
-};
-
-/* 00xx1010 - LD A, (rr) */
-fn_row_array ld_a_irr = {
-    { "LD A, (rr) [M2]",        _ld_a_irr },
-    { "LD A, (rr) [M3]",        _nothing },
-    { NULL,                     NULL },
-};
-
-/* 00xxx110 - LD r, imm8 */
-fn_row_array ld_r_n = {
-    { "LD r, imm8 [M2]",        _read_imm8_into_z },
-    { "LD r, imm8 [M3]",        _ld_r_n_set_imm },
-    { NULL,                     NULL }
-};
+#define _LD_IHL_R(r, name, src, unused) \
+    static void \
+    _ld_ihl_##r##_write_mem(cpu_t *cpu) \
+    { \
+        /* write the register to mem */ \
+        _cpu_write_byte(cpu, cpu->hl.val, (src)); \
+    } \
+    \
+    fn_row_array ld_ihl_##r = { \
+        { "LD (HL), " name " [M2]", _ld_ihl_##r##_write_mem }, \
+        { "LD (HL), " name " [M3]", _nothing }, \
+        { NULL,                     NULL }, \
+    };
+
+INSTR_R(_LD_IHL_R, )
+_LD_IHL_R(r, "r", OP_SRC(cpu->op->ir), )
+
+/* 01xxx110 - LD r, (HL) and 00xxx110 - LD r, imm8. both end up in Z */
+#define _LD_R_Z(r, name, dst, unused) \
+    static void \
+    _ld_##r##_z(cpu_t *cpu) \
+    { \
+        /* set the register from Z */ \
+        (dst) = cpu->wz.lo; \
+    } \
+    \
+    fn_row_array ld_##r##_ihl = { \
+        { "LD " name ", (HL) [M2]", _read_ihl_to_z }, \
+        { "LD " name ", (HL) [M3]", _ld_##r##_z }, \
+        { NULL,                     NULL }, \
+    }; \
+    \
+    fn_row_array ld_##r##_n = { \
+        { "LD " name ", imm8 [M2]", _read_imm8_into_z }, \
+        { "LD " name ", imm8 [M3]", _ld_##r##_z }, \
+        { NULL,                     NULL } \
+    };
+
+INSTR_R(_LD_R_Z, )
+_LD_R_Z(r, "r", OP_DST(cpu->op->ir), )
+
+/* 00xx0010 - LD (rr), A and 00xx1010 - LD A, (rr) */
+#define _LD_IRR(rr, name, reg, step, unused) \
+    static void \
+    _ld_i##rr##_a(cpu_t *cpu) \
+    { \
+        /* write A to mem and step HL if we need to */ \
+        int hl_step = (step); \
+        _cpu_write_byte(cpu, (reg).val, cpu->af.hi); \
+        if (hl_step) { \
+            _idu_write(cpu, cpu->hl.val); \
+            cpu->hl.val += hl_step; \
+        } \
+    } \
+    \
+    static void \
+    _ld_a_i##rr(cpu_t *cpu) \
+    { \
+        /* read mem into A and step HL if we need to */ \
+        int hl_step = (step); \
+        _cpu_read_byte(cpu, &cpu->af.hi, (reg).val); \
+        if (hl_step) { \
+            _idu_write(cpu, cpu->hl.val); \
+            cpu->hl.val += hl_step; \
+        } \
+    } \
+    \
+    fn_row_array ld_i##rr##_a = { \
+        { "LD (" name "), A [M2]",  _ld_i##rr##_a }, \
+        { "LD (" name "), A [M3]",  _nothing }, \
+        { NULL,                     NULL }, \
+    }; \
+    \
+    fn_row_array ld_a_i##rr = { \
+        { "LD A, (" name ") [M2]",  _ld_a_i##rr }, \
+        { "LD A, (" name ") [M3]",  _nothing }, \
+        { NULL,                     NULL }, \
+    };
+
+INSTR_IRR(_LD_IRR, )
+_LD_IRR(rr, "rr", OP_RR(cpu->op->ir), _hl_step(cpu), )
 
 /* 00110110 - LD (HL), imm8 */
 fn_row_array ld_ihl_n = {
@@ -450,12 +325,23 @@ fn_row_array ld_a_inn = {
 };
 
 /* 00xx0001 - LD rr, imm16 */
-fn_row_array ld_rr_nn = {
-    { "LD rr, imm16 [M2]",      _read_imm8_into_z },
-    { "LD rr, imm16 [M3]",      _read_imm8_into_w },
-    { "LD rr, imm16 [M4]",      _ld_rr_nn },
-    { NULL,                     NULL }
-};
+#define _LD_RR_NN(rr, name, dst, unused) \
+    static void \
+    _ld_##rr##_nn(cpu_t *cpu) \
+    { \
+        /* put WZ into the register */ \
+        (dst).val = cpu->wz.val; \
+    } \
+    \
+    fn_row_array ld_##rr##_nn = { \
+        { "LD " name ", imm16 [M2]", _read_imm8_into_z }, \
+        { "LD " name ", imm16 [M3]", _read_imm8_into_w }, \
+        { "LD " name ", imm16 [M4]", _ld_##rr##_nn }, \
+        { NULL,                     NULL } \
+    };
+
+INSTR_RR(_LD_RR_NN, )
+_LD_RR_NN(rr, "rr", OP_RR(cpu->op->ir), )
 
 /* 00001000 - LD (imm16), SP */
 fn_row_array ld_inn_sp = {
@@ -467,22 +353,52 @@ fn_row_array ld_inn_sp = {
     { NULL,                     NULL }
 };
 
-/* 11xx0101 - PUSH */
-fn_row_array push = {
-    { "PUSH [M2]",              _dec_sp },
-    { "PUSH [M3]",              _push_hi },
-    { "PUSH [M4]",              _push_lo },
-    { "PUSH [M5]",              _nothing },
-    { NULL,                     NULL }
-};
-
-/* 11xx0001 - POP */
-fn_row_array pop = {
-    { "POP [M2]",               _pop_lo_into_z },
-    { "POP [M3]",               _pop_hi_into_w },
-    { "POP [M4]",               _pop },
-    { NULL,                     NULL }
-};
+/* 11xx0101 - PUSH rr and 11xx0001 - POP rr */
+#define _PUSH_POP(rr, name, reg, unused) \
+    static void \
+    _push_hi_##rr(cpu_t *cpu) \
+    { \
+        /* write hi reg to mem and dec SP again. F has to be worked out \
+         * first */ \
+        if (&(reg) == &cpu->af) \
+            _cpu_flags(cpu); \
+        _cpu_write_byte(cpu, cpu->sp.val, (reg).hi); \
+        _idu_write(cpu, cpu->sp.val--); \
+    } \
+    \
+    static void \
+    _push_lo_##rr(cpu_t *cpu) \
+    { \
+        /* just write lo reg to mem */ \
+        _cpu_write_byte(cpu, cpu->sp.val, (reg).lo); \
+    } \
+    \
+    static void \
+    _pop_##rr(cpu_t *cpu) \
+    { \
+        /* write WZ into reg. popping AF only changes the flag bits of F */ \
+        (reg).val = cpu->wz.val; \
+        if (&(reg) == &cpu->af) \
+            _cpu_set_flags(cpu, cpu->af.lo); \
+    } \
+    \
+    fn_row_array push_##rr = { \
+        { "PUSH " name " [M2]",     _dec_sp }, \
+        { "PUSH " name " [M3]",     _push_hi_##rr }, \
+        { "PUSH " name " [M4]",     _push_lo_##rr }, \
+        { "PUSH " name " [M5]",     _nothing }, \
+        { NULL,                     NULL } \
+    }; \
+    \
+    fn_row_array pop_##rr = { \
+        { "POP " name " [M2]",      _pop_lo_into_z }, \
+        { "POP " name " [M3]",      _pop_hi_into_w }, \
+        { "POP " name " [M4]",      _pop_##rr }, \
+        { NULL,                     NULL } \
+    };
+
+INSTR_RR_STACK(_PUSH_POP, )
+_PUSH_POP(rr, "rr", OP_RR(cpu->op->ir), )
 
 /* 11111001 - LD SP, HL */
 fn_row_array ld_sp_hl = {
@@ -46,7 +46,16 @@ _cb_prefix(cpu_t *cpu)
      * have a NULL element on top (the FETCH cycle) so that the cpu state
      * matches with the correct index. no adjustment is needed */
     _cpu_read_imm8(cpu, &cpu->ir);
-    cpu->curlist = *cb_instructions[cpu->ir];
+
+    /* a cached instruction already knows its second byte. if it's not there,
+     * or the bus gave us something else, decode it now */
+    if (!cpu->op->cb || cpu->op->cb_ir != cpu->ir) {
+        cpu->scratch = *cpu->op;
+        cpu_decode_cb(&cpu->scratch, cpu->ir);
+        cpu->op = &cpu->scratch;
+    }
+
+    cpu->curlist = cpu_op_cb_list(cpu->op);
 }
 
 fn_row_array nop = {
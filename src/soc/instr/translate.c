@@ -0,0 +1,186 @@
+#include "soc/cpu_common.h"
+#include "soc/instr/instrs.h"
+#include "types.h"
+
+/* what the native backends make of each group. the handler kinds run the
+ * micro-ops from first on, the conditional ones take skip machine cycles when
+ * the condition fails. anything missing stays interpreted: EI, DI, RETI, HALT,
+ * STOP, LDH (C), the SP arithmetic and the CB prefix without its second byte */
+typedef struct xlat_entry {
+    fn_list_t group;
+    enum xlat_kind kind;
+    unsigned first, skip;
+} xlat_entry_t;
+
+static const xlat_entry_t _xlat[] = {
+    /* loads */
+    { nop,          XLAT_NOP,           0, 0 },
+    { ld_r_r,       XLAT_LD_R_R,        0, 0 },
+    { ld_r_n,       XLAT_LD_R_N,        0, 0 },
+    { ld_r_ihl,     XLAT_LD_R_IHL,      0, 0 },
+    { ld_ihl_r,     XLAT_LD_IHL_R,      0, 0 },
+    { ld_ihl_n,     XLAT_LD_IHL_N,      0, 0 },
+    { ld_a_irr,     XLAT_LD_A_IRR,      0, 0 },
+    { ld_irr_a,     XLAT_LD_IRR_A,      0, 0 },
+    { ldh_a_in,     XLAT_LD_A_ADDR,     0, 0 },
+    { ld_a_inn,     XLAT_LD_A_ADDR,     0, 0 },
+    { ldh_in_a,     XLAT_LD_ADDR_A,     0, 0 },
+    { ld_inn_a,     XLAT_LD_ADDR_A,     0, 0 },
+    { ld_rr_nn,     XLAT_LD_RR_NN,      0, 0 },
+    { ld_sp_hl,     XLAT_LD_SP_HL,      0, 0 },
+    { push_rr,      XLAT_PUSH,          0, 0 },
+    { pop_rr,       XLAT_POP,           0, 0 },
+    { inc_rr,       XLAT_ADD_RR,        0, 0 },
+    { dec_rr,       XLAT_ADD_RR,        0, 0 },
+
+    /* ALU operations, through their own micro-ops */
+    { add_r,        XLAT_HANDLERS,      0, 0 },
+    { adc_r,        XLAT_HANDLERS,      0, 0 },
+    { sub_r,        XLAT_HANDLERS,      0, 0 },
+    { sbc_r,        XLAT_HANDLERS,      0, 0 },
+    { and_r,        XLAT_HANDLERS,      0, 0 },
+    { xor_r,        XLAT_HANDLERS,      0, 0 },
+    { or_r,         XLAT_HANDLERS,      0, 0 },
+    { cp_r,         XLAT_HANDLERS,      0, 0 },
+    { inc_r,        XLAT_HANDLERS,      0, 0 },
+    { dec_r,        XLAT_HANDLERS,      0, 0 },
+    { ccf,          XLAT_HANDLERS,      0, 0 },
+    { scf,          XLAT_HANDLERS,      0, 0 },
+    { daa,          XLAT_HANDLERS,      0, 0 },
+    { cpl,          XLAT_HANDLERS,      0, 0 },
+    { add_hl_rr,    XLAT_HANDLERS,      0, 0 },
+    { rlca,         XLAT_HANDLERS,      0, 0 },
+    { rrca,         XLAT_HANDLERS,      0, 0 },
+    { rla,          XLAT_HANDLERS,      0, 0 },
+    { rra,          XLAT_HANDLERS,      0, 0 },
+    { add_n,        XLAT_HANDLERS_N,    1, 0 },
+    { adc_n,        XLAT_HANDLERS_N,    1, 0 },
+    { sub_n,        XLAT_HANDLERS_N,    1, 0 },
+    { sbc_n,        XLAT_HANDLERS_N,    1, 0 },
+    { and_n,        XLAT_HANDLERS_N,    1, 0 },
+    { xor_n,        XLAT_HANDLERS_N,    1, 0 },
+    { or_n,         XLAT_HANDLERS_N,    1, 0 },
+    { cp_n,         XLAT_HANDLERS_N,    1, 0 },
+    { add_ihl,      XLAT_HANDLERS_IHL,  1, 0 },
+    { adc_ihl,      XLAT_HANDLERS_IHL,  1, 0 },
+    { sub_ihl,      XLAT_HANDLERS_IHL,  1, 0 },
+    { sbc_ihl,      XLAT_HANDLERS_IHL,  1, 0 },
+    { and_ihl,      XLAT_HANDLERS_IHL,  1, 0 },
+    { xor_ihl,      XLAT_HANDLERS_IHL,  1, 0 },
+    { or_ihl,       XLAT_HANDLERS_IHL,  1, 0 },
+    { cp_ihl,       XLAT_HANDLERS_IHL,  1, 0 },
+    { inc_ihl,      XLAT_RMW_IHL,       1, 0 },
+    { dec_ihl,      XLAT_RMW_IHL,       1, 0 },
+
+    /* jumps */
+    { jr_e,         XLAT_JUMP,          0, 0 },
+    { jp_nn,        XLAT_JUMP,          0, 0 },
+    { jr_cc_e,      XLAT_JUMP,          0, 2 },
+    { jp_cc_nn,     XLAT_JUMP,          0, 3 },
+    { jp_hl,        XLAT_JUMP_HL,       0, 0 },
+    { call_nn,      XLAT_CALL,          0, 0 },
+    { rst_n,        XLAT_CALL,          0, 0 },
+    { call_cc_nn,   XLAT_CALL,          0, 3 },
+    { ret,          XLAT_RET,           0, 0 },
+    { ret_cc,       XLAT_RET,           0, 2 },
+};
+
+/* the CB lists start from M3, after the prefix */
+static const xlat_entry_t _xlat_cb[] = {
+    { rlc_r,        XLAT_HANDLERS,      1, 0 },
+    { rrc_r,        XLAT_HANDLERS,      1, 0 },
+    { rl_r,         XLAT_HANDLERS,      1, 0 },
+    { rr_r,         XLAT_HANDLERS,      1, 0 },
+    { sla_r,        XLAT_HANDLERS,      1, 0 },
+    { sra_r,        XLAT_HANDLERS,      1, 0 },
+    { swap_r,       XLAT_HANDLERS,      1, 0 },
+    { srl_r,        XLAT_HANDLERS,      1, 0 },
+    { bit_b_r,      XLAT_HANDLERS,      1, 0 },
+    { res_b_r,      XLAT_HANDLERS,      1, 0 },
+    { set_b_r,      XLAT_HANDLERS,      1, 0 },
+    { bit_b_ihl,    XLAT_HANDLERS_IHL,  2, 0 },
+    { rlc_ihl,      XLAT_RMW_IHL,       2, 0 },
+    { rrc_ihl,      XLAT_RMW_IHL,       2, 0 },
+    { rl_ihl,       XLAT_RMW_IHL,       2, 0 },
+    { rr_ihl,       XLAT_RMW_IHL,       2, 0 },
+    { sla_ihl,      XLAT_RMW_IHL,       2, 0 },
+    { sra_ihl,      XLAT_RMW_IHL,       2, 0 },
+    { swap_ihl,     XLAT_RMW_IHL,       2, 0 },
+    { srl_ihl,      XLAT_RMW_IHL,       2, 0 },
+    { res_b_ihl,    XLAT_RMW_IHL,       2, 0 },
+    { set_b_ihl,    XLAT_RMW_IHL,       2, 0 },
+};
+
+static const xlat_entry_t *
+_xlat_find(const xlat_entry_t *table, size_t n, fn_list_t group)
+{
+    for (size_t i = 0; i < n; ++i)
+        if (table[i].group == group)
+            return &table[i];
+    return NULL;
+}
+
+bool
+cpu_translate(const cpu_op_t *op, uint16_t pc, uint8_t n, uint16_t nn,
+        xlat_t *xlat)
+{
+    const xlat_entry_t *entry;
+    if (op->ir == 0xCB) {
+        if (!op->cb)
+            return false;
+        entry = _xlat_find(_xlat_cb, sizeof(_xlat_cb) / sizeof(*_xlat_cb),
+                cpu_op_cb_group(op));
+        xlat->list = cpu_op_cb_list(op);
+    } else {
+        entry = _xlat_find(_xlat, sizeof(_xlat) / sizeof(*_xlat),
+                cpu_op_group(op));
+        xlat->list = cpu_op_list(op);
+    }
+    if (!entry)
+        return false;
+
+    /* the decoded cycles are the longest path */
+    fn_list_t group = entry->group;
+    xlat->kind = entry->kind;
+    xlat->first = entry->first;
+    xlat->mcycles = op->mcycles;
+    xlat->skip_mcycles = entry->skip;
+    xlat->cc = entry->skip ? (int)OP_CC(op->ir) : -1;
+    xlat->next = pc + cpu_instr_len(op->ir);
+    xlat->ends = entry->kind >= XLAT_JUMP;
+    xlat->step = 0;
+    xlat->addr = 0;
+
+    switch (entry->kind) {
+        case XLAT_LD_A_IRR:
+        case XLAT_LD_IRR_A:
+            /* HL+ and HL- */
+            if ((op->ir & 0x30) == 0x20)
+                xlat->step = 1;
+            else if ((op->ir & 0x30) == 0x30)
+                xlat->step = -1;
+            break;
+        case XLAT_LD_A_ADDR:
+        case XLAT_LD_ADDR_A:
+            /* I/O registers must be accessed on their machine cycle */
+            xlat->addr = group == ldh_a_in || group == ldh_in_a ?
+                0xFF00 | n : nn;
+            if (!_cpu_plain_read(xlat->addr))
+                return false;
+            break;
+        case XLAT_ADD_RR:
+            xlat->step = group == inc_rr ? 1 : -1;
+            break;
+        case XLAT_JUMP:
+            xlat->addr = group == jr_e || group == jr_cc_e ?
+                (uint16_t)(xlat->next + (int8_t)n) : nn;
+            break;
+        case XLAT_CALL:
+            xlat->addr = group == rst_n ? OP_N(op->ir) * 0x08 : nn;
+            break;
+        default:
+            break;
+    }
+
+    return true;
+}
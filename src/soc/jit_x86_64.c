@@ -0,0 +1,730 @@
+#include "soc/cpu_common.h"
+#include "soc/instr/instrs.h"
+#include "soc/soc.h"
+#include "log.h"
+#include "types.h"
+
+#include <errno.h>
+#include <stddef.h>
+#include <sys/mman.h>
+
+/* host registers */
+enum {
+    RAX, RCX, RDX, RBX, RSP, RBP, RSI, RDI,
+    R8, R9, R10, R11, R12, R13, R14, R15
+};
+
+/* the SM83 registers live in callee-saved host registers while a block runs,
+ * each one zero-extended to 32 bits. PC is known at compile time */
+#define H_AF        RBX
+#define H_BC        RBP
+#define H_DE        R12
+#define H_HL        R13
+#define H_SP        R14
+#define H_CPU       R15
+
+/* x86 opcodes for "op r/m32, r32" */
+#define X_ADD       0x01
+#define X_OR        0x09
+#define X_AND       0x21
+#define X_SUB       0x29
+#define X_TEST      0x85
+#define X_MOV       0x89
+
+/* x86 /digit extensions for the immediate and shift groups */
+#define X_ADD_I     0
+#define X_OR_I      1
+#define X_AND_I     4
+#define X_SUB_I     5
+#define X_SHL_I     4
+#define X_SHR_I     5
+
+/* how many times a block must be entered before it gets compiled */
+#define JIT_HOT             32
+
+/* way more than the largest block can take */
+#define JIT_MAX_BLOCK_SIZE  0x2000
+
+/* the assembler state for the block being compiled */
+typedef struct jit_asm {
+    uint8_t *p;
+    uint8_t *epilogue;
+} jit_asm_t;
+
+/*
+ *      ** ASSEMBLER **
+ */
+
+static inline void
+_b(jit_asm_t *a, uint8_t val)
+{
+    *a->p++ = val;
+}
+
+static inline void
+_d(jit_asm_t *a, uint32_t val)
+{
+    memcpy(a->p, &val, sizeof(val));
+    a->p += sizeof(val);
+}
+
+static inline void
+_q(jit_asm_t *a, uint64_t val)
+{
+    memcpy(a->p, &val, sizeof(val));
+    a->p += sizeof(val);
+}
+
+static inline void
+_rex(jit_asm_t *a, bool w, unsigned reg, unsigned rm, bool force)
+{
+    uint8_t rex = 0x40 | (w << 3) | ((reg & 8) >> 1) | ((rm & 8) >> 3);
+    if (rex != 0x40 || force)
+        _b(a, rex);
+}
+
+/* op r/m32, r32 */
+static void
+_op_rr(jit_asm_t *a, uint8_t op, unsigned rm, unsigned reg)
+{
+    _rex(a, false, reg, rm, false);
+    _b(a, op);
+    _b(a, 0xC0 | (reg & 7) << 3 | (rm & 7));
+}
+
+/* op r/m32, imm32 */
+static void
+_op_ri(jit_asm_t *a, unsigned ext, unsigned rm, uint32_t imm)
+{
+    _rex(a, false, 0, rm, false);
+    _b(a, 0x81);
+    _b(a, 0xC0 | ext << 3 | (rm & 7));
+    _d(a, imm);
+}
+
+/* shl/shr r32, imm8 */
+static void
+_shift_ri(jit_asm_t *a, unsigned ext, unsigned rm, uint8_t imm)
+{
+    _rex(a, false, 0, rm, false);
+    _b(a, 0xC1);
+    _b(a, 0xC0 | ext << 3 | (rm & 7));
+    _b(a, imm);
+}
+
+/* mov r32, imm32 */
+static void
+_mov_ri(jit_asm_t *a, unsigned reg, uint32_t imm)
+{
+    _rex(a, false, 0, reg, false);
+    _b(a, 0xB8 + (reg & 7));
+    _d(a, imm);
+}
+
+/* movzx r32, r8 */
+static void
+_movzx8(jit_asm_t *a, unsigned reg, unsigned rm)
+{
+    _rex(a, false, reg, rm, rm >= RSP && rm <= RDI);
+    _b(a, 0x0F);
+    _b(a, 0xB6);
+    _b(a, 0xC0 | (reg & 7) << 3 | (rm & 7));
+}
+
+/* movzx r32, r16 */
+static void
+_movzx16(jit_asm_t *a, unsigned reg, unsigned rm)
+{
+    _rex(a, false, reg, rm, false);
+    _b(a, 0x0F);
+    _b(a, 0xB7);
+    _b(a, 0xC0 | (reg & 7) << 3 | (rm & 7));
+}
+
+/* movzx r32, word [cpu + off] */
+static void
+_load16(jit_asm_t *a, unsigned reg, size_t off)
+{
+    _rex(a, false, reg, H_CPU, false);
+    _b(a, 0x0F);
+    _b(a, 0xB7);
+    _b(a, 0x80 | (reg & 7) << 3 | (H_CPU & 7));
+    _d(a, off);
+}
+
+/* mov word [cpu + off], r16 */
+static void
+_store16(jit_asm_t *a, unsigned reg, size_t off)
+{
+    _b(a, 0x66);
+    _rex(a, false, reg, H_CPU, false);
+    _b(a, 0x89);
+    _b(a, 0x80 | (reg & 7) << 3 | (H_CPU & 7));
+    _d(a, off);
+}
+
+/* mov word [cpu + off], imm16 */
+static void
+_store16_imm(jit_asm_t *a, size_t off, uint16_t imm)
+{
+    _b(a, 0x66);
+    _rex(a, false, 0, H_CPU, false);
+    _b(a, 0xC7);
+    _b(a, 0x80 | (H_CPU & 7));
+    _d(a, off);
+    _b(a, imm & 0xFF);
+    _b(a, imm >> 8);
+}
+
+/* mov byte [cpu + off], imm8 */
+static void
+_store8_imm(jit_asm_t *a, size_t off, uint8_t imm)
+{
+    _rex(a, false, 0, H_CPU, false);
+    _b(a, 0xC6);
+    _b(a, 0x80 | (H_CPU & 7));
+    _d(a, off);
+    _b(a, imm);
+}
+
+/* cmp byte [cpu + off], imm8 */
+static void
+_cmp8_imm(jit_asm_t *a, size_t off, uint8_t imm)
+{
+    _rex(a, false, 0, H_CPU, false);
+    _b(a, 0x80);
+    _b(a, 0x80 | 7 << 3 | (H_CPU & 7));
+    _d(a, off);
+    _b(a, imm);
+}
+
+/* mov qword [cpu + off], imm64 (through rax) */
+static void
+_store_ptr(jit_asm_t *a, size_t off, const void *ptr)
+{
+    _b(a, 0x48);
+    _b(a, 0xB8);
+    _q(a, (uintptr_t)ptr);
+    _rex(a, true, RAX, H_CPU, false);
+    _b(a, 0x89);
+    _b(a, 0x80 | (H_CPU & 7));
+    _d(a, off);
+}
+
+static void
+_push(jit_asm_t *a, unsigned reg)
+{
+    _rex(a, false, 0, reg, false);
+    _b(a, 0x50 + (reg & 7));
+}
+
+static void
+_pop(jit_asm_t *a, unsigned reg)
+{
+    _rex(a, false, 0, reg, false);
+    _b(a, 0x58 + (reg & 7));
+}
+
+/* call a C function with the CPU as first argument. the others must already
+ * be in esi and edx */
+static void
+_call(jit_asm_t *a, const void *fn)
+{
+    /* mov rdi, r15 */
+    _rex(a, true, H_CPU, RDI, false);
+    _b(a, X_MOV);
+    _b(a, 0xC0 | (H_CPU & 7) << 3 | RDI);
+
+    /* mov rax, fn; call rax */
+    _b(a, 0x48);
+    _b(a, 0xB8);
+    _q(a, (uintptr_t)fn);
+    _b(a, 0xFF);
+    _b(a, 0xD0);
+}
+
+/*
+ *      ** CODE GENERATION **
+ */
+
+/* the offsets of the SM83 registers within cpu_t */
+static const size_t _pair_offs[] = {
+    [H_AF] = offsetof(cpu_t, af),
+    [H_BC] = offsetof(cpu_t, bc),
+    [H_DE] = offsetof(cpu_t, de),
+    [H_HL] = offsetof(cpu_t, hl),
+    [H_SP] = offsetof(cpu_t, sp),
+};
+
+static const unsigned _pairs[] = { H_AF, H_BC, H_DE, H_HL, H_SP };
+
+/* the host register holding an 8-bit register, by its 3-bit encoding */
+static const unsigned _r_pair[8] = {
+    H_BC, H_BC, H_DE, H_DE, H_HL, H_HL, 0, H_AF
+};
+
+static inline bool
+_r_is_hi(unsigned r)
+{
+    return r == 7 || !(r & 1);
+}
+
+static unsigned
+_rr_pair(cpu_t *cpu, const reg_t *rr)
+{
+    if (rr == &cpu->af)
+        return H_AF;
+    if (rr == &cpu->bc)
+        return H_BC;
+    if (rr == &cpu->de)
+        return H_DE;
+    if (rr == &cpu->hl)
+        return H_HL;
+    return H_SP;
+}
+
+/* tmp = r */
+static void
+_get8(jit_asm_t *a, unsigned r, unsigned tmp)
+{
+    unsigned pair = _r_pair[r];
+    if (_r_is_hi(r)) {
+        _op_rr(a, X_MOV, tmp, pair);
+        _shift_ri(a, X_SHR_I, tmp, 8);
+    } else {
+        _movzx8(a, tmp, pair);
+    }
+}
+
+/* r = al (clobbers eax) */
+static void
+_set8(jit_asm_t *a, unsigned r)
+{
+    unsigned pair = _r_pair[r];
+    _movzx8(a, RAX, RAX);
+    if (_r_is_hi(r)) {
+        _shift_ri(a, X_SHL_I, RAX, 8);
+        _op_ri(a, X_AND_I, pair, 0x00FF);
+    } else {
+        _op_ri(a, X_AND_I, pair, 0xFF00);
+    }
+    _op_rr(a, X_OR, pair, RAX);
+}
+
+/* pair = (pair + delta) & 0xFFFF */
+static void
+_add16(jit_asm_t *a, unsigned pair, int delta)
+{
+    if (delta > 0)
+        _op_ri(a, X_ADD_I, pair, delta);
+    else
+        _op_ri(a, X_SUB_I, pair, -delta);
+    _movzx16(a, pair, pair);
+}
+
+static void
+_emit_prologue(jit_asm_t *a)
+{
+    /* save the callee-saved registers and keep the stack aligned */
+    _push(a, RBX);
+    _push(a, RBP);
+    _push(a, R12);
+    _push(a, R13);
+    _push(a, R14);
+    _push(a, R15);
+    _b(a, 0x48);
+    _b(a, 0x83);
+    _b(a, 0xEC);
+    _b(a, 0x08);
+
+    /* mov r15, rdi */
+    _rex(a, true, RDI, H_CPU, false);
+    _b(a, X_MOV);
+    _b(a, 0xC0 | RDI << 3 | (H_CPU & 7));
+
+    /* load the registers */
+    for (size_t i = 0; i < sizeof(_pairs) / sizeof(*_pairs); ++i)
+        _load16(a, _pairs[i], _pair_offs[_pairs[i]]);
+}
+
+static void
+_emit_epilogue(jit_asm_t *a)
+{
+    /* write the registers back, PC is already there */
+    for (size_t i = 0; i < sizeof(_pairs) / sizeof(*_pairs); ++i)
+        _store16(a, _pairs[i], _pair_offs[_pairs[i]]);
+
+    _b(a, 0x48);
+    _b(a, 0x83);
+    _b(a, 0xC4);
+    _b(a, 0x08);
+    _pop(a, R15);
+    _pop(a, R14);
+    _pop(a, R13);
+    _pop(a, R12);
+    _pop(a, RBP);
+    _pop(a, RBX);
+    _b(a, 0xC3);
+}
+
+/* leave the block with PC at the given address */
+static void
+_emit_exit(jit_asm_t *a, uint16_t pc, unsigned cycles, unsigned idx)
+{
+    _store16_imm(a, offsetof(cpu_t, pc), pc);
+    _mov_ri(a, RAX, NATIVE_RET(cycles, idx));
+    _b(a, 0xE9);
+    _d(a, a->epilogue - (a->p + 4));
+}
+
+/* a helper returned a negative eax: leave before the instruction, nothing has
+ * happened yet */
+static void
+_emit_check(jit_asm_t *a, bcache_block_t *block, unsigned i, unsigned cycles)
+{
+    /* test eax, eax; jns over */
+    _op_rr(a, X_TEST, RAX, RAX);
+    _b(a, 0x79);
+    uint8_t *rel = a->p++;
+    _emit_exit(a, block->pcs[i], cycles, i);
+    *rel = a->p - (rel + 1);
+}
+
+/* the handlers below touch nothing but the registers. they are run as they
+ * are, with the registers synced to the CPU around them */
+static void
+_emit_spill(jit_asm_t *a)
+{
+    for (size_t i = 0; i < sizeof(_pairs) / sizeof(*_pairs); ++i)
+        _store16(a, _pairs[i], _pair_offs[_pairs[i]]);
+}
+
+static void
+_emit_reload(jit_asm_t *a)
+{
+    /* handlers never touch SP */
+    for (size_t i = 0; i < sizeof(_pairs) / sizeof(*_pairs) - 1; ++i)
+        _load16(a, _pairs[i], _pair_offs[_pairs[i]]);
+}
+
+static void
+_emit_handlers(jit_asm_t *a, const cpu_op_t *op, fn_list_t list,
+        unsigned first)
+{
+    _store_ptr(a, offsetof(cpu_t, op), op);
+    _emit_spill(a);
+    for (unsigned i = first; list[i].fn; ++i)
+        _call(a, list[i].fn);
+    _emit_reload(a);
+}
+
+/* where a conditional lands if the condition is false. the condition is true
+ * if the flag (Z for NZ/Z, C for NC/C) matches. both are kept up to date by
+ * the handlers, F isn't (see cpu_common.h) */
+static void
+_emit_cond(jit_asm_t *a, uint8_t cc, uint8_t **rel)
+{
+    /* Z is set when the result is zero, C when the carry isn't */
+    if (cc < 2) {
+        _cmp8_imm(a, offsetof(cpu_t, flags.res), 0);
+        _b(a, cc & 1 ? 0x75 : 0x74);
+    } else {
+        _cmp8_imm(a, offsetof(cpu_t, flags.carry), 0);
+        _b(a, cc & 1 ? 0x74 : 0x75);
+    }
+    *rel = a->p++;
+}
+
+static inline void
+_patch_cond(jit_asm_t *a, uint8_t *rel)
+{
+    *rel = a->p - (rel + 1);
+}
+
+/* emit one instruction. returns its machine cycles (the longest path for
+ * jumps) or -1 if the interpreter should run it. *ends is set if the block has
+ * been left */
+static int
+_jit_emit_instr(jit_asm_t *a, jit_t *jit, bcache_block_t *block, unsigned i,
+        unsigned cycles, bool *ends)
+{
+    cpu_t *cpu = jit->soc->cpu;
+    bcache_t *bcache = jit->soc->bcache;
+    const cpu_op_t *op = &block->ops[i];
+    uint16_t pc = block->pcs[i];
+    uint8_t n = bcache_peek(bcache, pc + 1);
+    uint16_t nn = n | bcache_peek(bcache, pc + 2) << 8;
+    xlat_t x;
+    if (!cpu_translate(op, pc, n, nn, &x))
+        return -1;
+
+    reg_t *rr = cpu_op_rr(cpu, op->ir);
+    unsigned src = op->ir & 0x07, dst = (op->ir & 0x38) >> 3;
+    unsigned taken = cycles + x.mcycles, skipped = cycles + x.skip_mcycles;
+    uint8_t *rel = NULL;
+
+    *ends = x.ends;
+    switch (x.kind) {
+        case XLAT_NOP:
+            break;
+
+        case XLAT_LD_R_R:
+            _get8(a, src, RAX);
+            _set8(a, dst);
+            break;
+
+        case XLAT_LD_R_N:
+            _mov_ri(a, RAX, n);
+            _set8(a, dst);
+            break;
+
+        case XLAT_LD_R_IHL:
+            _op_rr(a, X_MOV, RSI, H_HL);
+            _call(a, cpu_native_read);
+            _emit_check(a, block, i, cycles);
+            _set8(a, dst);
+            break;
+
+        case XLAT_LD_IHL_R:
+        case XLAT_LD_IHL_N:
+            if (x.kind == XLAT_LD_IHL_R)
+                _get8(a, src, RDX);
+            else
+                _mov_ri(a, RDX, n);
+            _op_rr(a, X_MOV, RSI, H_HL);
+            _call(a, cpu_native_write);
+            _emit_check(a, block, i, cycles);
+            break;
+
+        case XLAT_LD_A_IRR:
+        case XLAT_LD_IRR_A:
+        case XLAT_LD_A_ADDR:
+        case XLAT_LD_ADDR_A:
+            if (x.kind == XLAT_LD_A_IRR || x.kind == XLAT_LD_IRR_A)
+                _op_rr(a, X_MOV, RSI, _rr_pair(cpu, rr));
+            else
+                _mov_ri(a, RSI, x.addr);
+            if (x.kind == XLAT_LD_A_IRR || x.kind == XLAT_LD_A_ADDR) {
+                _call(a, cpu_native_read);
+                _emit_check(a, block, i, cycles);
+                _set8(a, 7);
+            } else {
+                _get8(a, 7, RDX);
+                _call(a, cpu_native_write);
+                _emit_check(a, block, i, cycles);
+            }
+            if (x.step)
+                _add16(a, H_HL, x.step);
+            break;
+
+        case XLAT_LD_RR_NN:
+            _mov_ri(a, _rr_pair(cpu, rr), nn);
+            break;
+
+        case XLAT_LD_SP_HL:
+            _op_rr(a, X_MOV, H_SP, H_HL);
+            break;
+
+        case XLAT_PUSH:
+            /* F has to be worked out first */
+            if (rr == &cpu->af) {
+                _call(a, cpu_native_flags);
+                _op_ri(a, X_AND_I, H_AF, 0xFF00);
+                _op_rr(a, X_OR, H_AF, RAX);
+            }
+            _op_rr(a, X_MOV, RSI, H_SP);
+            _op_rr(a, X_MOV, RDX, _rr_pair(cpu, rr));
+            _call(a, cpu_native_push);
+            _emit_check(a, block, i, cycles);
+            _add16(a, H_SP, -2);
+            break;
+
+        case XLAT_POP:
+            _op_rr(a, X_MOV, RSI, H_SP);
+            _call(a, cpu_native_pop);
+            _emit_check(a, block, i, cycles);
+            _add16(a, H_SP, 2);
+            _op_rr(a, X_MOV, _rr_pair(cpu, rr), RAX);
+
+            /* the lower nibble of F doesn't exist */
+            _op_ri(a, X_AND_I, H_AF, 0xFFF0);
+            if (rr == &cpu->af) {
+                _op_rr(a, X_MOV, RSI, H_AF);
+                _call(a, cpu_native_set_flags);
+            }
+            break;
+
+        case XLAT_ADD_RR:
+            _add16(a, _rr_pair(cpu, rr), x.step);
+            break;
+
+        case XLAT_HANDLERS:
+        case XLAT_HANDLERS_N:
+        case XLAT_HANDLERS_IHL:
+            if (x.kind == XLAT_HANDLERS_N) {
+                _store8_imm(a, offsetof(cpu_t, wz.lo), n);
+            } else if (x.kind == XLAT_HANDLERS_IHL) {
+                _op_rr(a, X_MOV, RSI, H_HL);
+                _call(a, cpu_native_read_z);
+                _emit_check(a, block, i, cycles);
+            }
+            _emit_handlers(a, op, x.list, x.first);
+            break;
+
+        case XLAT_RMW_IHL:
+            /* the handler goes in RDX, as a 64-bit immediate */
+            _store_ptr(a, offsetof(cpu_t, op), op);
+            _emit_spill(a);
+            _op_rr(a, X_MOV, RSI, H_HL);
+            _b(a, 0x48);
+            _b(a, 0xBA);
+            _q(a, (uintptr_t)x.list[x.first].fn);
+            _call(a, cpu_native_rmw);
+            _emit_check(a, block, i, cycles);
+            _emit_reload(a);
+            break;
+
+        case XLAT_JUMP:
+            if (x.cc >= 0)
+                _emit_cond(a, x.cc, &rel);
+            _emit_exit(a, x.addr, taken, block->len);
+            break;
+
+        case XLAT_JUMP_HL:
+            _store16(a, H_HL, offsetof(cpu_t, pc));
+            _mov_ri(a, RAX, NATIVE_RET(taken, block->len));
+            _b(a, 0xE9);
+            _d(a, a->epilogue - (a->p + 4));
+            break;
+
+        case XLAT_CALL:
+            if (x.cc >= 0)
+                _emit_cond(a, x.cc, &rel);
+            _op_rr(a, X_MOV, RSI, H_SP);
+            _mov_ri(a, RDX, x.next);
+            _call(a, cpu_native_push);
+            _emit_check(a, block, i, cycles);
+            _add16(a, H_SP, -2);
+            _emit_exit(a, x.addr, taken, block->len);
+            break;
+
+        case XLAT_RET:
+            if (x.cc >= 0)
+                _emit_cond(a, x.cc, &rel);
+            _op_rr(a, X_MOV, RSI, H_SP);
+            _call(a, cpu_native_pop);
+            _emit_check(a, block, i, cycles);
+            _add16(a, H_SP, 2);
+            _store16(a, RAX, offsetof(cpu_t, pc));
+            _mov_ri(a, RAX, NATIVE_RET(taken, block->len));
+            _b(a, 0xE9);
+            _d(a, a->epilogue - (a->p + 4));
+            break;
+    }
+
+    /* a failed condition falls through to the next instruction */
+    if (rel) {
+        _patch_cond(a, rel);
+        _emit_exit(a, x.next, skipped, block->len);
+    }
+
+    return x.mcycles;
+}
+
+static void
+_jit_flush(jit_t *jit)
+{
+    /* start over, blocks get compiled again once they're hot. AOT code stays
+     * where it is */
+    bcache_t *bcache = jit->soc->bcache;
+    for (size_t i = 0; i < BCACHE_BLOCKS; ++i) {
+        bcache_block_t *block = bcache->blocks[i];
+        if (!block->valid)
+            continue;
+
+        uint8_t *code = (uint8_t *)block->native;
+        if (code >= jit->code && code < jit->code + JIT_CODE_SIZE)
+            block->native = NULL;
+        block->hits = 0;
+        block->nojit = false;
+    }
+    jit->used = 0;
+}
+
+static void
+_jit_compile(jit_t *jit, bcache_block_t *block)
+{
+    /* make room */
+    if (JIT_CODE_SIZE - jit->used < JIT_MAX_BLOCK_SIZE)
+        _jit_flush(jit);
+
+    jit_asm_t a;
+    a.p = jit->code + jit->used;
+
+    /* the epilogue goes first, so that every exit can jump back to it */
+    a.epilogue = a.p;
+    _emit_epilogue(&a);
+    uint8_t *entry = a.p;
+    _emit_prologue(&a);
+
+    /* translate as much as we can */
+    unsigned cycles = 0, i;
+    bool ends = false;
+    for (i = 0; i < block->len && !ends; ++i) {
+        int c = _jit_emit_instr(&a, jit, block, i, cycles, &ends);
+        if (c < 0)
+            break;
+        cycles += c;
+    }
+
+    /* not even the first instruction could be translated */
+    if (!i) {
+        block->nojit = true;
+        return;
+    }
+
+    /* the interpreter continues from where we stopped */
+    if (!ends)
+        _emit_exit(&a, i < block->len ? block->pcs[i] : block->end, cycles, i);
+
+    assert(a.p - (jit->code + jit->used) <= JIT_MAX_BLOCK_SIZE);
+    jit->used = a.p - jit->code;
+    block->native = (bcache_native_t)entry;
+    block->native_cycles = cycles;
+    LOG(LOG_VERBOSE, "compiled block at 0x%04X:%u (%u instructions)",
+            block->pc, block->bank, i);
+}
+
+/*
+ *      ** ENTRY POINT **
+ */
+
+void
+jit_enter(jit_t *jit, bcache_block_t *block)
+{
+    /* wait for the block to be worth it */
+    if (block->nojit || ++block->hits < JIT_HOT)
+        return;
+
+    _jit_compile(jit, block);
+}
+
+void
+jit_init(jit_t *jit, soc_t *soc)
+{
+    /* set up SoC */
+    jit->soc = soc;
+
+    /* the native code buffer */
+    jit->code = mmap(NULL, JIT_CODE_SIZE, PROT_READ | PROT_WRITE | PROT_EXEC,
+            MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (jit->code == MAP_FAILED)
+        gb_die(errno);
+    jit->used = 0;
+}
+
+void
+jit_deinit(jit_t *jit)
+{
+    munmap(jit->code, JIT_CODE_SIZE);
+}
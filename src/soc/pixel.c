@@ -0,0 +1,166 @@
+#include "soc/pixel.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define PIXEL_X86
+#endif
+
+/* put color ID i of x (bits 2i and 2i + 1) in byte i (in memory) */
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+#define UNPACK_BYTE(i)      (8 * (i))
+#elif __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+#define UNPACK_BYTE(i)      (24 - 8 * (i))
+#else
+#error "Byte order is unknown"
+#endif
+#define UNPACK_ID(x, i) ((uint32_t)(((x) >> (2 * (i))) & 3) << UNPACK_BYTE(i))
+#define UNPACK(x)                                                           \
+    (UNPACK_ID(x, 0) | UNPACK_ID(x, 1) | UNPACK_ID(x, 2) | UNPACK_ID(x, 3))
+
+/* put bit 7 - i of x in bit 2i */
+#define INTERLEAVE_BIT(x, i) ((uint16_t)(((x) >> (7 - (i))) & 1) << (2 * (i)))
+#define INTERLEAVE(x)                                                       \
+    (INTERLEAVE_BIT(x, 0) | INTERLEAVE_BIT(x, 1) | INTERLEAVE_BIT(x, 2) |   \
+     INTERLEAVE_BIT(x, 3) | INTERLEAVE_BIT(x, 4) | INTERLEAVE_BIT(x, 5) |   \
+     INTERLEAVE_BIT(x, 6) | INTERLEAVE_BIT(x, 7))
+
+/* a table of f(x) for every byte */
+#define TABLE4(f, x)    f(x), f(x + 1), f(x + 2), f(x + 3)
+#define TABLE16(f, x)                                                       \
+    TABLE4(f, x), TABLE4(f, x + 4), TABLE4(f, x + 8), TABLE4(f, x + 12)
+#define TABLE64(f, x)                                                       \
+    TABLE16(f, x), TABLE16(f, x + 16), TABLE16(f, x + 32), TABLE16(f, x + 48)
+#define TABLE256(f)                                                         \
+    TABLE64(f, 0), TABLE64(f, 64), TABLE64(f, 128), TABLE64(f, 192)
+
+const uint16_t pixel_interleave[256] = { TABLE256(INTERLEAVE) };
+const uint32_t pixel_unpack[256] = { TABLE256(UNPACK) };
+
+static void
+_shade_scalar(uint8_t *dst, const uint8_t *ids, size_t n, const uint8_t lut[4])
+{
+    for (size_t i = 0; i < n; ++i)
+        dst[i] = lut[ids[i]];
+}
+
+static void
+_color_scalar(uint32_t *dst, const uint8_t *shades, size_t n,
+        const uint32_t colors[4])
+{
+    for (size_t i = 0; i < n; ++i)
+        dst[i] = colors[shades[i]];
+}
+
+static const pixel_kernels_t _scalar = {
+    .shade = _shade_scalar,
+    .color = _color_scalar,
+};
+
+#ifdef PIXEL_X86
+
+__attribute__((target("ssse3")))
+static void
+_shade_ssse3(uint8_t *dst, const uint8_t *ids, size_t n, const uint8_t lut[4])
+{
+    /* the 4 entries are a shuffle table of their own */
+    uint32_t entries;
+    memcpy(&entries, lut, sizeof(entries));
+    __m128i table = _mm_cvtsi32_si128(entries);
+
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(ids + i));
+        _mm_storeu_si128((__m128i *)(dst + i), _mm_shuffle_epi8(table, v));
+    }
+
+    _shade_scalar(dst + i, ids + i, n - i, lut);
+}
+
+__attribute__((target("ssse3")))
+static void
+_color_ssse3(uint32_t *dst, const uint8_t *shades, size_t n,
+        const uint32_t colors[4])
+{
+    /* the 4 colors make up the table. every pixel picks the 4 bytes of its
+     * own, from 4 * shade to 4 * shade + 3 */
+    __m128i table = _mm_loadu_si128((const __m128i *)colors);
+    const __m128i spread = _mm_set_epi8(3, 3, 3, 3, 2, 2, 2, 2,
+            1, 1, 1, 1, 0, 0, 0, 0);
+    const __m128i bytes = _mm_set1_epi32(0x03020100);
+
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        uint32_t four;
+        memcpy(&four, shades + i, sizeof(four));
+        __m128i idx = _mm_shuffle_epi8(_mm_cvtsi32_si128(four), spread);
+        idx = _mm_add_epi8(_mm_slli_epi32(idx, 2), bytes);
+        _mm_storeu_si128((__m128i *)(dst + i), _mm_shuffle_epi8(table, idx));
+    }
+
+    _color_scalar(dst + i, shades + i, n - i, colors);
+}
+
+static const pixel_kernels_t _ssse3 = {
+    .shade = _shade_ssse3,
+    .color = _color_ssse3,
+};
+
+__attribute__((target("avx2")))
+static void
+_shade_avx2(uint8_t *dst, const uint8_t *ids, size_t n, const uint8_t lut[4])
+{
+    /* same as SSSE3, with the table in both halves */
+    uint32_t entries;
+    memcpy(&entries, lut, sizeof(entries));
+    __m256i table = _mm256_broadcastsi128_si256(_mm_cvtsi32_si128(entries));
+
+    size_t i = 0;
+    for (; i + 32 <= n; i += 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i *)(ids + i));
+        _mm256_storeu_si256((__m256i *)(dst + i),
+                _mm256_shuffle_epi8(table, v));
+    }
+
+    _shade_ssse3(dst + i, ids + i, n - i, lut);
+}
+
+__attribute__((target("avx2")))
+static void
+_color_avx2(uint32_t *dst, const uint8_t *shades, size_t n,
+        const uint32_t colors[4])
+{
+    /* the colors are picked by 32-bit lane, 8 at a time */
+    __m256i table =
+        _mm256_castsi128_si256(_mm_loadu_si128((const __m128i *)colors));
+
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m128i eight = _mm_loadl_epi64((const __m128i *)(shades + i));
+        __m256i idx = _mm256_cvtepu8_epi32(eight);
+        _mm256_storeu_si256((__m256i *)(dst + i),
+                _mm256_permutevar8x32_epi32(table, idx));
+    }
+
+    _color_scalar(dst + i, shades + i, n - i, colors);
+}
+
+static const pixel_kernels_t _avx2 = {
+    .shade = _shade_avx2,
+    .color = _color_avx2,
+};
+
+#endif /* PIXEL_X86 */
+
+const pixel_kernels_t *
+pixel_kernels(void)
+{
+#ifdef PIXEL_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+        return &_avx2;
+    if (__builtin_cpu_supports("ssse3"))
+        return &_ssse3;
+#endif /* PIXEL_X86 */
+
+    return &_scalar;
+}
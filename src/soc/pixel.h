@@ -0,0 +1,51 @@
+#ifndef __PIXEL_H
+#define __PIXEL_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+/* the pixel kernels shared by the renderers. a tile row is packed and unpacked
+ * with lookup tables, while palettes and colors are applied to whole runs of
+ * pixels at once, with whatever vector instructions the host has */
+
+/* the bits of a byte spread out to every other bit, the most significant one
+ * lowest */
+extern const uint16_t pixel_interleave[256];
+
+/* 4 color IDs of 2 bits each, spread out to one per byte, the lowest first in
+ * memory */
+extern const uint32_t pixel_unpack[256];
+
+/* pack the 8 color IDs of a tile row from its two bitplanes, 2 bits each, the
+ * leftmost pixel lowest */
+static inline uint16_t
+pixel_pack_row(uint8_t low, uint8_t high)
+{
+    return pixel_interleave[low] | pixel_interleave[high] << 1;
+}
+
+/* unpack a row to one color ID per byte, the leftmost pixel first */
+static inline void
+pixel_unpack_row(uint8_t *row, uint16_t packed)
+{
+    uint32_t left = pixel_unpack[packed & 0xFF];
+    uint32_t right = pixel_unpack[packed >> 8];
+    memcpy(row, &left, sizeof(left));
+    memcpy(row + 4, &right, sizeof(right));
+}
+
+typedef struct pixel_kernels {
+    /* dst[i] = lut[ids[i]], with IDs from 0 to 3 */
+    void (*shade)(uint8_t *dst, const uint8_t *ids, size_t n,
+                  const uint8_t lut[4]);
+
+    /* dst[i] = colors[shades[i]], with shades from 0 to 3 */
+    void (*color)(uint32_t *dst, const uint8_t *shades, size_t n,
+                  const uint32_t colors[4]);
+} pixel_kernels_t;
+
+/* the best kernels for this CPU */
+const pixel_kernels_t *pixel_kernels(void);
+
+#endif /* __PIXEL_H */
@@ -1,3 +1,4 @@
+#include "soc/pixel.h"
 #include "soc/soc.h"
 #include "log.h"
 
@@ -13,69 +14,60 @@
 #define BLACK       0x0F380FFF
 #endif
 
+static inline bool
+_get_stat_lyc(ppu_t *ppu)
+{
+    return ppu->lyc_int_enabled && ppu->ly == ppu->lyc;
+}
+
 static inline void
 _check_lyc_stat_interrupt(ppu_t *ppu)
 {
-    if (ppu->lyc_int_enabled && ppu->ly == ppu->lyc)
-        ppu->stat_lyc = true;
-    else
-        ppu->stat_lyc = false;
+    ppu->stat_lyc = _get_stat_lyc(ppu);
 }
 
-static inline pixel_t
-_get_pixel_with_palette_and_color_id(uint8_t palette, uint8_t color_id)
+static inline bool
+_is_bg_queue_empty(ppu_t *ppu)
 {
-    assert(color_id < 4);
-    pixel_t ret;
-    uint8_t color = (palette >> (color_id * 2)) & 0x03;
-    switch (color) {
-        case 0x00:
-            ret.val = WHITE;
-            break;
-        case 0x01:
-            ret.val = LIGHT_GRAY;
-            break;
-        case 0x02:
-            ret.val = DARK_GRAY;
-            break;
-        case 0x03:
-            ret.val = BLACK;
-            break;
-    }
+    return ppu->bg_queue_idx >= 8;
+}
 
-    return ret;
+/* the two bitplanes of a tile row, laid out like the queues */
+static inline uint16_t
+_queue_planes(uint8_t low, uint8_t high)
+{
+    return (uint16_t)high << 8 | low;
 }
 
-static void
-_extract_color_ids_from_bitplane(uint8_t *row, uint8_t low, uint8_t high)
-{
-    for (size_t i = 0; i < 8; ++i) {
-        size_t bit_idx = 7 - i;
-        uint8_t low_bit = (low >> bit_idx) & 0x01;
-        uint8_t high_bit = (high >> bit_idx) & 0x01;
-        row[i] = (high_bit << 1) | low_bit;
-        LOG(LOG_VERBOSE, "extracted color ID: 0x%02X2", row[i]);
-    }
+/* the color ID of the next pixel out of a queue */
+static inline uint8_t
+_queue_head(uint16_t queue)
+{
+    return ((queue >> 7) & 0x01) | ((queue >> 14) & 0x02);
 }
 
-static inline bool
-_is_bg_queue_empty(ppu_t *ppu)
+/* shift a queue by one pixel, with a transparent one coming in. each plane is
+ * shifted on its own */
+static inline uint16_t
+_queue_shift(uint16_t queue)
 {
-    return ppu->bg_queue_idx >= 8;
+    return (queue << 1) & 0xFEFE;
+}
+
+/* the pixels of a queue that aren't transparent, one bit each */
+static inline uint8_t
+_queue_opaque(uint16_t queue)
+{
+    return (queue | queue >> 8) & 0xFF;
 }
 
 static inline void
 _shift_obj_queues(ppu_t *ppu)
 {
-    /* shift all pixels to the left and put 0x00 as the last byte */
-    for (size_t i = 1; i < 8; ++i)
-        ppu->obj_queue[i - 1] = ppu->obj_queue[i];
-    ppu->obj_queue[7] = 0x00;
-
-    /* shift the obj attributes also */
-    for (size_t i = 1; i < 8; ++i)
-        ppu->obj_attrs[i - 1] = ppu->obj_attrs[i];
-    ppu->obj_attrs[7] = 0x00;
+    /* shift all pixels to the left, with null attributes coming in */
+    ppu->obj_queue = _queue_shift(ppu->obj_queue);
+    ppu->obj_prio <<= 1;
+    ppu->obj_palette <<= 1;
 }
 
 static inline void
@@ -83,16 +75,110 @@ _go_to_oamscan(ppu_t *ppu)
 {
     /* get ready for OAMSCAN */
     ppu->mode = PPU_OAMSCAN;
-    ppu->cycles_to_waste = 1;
+    soc_bus_transition(ppu->soc);
     ppu->cur_oam_idx = 0;
     ppu->cur_objs = 0;
+
+    /* the scan reads an object every 2 cycles. unless DMA takes OAM away
+     * halfway through, they can all be looked up at the end instead */
+    dma_t *dma = ppu->soc->dma;
+    ppu->whole_scan = !dma->requested && !dma->pending;
+    ppu->cycles_to_waste = ppu->whole_scan ? 79 : 1;
+}
+
+/* sort objects by X, the ones on the same X staying in OAM order, and mark
+ * where they are */
+static void
+_sort_objs(obj_store_entry_t *objs, size_t n, uint64_t xmap[3])
+{
+    memset(xmap, 0, 3 * sizeof(*xmap));
+    for (size_t i = 0; i < n; ++i) {
+        obj_store_entry_t obj = objs[i];
+        size_t j = i;
+        for (; j > 0 && objs[j - 1].x_pos > obj.x_pos; --j)
+            objs[j] = objs[j - 1];
+        objs[j] = obj;
+
+        if (obj.x_pos < 192)
+            xmap[obj.x_pos / 64] |= (uint64_t)1 << (obj.x_pos % 64);
+    }
+}
+
+/* the lines an object with the given OAM Y is on have to be picked again */
+static void
+_obj_index_touch(obj_index_t *idx, uint8_t y)
+{
+    for (int ly = y - 16; ly < y; ++ly)
+        if (ly >= 0 && ly < SCREEN_HEIGHT)
+            idx->dirty[ly / 64] |= (uint64_t)1 << (ly % 64);
+}
+
+/* put an object with the given OAM Y on the lines it's on, or take it off */
+static void
+_obj_index_move(obj_index_t *idx, unsigned obj, uint8_t y, bool on)
+{
+    uint64_t bit = (uint64_t)1 << obj;
+    for (int ly = y - 16; ly < y; ++ly) {
+        if (ly < 0 || ly >= SCREEN_HEIGHT)
+            continue;
+
+        /* the first 8 lines are covered by both heights */
+        for (unsigned tall = ly >= y - 8; tall < 2; ++tall) {
+            if (on)
+                idx->on_line[tall][ly] |= bit;
+            else
+                idx->on_line[tall][ly] &= ~bit;
+        }
+    }
+    _obj_index_touch(idx, y);
+}
+
+/* the objects on the current line, looked up in the index */
+static void
+_obj_index_pick(ppu_t *ppu)
+{
+    assert(ppu->ly < SCREEN_HEIGHT);
+    obj_index_t *idx = &ppu->obj_index;
+    obj_line_t *line = &idx->lines[ppu->ly];
+    const uint8_t *oam = ppu->soc->oam;
+    unsigned height = LCDC_OBJ_SIZE(ppu->lcdc) ? 16 : 8;
+    uint64_t bit = (uint64_t)1 << (ppu->ly % 64);
+
+    /* every line has other objects on it at the other height */
+    if (idx->height != height) {
+        memset(idx->dirty, 0xFF, sizeof(idx->dirty));
+        idx->height = height;
+    }
+
+    /* the line is picked again just like the scan would: the first 10 objects
+     * on it, in OAM order */
+    if (idx->dirty[ppu->ly / 64] & bit) {
+        uint64_t on = idx->on_line[height == 16][ppu->ly];
+        line->count = 0;
+        for (; on && line->count < PPU_LINE_OBJS; on &= on - 1)
+            line->objs[line->count++] = __builtin_ctzll(on);
+        idx->dirty[ppu->ly / 64] &= ~bit;
+    }
+
+    /* the sprite store gets them as the scan leaves them */
+    for (size_t i = 0; i < line->count; ++i) {
+        unsigned obj = line->objs[i];
+        ppu->objs[i].x_pos = oam[obj * 4 + 1];
+        ppu->objs[i].tile_row = ppu->ly + 16 - oam[obj * 4];
+        ppu->objs[i].obj_idx = obj;
+    }
+    ppu->cur_objs = line->count;
+    _sort_objs(ppu->objs, ppu->cur_objs, ppu->obj_xmap);
+
+    /* the next time, they're already sorted */
+    for (size_t i = 0; i < line->count; ++i)
+        line->objs[i] = ppu->objs[i].obj_idx;
 }
 
 static inline void
-_go_to_render(ppu_t *ppu)
+_reset_fifos(ppu_t *ppu)
 {
-    /* get ready for RENDER */
-    ppu->mode = PPU_RENDER;
+    /* get the fetcher and the pusher ready for a new line */
     ppu->fetcher_mode = PPU_FETCHER_FETCH;
     ppu->sprite_fetch = false;
     ppu->cycles_to_waste = 1;
@@ -105,13 +191,110 @@ _go_to_render(ppu_t *ppu)
     ppu->sprite_hit = false;
     ppu->render_cycles = 0;
 
-    /* init obj queue with transparent object pixels */
-    for (size_t i = 0; i < 8; ++i)
-        ppu->obj_queue[i] = 0x00;
+    /* init obj queue with transparent object pixels and null attributes */
+    ppu->obj_queue = 0;
+    ppu->obj_prio = ppu->obj_palette = 0;
+}
+
+/* the objects the fetcher actually goes for (see _line_render_cycles), in the
+ * order it does. returns how many there are */
+static size_t
+_line_objs(ppu_t *ppu, size_t *order)
+{
+    size_t n = 0;
+    for (size_t i = 0; i < ppu->cur_objs; ++i) {
+        unsigned x = ppu->objs[i].x_pos;
+        if (x == 0 || x > 167)
+            continue;
+
+        /* an object on the same X as an earlier one is never fetched: the
+         * pusher moves on as soon as the first one is merged. they're sorted
+         * by X already, so that's the one right before */
+        if (n && ppu->objs[order[n - 1]].x_pos == x)
+            continue;
+        order[n++] = i;
+    }
+
+    return n;
+}
+
+/* how long the FIFOs take to push the current line. this is exactly what
+ * _ppu_render() ends up with, worked out in one go.
+ *
+ * without objects, the first pixel comes out after 6 cycles and then one comes
+ * out every cycle: SCX % 8 thrown away and the 168 of the line (8 offscreen).
+ * the fetcher refills the BG queue whenever it runs dry and has fetched the
+ * next tile 6 cycles later.
+ *
+ * an object stops the pusher until the fetcher has fetched it too, 6 cycles
+ * after it's done with the BG tile in progress. how long that is depends on
+ * where the BG queue is (the index p of the last pixel out). right after an
+ * object, the next tile is already fetched until the queue is refilled */
+static unsigned
+_line_render_cycles(ppu_t *ppu, const size_t *order, size_t n)
+{
+    unsigned discard = ppu->scx & 0x07;
+    unsigned cycles = 174 + discard;
+
+    /* the pusher call at which the BG queue is refilled with the tile already
+     * fetched */
+    unsigned refill = 0;
+
+    /* objects on X = 0 are hit before anything is pushed, so the fetcher goes
+     * through two BG tiles first. after that, another one is hit after every
+     * pixel thrown away */
+    size_t zeros = 0;
+    for (size_t i = 0; i < ppu->cur_objs; ++i)
+        zeros += ppu->objs[i].x_pos == 0;
+    if (zeros > discard + 1)
+        zeros = discard + 1;
+    if (zeros) {
+        cycles += 12 + 6 * (zeros - 1);
+        refill = 8;
+    }
+
+    for (size_t i = 0; i < n; ++i) {
+        /* the pusher call which brought LX to the object's X */
+        unsigned c = ppu->objs[order[i]].x_pos + discard - 1;
+        unsigned p = c & 0x07;
+
+        if (p == 7)
+            /* the queue ran dry, so it's refilled and a new tile fetched */
+            cycles += 12;
+        else if (c < refill || p >= 6)
+            /* the next tile is already there */
+            cycles += 6;
+        else
+            /* the tile in progress has to be finished first */
+            cycles += 11 - p;
+
+        refill = ((c + 1) & ~0x07) + 8;
+    }
+
+    return cycles;
+}
+
+static inline void
+_go_to_render(ppu_t *ppu)
+{
+    /* get ready for RENDER */
+    ppu->mode = PPU_RENDER;
+    soc_bus_transition(ppu->soc);
+
+    /* DMA might take the buses away from the PPU halfway through the line, so
+     * only draw it at once if it's nowhere to be seen */
+    dma_t *dma = ppu->soc->dma;
+    ppu->whole_line = !dma->requested && !dma->pending;
+    if (!ppu->whole_line) {
+        _reset_fifos(ppu);
+        return;
+    }
 
-    /* init obj attribute queue with null attributes */
-    for (size_t i = 0; i < 8; ++i)
-        ppu->obj_attrs[i] = 0x00;
+    /* otherwise, just wait for the end of the line */
+    size_t order[10];
+    size_t n = _line_objs(ppu, order);
+    ppu->render_cycles = _line_render_cycles(ppu, order, n);
+    ppu->cycles_to_waste = ppu->render_cycles - 1;
 }
 
 static inline void
@@ -119,6 +302,7 @@ _go_to_hblank(ppu_t *ppu)
 {
     /* get ready for HBLANK */
     ppu->mode = PPU_HBLANK;
+    soc_bus_transition(ppu->soc);
     ppu->cycles_to_waste = 375 - ppu->render_cycles;
 }
 
@@ -127,6 +311,7 @@ _go_to_vblank(ppu_t *ppu)
 {
     /* get ready for VBLANK */
     ppu->mode = PPU_VBLANK;
+    soc_bus_transition(ppu->soc);
     ppu->cycles_to_waste = 455;
     soc_interrupt(ppu->soc, INT_VBLANK);
 }
@@ -175,6 +360,13 @@ _ppu_oamscan(ppu_t *ppu)
     /* if there are more cycles to waste, do it and return */
     WASTE_CYCLES(ppu);
 
+    /* a scan done at once only has to look the objects up */
+    if (ppu->whole_scan) {
+        _obj_index_pick(ppu);
+        _go_to_render(ppu);
+        return;
+    }
+
     /* current OAM address */
     uint8_t cur_addr = ppu->cur_oam_idx * 4;
     assert(cur_addr < 0xA0);
@@ -187,7 +379,7 @@ _ppu_oamscan(ppu_t *ppu)
 
     /* if we can add another object AND the object is within our reach, add it
      * */
-    if (ppu->cur_objs < 10 && ppu->ly >= obj_y_pos &&
+    if (ppu->cur_objs < PPU_LINE_OBJS && ppu->ly >= obj_y_pos &&
             ppu->ly < obj_y_pos + obj_size) {
         /* the X coordinate is the obj's X coord - 8 */
         ppu->objs[ppu->cur_objs].x_pos =
@@ -204,10 +396,13 @@ _ppu_oamscan(ppu_t *ppu)
 
     /* increase cur_oam_idx and waste 1 cycle. if cur_oam_idx is becomes 40, we
      * just exit */
-    if (++ppu->cur_oam_idx > 39)
+    if (++ppu->cur_oam_idx > 39) {
+        /* the matchers want them by X */
+        _sort_objs(ppu->objs, ppu->cur_objs, ppu->obj_xmap);
         _go_to_render(ppu);
-    else
+    } else {
         ppu->cycles_to_waste = 1;
+    }
 }
 
 static bool
@@ -221,8 +416,7 @@ _try_fill_bg_queue(ppu_t *ppu)
         return false;
 
     /* set BG queue */
-    for (size_t i = 0; i < 8; ++i)
-        ppu->bg_queue[i] = ppu->tmp_reg[i];
+    ppu->bg_queue = ppu->tmp_reg;
 
     /* BG queue is now not empty and tmp reg is not full */
     ppu->bg_queue_idx = 0;
@@ -297,7 +491,7 @@ _ppu_fetcher_fetch(ppu_t *ppu)
 }
 
 static inline uint16_t
-_get_bg_tile_address(ppu_t *ppu)
+_get_tile_address(ppu_t *ppu, uint8_t tile_id)
 {
     /* formulate the tile address */
     uint16_t addr = 0x8000;
@@ -305,11 +499,10 @@ _get_bg_tile_address(ppu_t *ppu)
     /* bit 12 depends on the addressing mode. if we are in 0x8000 mode, it is
      * always set. otherwise, if we are in 0x8800 mode, it is the negation of
      * tile ID's bit 7 */
-    addr |=
-        (!((LCDC_BGWIN_TILES(ppu->lcdc) || (ppu->cur_tile_id & 0x80)))) << 12;
+    addr |= (!((LCDC_BGWIN_TILES(ppu->lcdc) || (tile_id & 0x80)))) << 12;
 
     /* put the tile ID in the address */
-    addr |= ppu->cur_tile_id << 4;
+    addr |= tile_id << 4;
 
     /* put the tile's row (Y coord) in the address */
     addr |= ((ppu->ly + ppu->scy) & 0x07) << 1;
@@ -317,6 +510,12 @@ _get_bg_tile_address(ppu_t *ppu)
     return addr;
 }
 
+static inline uint16_t
+_get_bg_tile_address(ppu_t *ppu)
+{
+    return _get_tile_address(ppu, ppu->cur_tile_id);
+}
+
 static inline uint16_t
 _get_obj_tile_address(ppu_t *ppu)
 {
@@ -354,17 +553,16 @@ _ppu_fetcher_tile_low(ppu_t *ppu)
 static void
 _merge_into_obj_queue(ppu_t *ppu)
 {
-    uint8_t cur_obj_pixels[8];
-    _extract_color_ids_from_bitplane(cur_obj_pixels, ppu->cur_tile_low,
-            ppu->cur_tile_high);
-
-    /* merge only if the currently queued pixel is transparent (color ID: 0) */
-    for (size_t i = 0; i < 8; ++i) {
-        if (ppu->obj_queue[i] == 0) {
-            ppu->obj_queue[i] = cur_obj_pixels[i];
-            ppu->obj_attrs[i] = ppu->cur_fetched_obj_attrs;
-        }
-    }
+    /* merge only where the currently queued pixel is transparent (color ID:
+     * 0), all 8 pixels at once */
+    uint8_t room = ~_queue_opaque(ppu->obj_queue);
+    uint8_t attrs = ppu->cur_fetched_obj_attrs;
+    ppu->obj_queue |= _queue_planes(ppu->cur_tile_low & room,
+            ppu->cur_tile_high & room);
+    ppu->obj_prio = (ppu->obj_prio & ~room) |
+        (OBJ_ATTR_PRIORITY(attrs) ? room : 0);
+    ppu->obj_palette = (ppu->obj_palette & ~room) |
+        (OBJ_ATTR_PALETTE(attrs) ? room : 0);
 }
 
 static void
@@ -396,8 +594,7 @@ _ppu_fetcher_tile_high_push(ppu_t *ppu)
         ppu->fetcher_mode = PPU_FETCHER_SLEEP;
     } else {
         /* put the pixels in the tmp register */
-        _extract_color_ids_from_bitplane(ppu->tmp_reg, ppu->cur_tile_low,
-                ppu->cur_tile_high);
+        ppu->tmp_reg = _queue_planes(ppu->cur_tile_low, ppu->cur_tile_high);
         ppu->tmp_reg_full = true;
 
         /* for a succesful fill, fetcher goes back immediately to FETCH after
@@ -442,27 +639,26 @@ static void
 _ppu_pusher(ppu_t *ppu)
 {
     /* white default pixel */
-    pixel_t px;
-    px.val = 0xFFFFFFFF;
+    uint8_t px = 0;
 
     /* try to get BG pixel (queue is always clocked forward) */
-    size_t old_bg_queue_idx = ppu->bg_queue_idx;
-    uint8_t bg_color = ppu->bg_queue[ppu->bg_queue_idx++];
+    size_t old_bg_queue_idx = ppu->bg_queue_idx++;
+    uint8_t bg_color = _queue_head(ppu->bg_queue);
+    ppu->bg_queue = _queue_shift(ppu->bg_queue);
 
     /* use this pixel and mix it with the object below */
     if (LCDC_BGWIN_ENABLE(ppu->lcdc))
-        px = _get_pixel_with_palette_and_color_id(ppu->bgp, bg_color);
+        px = ppu->bgp_shades[bg_color];
 
     /* extract pixel from obj queue if sprites are enabled. TODO: is obj queue
      * shifted even if disabled? */
     if (LCDC_OBJ_ENABLE(ppu->lcdc)) {
-        uint8_t obj_color = ppu->obj_queue[0];
-        uint8_t obj_attrs = ppu->obj_attrs[0];
+        uint8_t obj_color = _queue_head(ppu->obj_queue);
+        bool obj_prio = ppu->obj_prio & 0x80;
+        unsigned obj_palette = (ppu->obj_palette >> 7) & 0x01;
         _shift_obj_queues(ppu);
-        if (!(OBJ_ATTR_PRIORITY(obj_attrs) && bg_color == 0) && obj_color != 0) {
-            uint8_t obj_palette = OBJ_ATTR_PALETTE(obj_attrs) ? ppu->obp1 : ppu->obp0;
-            px = _get_pixel_with_palette_and_color_id(obj_palette, obj_color);
-        }
+        if (!(obj_prio && bg_color == 0) && obj_color != 0)
+            px = ppu->obp_shades[obj_palette][obj_color];
     }
 
     /* if we just started (offscreen lx == 0), first discard first (SCX % 8)
@@ -476,14 +672,97 @@ _ppu_pusher(ppu_t *ppu)
 
     /* increase LX */
     ++ppu->lx;
+}
 
-    /* reset the next object to fetch, since we are in a new X coord */
-    ppu->next_obj_to_check = 0;
+static void
+_tile_row(ppu_t *ppu, uint16_t addr, uint8_t *row)
+{
+    /* addr is that of the row's low byte, as the fetcher would read it */
+    tile_cache_t *tiles = &ppu->tiles;
+    unsigned tile = (addr & 0x1FFF) >> 4;
+    uint64_t bit = (uint64_t)1 << (tile % 64);
+
+    /* decode the whole tile if it was written to since last time */
+    if (tiles->dirty[tile / 64] & bit) {
+        uint16_t base = 0x8000 + tile * 16;
+        for (size_t i = 0; i < 8; ++i)
+            tiles->rows[tile][i] = pixel_pack_row(
+                    soc_vid_bus_read(ppu->soc, PRIO_PPU, base + i * 2, false),
+                    soc_vid_bus_read(ppu->soc, PRIO_PPU, base + i * 2 + 1,
+                        false));
+        tiles->dirty[tile / 64] &= ~bit;
+    }
+
+    /* the row's color IDs, one per byte */
+    pixel_unpack_row(row, tiles->rows[tile][(addr >> 1) & 0x07]);
+}
+
+static void
+_ppu_draw_line(ppu_t *ppu)
+{
+    /* the color IDs of the whole line, as the FIFOs would push them. the BG
+     * tiles start from the one SCX falls in */
+    uint8_t ids[SCREEN_WIDTH + 8];
+    const uint8_t *bg = ids + (ppu->scx & 0x07);
+
+    /* the objects start 8 pixels to the left of the screen and the last ones
+     * can hang 8 pixels off the right */
+    uint8_t obj[SCREEN_WIDTH + 16] = { 0 }, attrs[SCREEN_WIDTH + 16] = { 0 };
+
+    uint16_t map = LCDC_BG_TILEMAP(ppu->lcdc) ? 0x9C00 : 0x9800;
+    map |= (((ppu->ly + ppu->scy) / 8) & 0x1F) << 5;
+    for (unsigned i = 0; i < SCREEN_WIDTH / 8 + 1; ++i) {
+        uint8_t id = soc_vid_bus_read(ppu->soc, PRIO_PPU,
+                map | ((ppu->scx / 8 + i) & 0x1F), false);
+        _tile_row(ppu, _get_tile_address(ppu, id), ids + i * 8);
+    }
+
+    /* objects go in the order they're fetched, only over transparent pixels.
+     * the fetcher reads their rows just like BG ones. the ones on X = 0 are
+     * entirely offscreen, so they can't cover anything that's shown */
+    size_t order[10];
+    size_t n = LCDC_OBJ_ENABLE(ppu->lcdc) ? _line_objs(ppu, order) : 0;
+    for (size_t i = 0; i < n; ++i) {
+        obj_store_entry_t *entry = &ppu->objs[order[i]];
+        uint8_t id = soc_oam_read(ppu->soc, PRIO_PPU, entry->obj_idx * 4 + 2);
+        uint8_t attr = soc_oam_read(ppu->soc, PRIO_PPU,
+                entry->obj_idx * 4 + 3);
+        uint8_t row[8];
+        _tile_row(ppu, _get_tile_address(ppu, id), row);
+        for (size_t j = 0; j < 8; ++j) {
+            if (!obj[entry->x_pos + j]) {
+                obj[entry->x_pos + j] = row[j];
+                attrs[entry->x_pos + j] = attr;
+            }
+        }
+    }
+
+    /* BG goes through its palette all at once. with BG off, it's all white,
+     * but its color IDs still matter to the objects */
+    static const uint8_t white[4] = { 0 };
+    uint8_t *line = ppu->screen[ppu->ly];
+    ppu->kernels->shade(line, bg, SCREEN_WIDTH,
+            LCDC_BGWIN_ENABLE(ppu->lcdc) ? ppu->bgp_shades : white);
+
+    /* then the objects are mixed in like the pusher does */
+    for (size_t x = 0; x < SCREEN_WIDTH && n; ++x) {
+        uint8_t obj_color = obj[x + 8], obj_attrs = attrs[x + 8];
+        if (!(OBJ_ATTR_PRIORITY(obj_attrs) && bg[x] == 0) && obj_color != 0)
+            line[x] = ppu->obp_shades[OBJ_ATTR_PALETTE(obj_attrs)][obj_color];
+    }
 }
 
 static void
 _ppu_render(ppu_t *ppu)
 {
+    /* a line drawn at once only has to wait for its end */
+    if (ppu->whole_line) {
+        WASTE_CYCLES(ppu);
+        _ppu_draw_line(ppu);
+        _go_to_hblank(ppu);
+        return;
+    }
+
     /* call the fetcher before the pusher, as the latter may use a fresh BG
      * queue push immediately */
     _ppu_fetcher(ppu);
@@ -507,24 +786,29 @@ _ppu_render(ppu_t *ppu)
     if (!_is_bg_queue_empty(ppu) && !ppu->sprite_hit)
         _ppu_pusher(ppu);
 
-    /* check for sprites in the current X value if none is hit currently */
-    for (size_t i = ppu->next_obj_to_check;
-            i < ppu->cur_objs && !ppu->sprite_hit; ++i) {
-        if (ppu->objs[i].x_pos == ppu->lx) {
-            ppu->cur_fetched_obj = i;
-            ppu->next_obj_to_check = i + 1;
-            ppu->sprite_hit = true;
-            break;
-        }
+    /* check for sprites in the current X value if none is hit currently. they
+     * are sorted by X, so the ones behind LX are skipped for good */
+    unsigned lx = ppu->lx;
+    if (ppu->sprite_hit ||
+            !(ppu->obj_xmap[lx / 64] & (uint64_t)1 << (lx % 64)))
+        return;
+
+    size_t i = ppu->next_obj_to_check;
+    while (i < ppu->cur_objs && ppu->objs[i].x_pos < lx)
+        ++i;
+    if (i < ppu->cur_objs && ppu->objs[i].x_pos == lx) {
+        ppu->cur_fetched_obj = i;
+        ppu->sprite_hit = true;
+        ++i;
     }
+    ppu->next_obj_to_check = i;
 }
 
-static inline void
-_calculate_stat_mode(ppu_t *ppu)
+static inline bool
+_get_stat_mode(ppu_t *ppu)
 {
-    /* calculate STAT mode and set it. this function is called after changing
-     * the current mode */
-    bool stat_int = false; 
+    /* calculate STAT mode line from the currently visible mode */
+    bool stat_int = false;
     switch (ppu->visible_mode) {
         case PPU_HBLANK:
             /* HBLANK must wait 1 cycle first */
@@ -545,8 +829,121 @@ _calculate_stat_mode(ppu_t *ppu)
             break;
     }
 
-    /* turn on or off the STAT line for mode */
-    ppu->stat_mode = stat_int;
+    return stat_int;
+}
+
+static inline void
+_calculate_stat_mode(ppu_t *ppu)
+{
+    /* turn on or off the STAT line for mode. this function is called after
+     * changing the current mode */
+    ppu->stat_mode = _get_stat_mode(ppu);
+}
+
+static inline bool
+_ppu_settled(ppu_t *ppu)
+{
+    /* the visible mode and the STAT lines lag one cycle behind */
+    return ppu->visible_mode == ppu->mode && !ppu->stat_written &&
+        ppu->stat_mode == _get_stat_mode(ppu) &&
+        ppu->stat_lyc == _get_stat_lyc(ppu);
+}
+
+unsigned
+ppu_next_event(ppu_t *ppu)
+{
+    /* if LCD is powered off, the CPU has to turn it back on */
+    if (!LCDC_PPU_ENABLE(ppu->lcdc))
+        return NO_EVENT;
+
+    /* the FIFOs push a pixel at every cycle */
+    if (ppu->mode == PPU_RENDER && !ppu->whole_line)
+        return 0;
+
+    /* let the lagging stuff settle before skipping anything */
+    if (!_ppu_settled(ppu))
+        return 0;
+
+    /* otherwise, the current mode is just waiting for its end */
+    return ppu->cycles_to_waste;
+}
+
+unsigned
+ppu_next_change(ppu_t *ppu)
+{
+    /* outside of the FIFOs, nothing changes in between events */
+    if (!LCDC_PPU_ENABLE(ppu->lcdc) || ppu->mode != PPU_RENDER ||
+            ppu->whole_line)
+        return ppu_next_event(ppu);
+
+    if (!_ppu_settled(ppu))
+        return 0;
+
+    /* the renderer can't end before it has pushed the rest of the line, one
+     * pixel per cycle at most. until then, LY, STAT and the interrupts stay
+     * the same */
+    return ppu->lx < 168 ? 168 - ppu->lx : 0;
+}
+
+void
+ppu_skip(ppu_t *ppu, unsigned cycles)
+{
+    if (!LCDC_PPU_ENABLE(ppu->lcdc))
+        return;
+
+    assert(cycles <= ppu->cycles_to_waste);
+    ppu->cycles_to_waste -= cycles;
+}
+
+void
+ppu_fallback(ppu_t *ppu)
+{
+    if (ppu->mode == PPU_OAMSCAN) {
+        /* read the objects the scan has gone through by now, one every 2
+         * cycles, with OAM as it was until now */
+        unsigned done = 79 - ppu->cycles_to_waste;
+        LOG(LOG_VERBOSE, "line %u scans OAM one by one after %u cycles",
+                ppu->ly, done);
+        ppu->whole_scan = false;
+        ppu->cycles_to_waste = 1;
+        for (unsigned i = 0; i < done; ++i)
+            _ppu_oamscan(ppu);
+
+        assert(ppu->mode == PPU_OAMSCAN);
+        return;
+    }
+
+    /* run the FIFOs through the part of the line that has gone by, with
+     * everything as it was until now */
+    unsigned done = ppu->render_cycles - 1 - ppu->cycles_to_waste;
+    LOG(LOG_VERBOSE, "line %u goes through the FIFOs after %u cycles",
+            ppu->ly, done);
+    ppu->whole_line = false;
+    _reset_fifos(ppu);
+    for (unsigned i = 0; i < done; ++i)
+        _ppu_render(ppu);
+
+    /* the line can't be over before the time that was worked out for it */
+    assert(ppu->mode == PPU_RENDER);
+}
+
+void
+ppu_oam_write(ppu_t *ppu, uint8_t addr, uint8_t val)
+{
+    /* only the positions matter to the scan */
+    const uint8_t *oam = ppu->soc->oam;
+    if (addr >= PPU_OBJS * 4 || oam[addr] == val)
+        return;
+
+    obj_index_t *idx = &ppu->obj_index;
+    if (addr % 4 == 0) {
+        /* the object moves to other lines */
+        _obj_index_move(idx, addr / 4, oam[addr], false);
+        _obj_index_move(idx, addr / 4, val, true);
+    } else if (addr % 4 == 1) {
+        /* the lines it's on are sorted differently */
+        _obj_index_touch(idx, oam[addr - 1]);
+    }
 }
 
 void
@@ -601,6 +998,17 @@ ppu_cycle(ppu_t *ppu)
         soc_interrupt(ppu->soc, INT_STAT);
 }
 
+void
+ppu_blit(ppu_t *ppu, void *dst, size_t pitch)
+{
+    /* the shades are only turned into colors when somebody looks at them */
+    static const uint32_t colors[4] = { WHITE, LIGHT_GRAY, DARK_GRAY, BLACK };
+    for (size_t y = 0; y < SCREEN_HEIGHT; ++y) {
+        uint32_t *row = (uint32_t *)((uint8_t *)dst + y * pitch);
+        ppu->kernels->color(row, ppu->screen[y], SCREEN_WIDTH, colors);
+    }
+}
+
 void
 ppu_init(ppu_t *ppu, soc_t *soc)
 {
@@ -621,12 +1029,27 @@ ppu_init(ppu_t *ppu, soc_t *soc)
     /* the initial viewport is 0x0 */
     ppu->scx = ppu->scy = 0;
 
+    /* no line is being drawn yet */
+    ppu->whole_line = ppu->whole_scan = false;
+
+    /* OAM starts out cleared, so no objects are on any line */
+    memset(&ppu->obj_index, 0, sizeof(ppu->obj_index));
+    memset(ppu->obj_index.dirty, 0xFF, sizeof(ppu->obj_index.dirty));
+    ppu->obj_index.height = 8;
+
     /* initial palette is 0xFC */
-    ppu->bgp = 0xFC;
+    ppu_write_palette(ppu, &ppu->bgp, ppu->bgp_shades, 0xFC);
 
     /* initial objects' palettes are uninitialized, but we're setting them to
      * 0xFF anyway */
-    ppu->obp0 = ppu->obp1 = 0xFF;
+    ppu_write_palette(ppu, &ppu->obp0, ppu->obp_shades[0], 0xFF);
+    ppu_write_palette(ppu, &ppu->obp1, ppu->obp_shades[1], 0xFF);
+
+    /* pick the pixel kernels once and for all */
+    ppu->kernels = pixel_kernels();
+
+    /* none of the tiles have been decoded yet */
+    memset(ppu->tiles.dirty, 0xFF, sizeof(ppu->tiles.dirty));
 
     /* initial window's position is 0 */
     ppu->wx = ppu->wy = 0;
@@ -636,7 +1059,7 @@ ppu_init(ppu_t *ppu, soc_t *soc)
     ppu->vblank_int_enabled = ppu->hblank_int_enabled = false;
 
     /* fill the screen with white pixels */
-    memset(ppu->screen, 0xFF, SCREEN_HEIGHT * SCREEN_WIDTH);
+    memset(ppu->screen, 0, sizeof(ppu->screen));
 
     /* initially, the two STAT sources are off */
     ppu->stat_mode = ppu->stat_lyc = false;
@@ -1,3 +1,4 @@
+#include "soc/cpu_common.h"
 #include "soc/soc.h"
 #include "log.h"
 
@@ -46,12 +47,159 @@ _get_oam_bus_priority(soc_t *soc)
     return PRIO_CPU;
 }
 
+static void
+_soc_map_bus(soc_t *soc, bus_t *bus, unsigned first, unsigned last, bool cs)
+{
+    /* ask the bus what's behind each page */
+    for (unsigned page = first; page <= last; ++page) {
+        uint16_t addr = page << 8;
+        soc->map.bus_read[page] = bus->map ? bus->map(bus, addr, cs, false) :
+            NULL;
+        soc->map.bus_write[page] = bus->map ? bus->map(bus, addr, cs, true) :
+            NULL;
+    }
+}
+
+static void
+_soc_map_cpu(soc_t *soc, unsigned first, unsigned last, bool owned)
+{
+    /* the CPU only goes straight to the memory of a bus it owns */
+    for (unsigned page = first; page <= last; ++page) {
+        soc->map.cpu_read[page] = owned ? soc->map.bus_read[page] : NULL;
+        soc->map.cpu_write[page] = owned ? soc->map.bus_write[page] : NULL;
+    }
+}
+
 static inline void
-_calculate_bus_priorities(soc_t *soc)
+_soc_map_ext(soc_t *soc)
+{
+    /* OAM and the high area never go through the map */
+    bool owned = soc->ext_prio == PRIO_CPU;
+    _soc_map_cpu(soc, 0x00, 0x7F, owned);
+    _soc_map_cpu(soc, 0xA0, 0xFD, owned);
+}
+
+static inline void
+_soc_map_vid(soc_t *soc)
+{
+    _soc_map_cpu(soc, 0x80, 0x9F, soc->vid_prio == PRIO_CPU);
+}
+
+/* the cart's windows in the map, as pages */
+static const struct {
+    unsigned first, last;
+    bool cs;
+} _cart_windows[SOC_CART_WINDOWS] = {
+    { 0x00, 0x3F, true },       /* ROM bank 0, which MBC1 can switch too */
+    { 0x40, 0x7F, true },       /* the switchable ROM bank */
+    { 0xA0, 0xBF, false }       /* the cart RAM */
+};
+
+static bool
+_soc_cart_window_changed(soc_t *soc, unsigned i)
 {
-    soc->ext_prio = _get_ext_bus_priority(soc);
-    soc->vid_prio = _get_vid_bus_priority(soc);
-    soc->oam_prio = _get_oam_bus_priority(soc);
+    /* a window has the same memory behind it as long as its bank and its
+     * first page stay the same. remember them for the next time */
+    bus_t *bus = soc->ext_bus;
+    uint16_t addr = _cart_windows[i].first << 8;
+    bool cs = _cart_windows[i].cs;
+    unsigned bank = bus->bank ? _soc_ext_bank(soc, addr, cs) : 0;
+    uint8_t *read = bus->map ? bus->map(bus, addr, cs, false) : NULL;
+    uint8_t *write = bus->map ? bus->map(bus, addr, cs, true) : NULL;
+
+    if (bank == soc->map.cart[i].bank && read == soc->map.cart[i].read &&
+            write == soc->map.cart[i].write)
+        return false;
+
+    soc->map.cart[i].bank = bank;
+    soc->map.cart[i].read = read;
+    soc->map.cart[i].write = write;
+    return true;
+}
+
+static void
+_soc_map_cart(soc_t *soc)
+{
+    /* the MBC might have switched ROM or RAM banks, or turned the RAM on or
+     * off. games write the same values over and over, though, so only the
+     * windows that did change are mapped again */
+    bool owned = soc->ext_prio == PRIO_CPU;
+    for (unsigned i = 0; i < SOC_CART_WINDOWS; ++i) {
+        if (!_soc_cart_window_changed(soc, i))
+            continue;
+
+        unsigned first = _cart_windows[i].first;
+        unsigned last = _cart_windows[i].last;
+        _soc_map_bus(soc, soc->ext_bus, first, last, _cart_windows[i].cs);
+        _soc_map_cpu(soc, first, last, owned);
+    }
+}
+
+static void
+_soc_map_owner(soc_t *soc, enum soc_bus bus, bus_prio_t owner, void *data)
+{
+    /* the CPU's map follows whoever owns the buses */
+    if (bus == SOC_BUS_EXT)
+        _soc_map_ext(soc);
+    else if (bus == SOC_BUS_VID)
+        _soc_map_vid(soc);
+}
+
+static void
+_soc_map_init(soc_t *soc)
+{
+    /* DMA reads the external bus from 0xA000 up, the high area included */
+    memset(&soc->map, 0, sizeof(soc->map));
+    _soc_map_bus(soc, soc->ext_bus, 0x00, 0x7F, true);
+    _soc_map_bus(soc, soc->video_bus, 0x80, 0x9F, false);
+    _soc_map_bus(soc, soc->ext_bus, 0xA0, 0xFF, false);
+    _soc_map_ext(soc);
+    _soc_map_vid(soc);
+
+    /* and what the cart's windows have now */
+    for (unsigned i = 0; i < SOC_CART_WINDOWS; ++i)
+        _soc_cart_window_changed(soc, i);
+}
+
+static inline void
+_soc_set_bus_owner(soc_t *soc, enum soc_bus bus, bus_prio_t *cur,
+        bus_prio_t owner)
+{
+    if (*cur == owner)
+        return;
+
+    /* tell everyone who cares */
+    *cur = owner;
+    for (unsigned i = 0; i < soc->nbus_subs; ++i)
+        soc->bus_subs[i].fn(soc, bus, owner, soc->bus_subs[i].data);
+}
+
+static void
+_soc_update_bus_owners(soc_t *soc)
+{
+    /* DMA or the PPU went through a transition in the last dot */
+    soc->bus_transition = false;
+    _soc_set_bus_owner(soc, SOC_BUS_EXT, &soc->ext_prio,
+            _get_ext_bus_priority(soc));
+    _soc_set_bus_owner(soc, SOC_BUS_VID, &soc->vid_prio,
+            _get_vid_bus_priority(soc));
+    _soc_set_bus_owner(soc, SOC_BUS_OAM, &soc->oam_prio,
+            _get_oam_bus_priority(soc));
+}
+
+bool
+soc_bus_subscribe(soc_t *soc, soc_bus_fn_t fn, void *data)
+{
+    /* the table is fixed, so there's room for a few of them only */
+    if (soc->nbus_subs >= SOC_BUS_SUBSCRIBERS) {
+        LOG(LOG_ERR, "too many bus subscribers");
+        return false;
+    }
+
+    soc->bus_subs[soc->nbus_subs].fn = fn;
+    soc->bus_subs[soc->nbus_subs].data = data;
+    ++soc->nbus_subs;
+    return true;
 }
 
 uint8_t
@@ -64,7 +212,7 @@ soc_ext_bus_read(soc_t *soc, bus_prio_t prio, uint16_t addr, bool cs)
     }
 
     /* invoke external bus */
-    return soc->ext_bus->read(soc->ext_bus, addr, cs);
+    return _soc_ext_read(soc, addr, cs);
 }
 
 void
@@ -76,8 +224,11 @@ soc_ext_bus_write(soc_t *soc, bus_prio_t prio, uint16_t addr, bool cs, uint8_t v
         return;
     }
 
-    /* invoke external bus */
-    soc->ext_bus->write(soc->ext_bus, addr, cs, val);
+    /* invoke external bus. a ROM write goes to the MBC, which might switch
+     * banks */
+    _soc_ext_write(soc, addr, cs, val);
+    if (cs)
+        _soc_map_cart(soc);
 }
 
 uint8_t
@@ -90,7 +241,7 @@ soc_vid_bus_read(soc_t *soc, bus_prio_t prio, uint16_t addr, bool cs)
     }
 
     /* invoke video bus */
-    return soc->video_bus->read(soc->video_bus, addr, cs);
+    return _soc_vid_read(soc, addr, cs);
 }
 
 void
@@ -103,7 +254,10 @@ soc_vid_bus_write(soc_t *soc, bus_prio_t prio, uint16_t addr, bool cs, uint8_t v
     }
 
     /* invoke video bus */
-    soc->video_bus->write(soc->video_bus, addr, cs, val);
+    ppu_line_write(soc->ppu);
+    if (!cs)
+        ppu_vram_write(soc->ppu, addr);
+    _soc_vid_write(soc, addr, cs, val);
 }
 
 uint8_t
@@ -131,6 +285,9 @@ soc_oam_write(soc_t *soc, bus_prio_t prio, uint8_t addr, uint8_t val)
     }
 
     /* write OAM */
+    ppu_line_write(soc->ppu);
+    ppu_scan_write(soc->ppu);
+    ppu_oam_write(soc->ppu, addr, val);
     soc->oam[addr] = val;
 }
 
@@ -242,9 +399,11 @@ _soc_iomem_write(soc_t *soc, uint8_t addr, uint8_t val)
             ppu_set_stat(soc->ppu, val);
             break;
         case 0x42:
+            ppu_line_write(soc->ppu);
             soc->ppu->scy = val;
             break;
         case 0x43:
+            ppu_line_write(soc->ppu);
             soc->ppu->scx = val;
             break;
         case 0x44:
@@ -253,16 +412,22 @@ _soc_iomem_write(soc_t *soc, uint8_t addr, uint8_t val)
             soc->ppu->lyc = val;
             break;
         case 0x46:
+            /* DMA is going to take OAM away from the PPU */
+            ppu_line_write(soc->ppu);
+            ppu_scan_write(soc->ppu);
             dma_start(soc->dma, val);
             break;
         case 0x47:
-            soc->ppu->bgp = val;
+            ppu_write_palette(soc->ppu, &soc->ppu->bgp, soc->ppu->bgp_shades,
+                    val);
             break;
         case 0x48:
-            soc->ppu->obp0 = val;
+            ppu_write_palette(soc->ppu, &soc->ppu->obp0,
+                    soc->ppu->obp_shades[0], val);
             break;
         case 0x49:
-            soc->ppu->obp1 = val;
+            ppu_write_palette(soc->ppu, &soc->ppu->obp1,
+                    soc->ppu->obp_shades[1], val);
             break;
         case 0xFF:
             soc->cpu->ie = val;
@@ -324,8 +489,13 @@ soc_cycle(soc_t *soc)
      * CPU wrote to the bus and/or used the IDU, it will set the appropriate
      * flags here */
 
-    /* first, calculate bus priorities for the current cycle */
-    _calculate_bus_priorities(soc);
+    /* first, hand the buses over if DMA or the PPU asked for it. otherwise,
+     * the owners are still the same */
+    if (soc->bus_transition)
+        _soc_update_bus_owners(soc);
+    assert(soc->ext_prio == _get_ext_bus_priority(soc) &&
+            soc->vid_prio == _get_vid_bus_priority(soc) &&
+            soc->oam_prio == _get_oam_bus_priority(soc));
 
     /* there's a dependency problem. the CPU's read and write signals, along
      * with the bidirectional data bus, are connected to the other components.
@@ -360,6 +530,14 @@ soc_cycle(soc_t *soc)
     jp_cycle(soc->jp);
 
     /* if there's a pending read from the CPU, fulfill it now */
+    soc_finish_io_read(soc);
+
+    ++soc->timestamp;
+}
+
+void
+soc_finish_io_read(soc_t *soc)
+{
     if (soc->pending_io_read) {
         assert(!(soc->pending_addr & 0x80));
         *soc->pending_dst = _soc_iomem_read(soc, soc->pending_addr);
@@ -367,21 +545,219 @@ soc_cycle(soc_t *soc)
     }
 }
 
+/* fill the event queue and return the earliest event */
+static inline uint64_t
+_soc_schedule(soc_t *soc)
+{
+    unsigned rel[SOC_EVENTS];
+    uint64_t next = UINT64_MAX;
+
+    /* ask every component how many cycles it is going to waste */
+    rel[SOC_EVENT_CPU] = cpu_next_event(soc->cpu);
+    rel[SOC_EVENT_DMA] = dma_next_event(soc->dma);
+    rel[SOC_EVENT_PPU] = ppu_next_event(soc->ppu);
+    rel[SOC_EVENT_TIM] = tim_next_event(soc->tim);
+    rel[SOC_EVENT_JP] = jp_next_event(soc->jp);
+
+    /* there's only a handful of components, a linear scan is cheaper than
+     * keeping an actual heap up to date */
+    for (size_t i = 0; i < SOC_EVENTS; ++i) {
+        soc->events[i] = rel[i] == NO_EVENT ? UINT64_MAX :
+            soc->timestamp + rel[i];
+        if (soc->events[i] < next)
+            next = soc->events[i];
+    }
+
+    return next;
+}
+
+/* jump to the next event and run the dot in which it happens */
+static inline void
+_soc_advance(soc_t *soc)
+{
+    uint64_t next = _soc_schedule(soc);
+
+    /* the CPU always has something to do within a machine cycle */
+    assert(next != UINT64_MAX);
+
+    /* nobody does anything until then, so just tell everyone how many cycles
+     * went by. this is what makes the emulator fast: most dots are spent
+     * waiting for the next machine cycle or the next PPU mode */
+    if (next > soc->timestamp) {
+        unsigned cycles = next - soc->timestamp;
+        cpu_skip(soc->cpu, cycles);
+        dma_skip(soc->dma, cycles);
+        ppu_skip(soc->ppu, cycles);
+        tim_skip(soc->tim, cycles);
+        soc->timestamp = next;
+    }
+
+    /* now run the interesting dot with all the components in lockstep */
+    soc_cycle(soc);
+}
+
 unsigned
 soc_step(soc_t *soc)
 {
-    unsigned c = 4;
-    for (size_t i = 0; i < 4; ++i) {
-        soc_cycle(soc);
-        ++c;
+    uint64_t start = soc->timestamp;
+
+    /* the CPU starts wasting 3 cycles from power on, so its machine cycles
+     * always end on a multiple of 4. keep going until one of them leaves the
+     * CPU ready to fetch the next instruction */
+    do {
+        _soc_advance(soc);
+    } while ((soc->timestamp & 3) || soc->cpu->state != FETCH);
+
+    return soc->timestamp - start;
+}
+
+static inline bool
+_soc_jp_held(jp_t *jp)
+{
+    return jp->start_pressed || jp->select_pressed || jp->a_pressed ||
+        jp->b_pressed || jp->down_pressed || jp->up_pressed ||
+        jp->left_pressed || jp->right_pressed;
+}
+
+static inline uint64_t
+_soc_irq_horizon(soc_t *soc)
+{
+    /* the cycles before an enabled interrupt might come up. IE itself can only
+     * change through the CPU */
+    uint8_t ie = soc->cpu->ie;
+    unsigned next = NO_EVENT;
+
+    /* a held button can raise the joypad interrupt at any cycle */
+    if ((ie & INT_JP) && _soc_jp_held(soc->jp))
+        return 0;
+
+    /* the PPU only raises its interrupts when switching modes */
+    if (ie & (INT_VBLANK | INT_STAT)) {
+        unsigned ppu = ppu_next_change(soc->ppu);
+        if (ppu < next)
+            next = ppu;
     }
-    while (soc->cpu->state != FETCH) {
-        for (size_t i = 0; i < 4; ++i) {
-            soc_cycle(soc);
-            ++c;
-        }
+
+    /* the timer only raises it when TIMA overflows */
+    if (ie & INT_TIMER) {
+        unsigned tim = tim_next_irq(soc->tim);
+        if (tim < next)
+            next = tim;
+    }
+
+    return next == NO_EVENT ? UINT64_MAX : next;
+}
+
+bool
+soc_can_run_ahead(soc_t *soc, unsigned mcycles)
+{
+    cpu_t *cpu = soc->cpu;
+
+    /* a pending EI or DMA must be seen at every instruction boundary */
+    if (cpu->ei_state != EI_NOT_CALLED || soc->dma->pending ||
+            soc->dma->requested || soc->ext_prio != PRIO_CPU)
+        return false;
+
+    /* with IME set, no interrupt may come up before the CPU is done. the
+     * other components stay behind until then, and they don't care about
+     * plain memory */
+    if (cpu->ime && (_pending_interrupts(cpu) ||
+                _soc_irq_horizon(soc) < 4 * mcycles))
+        return false;
+
+    return true;
+}
+
+unsigned
+soc_halt_wait(soc_t *soc)
+{
+    /* a pending EI must be seen at every machine cycle */
+    if (soc->cpu->ei_state != EI_NOT_CALLED)
+        return 0;
+
+    /* a halted CPU only wakes up for an interrupt. the frontend looks at the
+     * PPU in between steps though, so don't go past its next event. with the
+     * LCD off, stop once in a while anyway */
+    uint64_t horizon = _soc_irq_horizon(soc);
+    unsigned ppu = ppu_next_change(soc->ppu);
+    if (ppu < horizon)
+        horizon = ppu;
+    if (horizon > SOC_MAX_WAIT)
+        horizon = SOC_MAX_WAIT;
+
+    /* the CPU sits in the NOP it has just fetched for as many machine cycles
+     * as fit */
+    unsigned mcycles = horizon / 4;
+    return mcycles > 1 ? 4 * (mcycles - 1) : 0;
+}
+
+unsigned
+soc_idle_horizon(soc_t *soc)
+{
+    /* the cycles in which the CPU can run ahead, as long as it only reads
+     * memory that doesn't change in the meantime (see soc_io_stable) */
+    if (!soc_can_run_ahead(soc, 0))
+        return 0;
+
+    /* same as a halted CPU, except interrupts only matter with IME set */
+    uint64_t horizon = soc->cpu->ime ? _soc_irq_horizon(soc) : UINT64_MAX;
+    unsigned ppu = ppu_next_change(soc->ppu);
+    if (ppu < horizon)
+        horizon = ppu;
+    if (horizon > SOC_MAX_WAIT)
+        horizon = SOC_MAX_WAIT;
+
+    return horizon;
+}
+
+unsigned
+soc_io_stable(soc_t *soc, uint8_t addr)
+{
+    /* the cycles before an IO register might change without the CPU writing
+     * it. the unknown ones might change at any time */
+    unsigned next = NO_EVENT, tim;
+    switch (addr) {
+        case 0x00:
+            /* the buttons only move in between steps. the first cycle of a
+             * step sees them */
+            if (soc->jp->start != soc->jp->start_pressed ||
+                    soc->jp->select != soc->jp->select_pressed ||
+                    soc->jp->a != soc->jp->a_pressed ||
+                    soc->jp->b != soc->jp->b_pressed ||
+                    soc->jp->down != soc->jp->down_pressed ||
+                    soc->jp->up != soc->jp->up_pressed ||
+                    soc->jp->left != soc->jp->left_pressed ||
+                    soc->jp->right != soc->jp->right_pressed)
+                return 0;
+            return NO_EVENT;
+        case 0x04:
+            return tim_next_div(soc->tim);
+        case 0x05:
+            return tim_next_tick(soc->tim);
+        case 0x0F:
+            /* any interrupt, enabled or not */
+            if (_soc_jp_held(soc->jp))
+                return 0;
+            next = ppu_next_change(soc->ppu);
+            tim = tim_next_event(soc->tim);
+            return tim < next ? tim : next;
+        case 0x41:
+        case 0x44:
+            return ppu_next_change(soc->ppu);
+        case 0x06:
+        case 0x07:
+        case 0x40:
+        case 0x42:
+        case 0x43:
+        case 0x45:
+        case 0x46:
+        case 0x47:
+        case 0x48:
+        case 0x49:
+            return NO_EVENT;
+        default:
+            return 0;
     }
-    return c;
 }
 
 unsigned
@@ -390,9 +766,11 @@ soc_run_until_vblank(soc_t *soc)
     /* total cycles */
     unsigned c = 0;
 
-    /* if PPU is disabled, just step once (TODO: think) */
+    /* if PPU is disabled, there's no VBLANK to wait for, so just run for as
+     * long as a frame takes. steps don't count, since a halted CPU can take up
+     * to a scanline in one of them */
     if (!LCDC_PPU_ENABLE(soc->ppu->lcdc)) {
-        for (size_t i = 0; i < 4560; ++i)
+        while (c < 70224)
             c += soc_step(soc);
 
         return c;
@@ -411,10 +789,38 @@ void
 soc_run_one_frame(soc_t *soc)
 {
     /* run for 70224 cycles */
-    for (size_t i = 0; i < 70224; ++i)
+    uint64_t end = soc->timestamp + 70224;
+    while (soc->timestamp < end)
         soc_step(soc);
 }
 
+void
+soc_usage(soc_t *soc, soc_usage_t *usage)
+{
+    /* the components are allocated one by one */
+    usage->soc = sizeof(soc_t) + sizeof(cpu_t) + sizeof(dma_t) +
+        sizeof(tim_t) + sizeof(jp_t);
+    usage->ppu = sizeof(ppu_t);
+    /* the blocks come in whole chunks */
+    unsigned chunks = (soc->bcache->nblocks + BCACHE_CHUNK - 1) / BCACHE_CHUNK;
+    usage->bcache = sizeof(bcache_t) +
+        chunks * BCACHE_CHUNK * sizeof(bcache_block_t);
+#ifdef GBEMU_JIT
+    usage->jit = sizeof(jit_t) + soc->jit->used;
+#else
+    usage->jit = 0;
+#endif
+
+    /* the buses know what's behind them */
+    usage->ext_bus = soc->ext_bus->usage ?
+        soc->ext_bus->usage(soc->ext_bus) : 0;
+    usage->video_bus = soc->video_bus->usage ?
+        soc->video_bus->usage(soc->video_bus) : 0;
+
+    usage->total = usage->soc + usage->ppu + usage->bcache + usage->jit +
+        usage->ext_bus + usage->video_bus;
+}
+
 soc_t *
 soc_create(bus_t *ext_bus, bus_t *video_bus)
 {
@@ -453,16 +859,52 @@ soc_create(bus_t *ext_bus, bus_t *video_bus)
         goto tim_free;
     jp_init(soc->jp, soc);
 
+    /* the block cache */
+    soc->bcache = malloc(sizeof(bcache_t));
+    if (!soc->bcache)
+        goto jp_free;
+    bcache_init(soc->bcache, soc);
+
+#ifdef GBEMU_JIT
+    /* the recompiler */
+    soc->jit = malloc(sizeof(jit_t));
+    if (!soc->jit)
+        goto bcache_free;
+    jit_init(soc->jit, soc);
+#endif
+
     /* init variables */
     soc->ext_bus = ext_bus;
     soc->video_bus = video_bus;
+#ifdef GBEMU_STD_BUS
+    soc->std_ext = ext_bus_is_std(ext_bus);
+    soc->std_vid = vid_bus_is_std(video_bus);
+#endif
     soc->ext_prio = soc->vid_prio = soc->oam_prio = PRIO_CPU;
+    soc->bus_transition = true;
+    soc->nbus_subs = 0;
     memset(soc->oam, 0, sizeof(soc->oam));
     memset(soc->hram, 0, sizeof(soc->hram));
     soc->pending_io_read = false;
+    soc->timestamp = 0;
+    memset(soc->events, 0, sizeof(soc->events));
+    soc->aot = aot_match(ext_bus);
+    _soc_map_init(soc);
+    if (!soc_bus_subscribe(soc, _soc_map_owner, NULL)) {
+        soc_destroy(soc);
+        goto failure;
+    }
 
     return soc;
 
+#ifdef GBEMU_JIT
+bcache_free:
+    free(soc->bcache);
+#endif
+
+jp_free:
+    free(soc->jp);
+
 tim_free:
     free(soc->tim);
 
@@ -486,6 +928,12 @@ void
 soc_destroy(soc_t *soc)
 {
     /* free components one by one */
+#ifdef GBEMU_JIT
+    jit_deinit(soc->jit);
+    free(soc->jit);
+#endif
+    bcache_deinit(soc->bcache);
+    free(soc->bcache);
     free(soc->jp);
     free(soc->tim);
     free(soc->ppu);
@@ -4,6 +4,11 @@
 #include "ext/bus.h"
 #include "types.h"
 
+#ifdef GBEMU_STD_BUS
+#include "ext/std_bus.h"
+#endif
+
+#include <limits.h>
 #include <stddef.h>
 #include <stdint.h>
 #include <stdbool.h>
@@ -26,6 +31,28 @@
         return;                 \
     }
 
+/* returned by a component that has nothing scheduled (see soc_step) */
+#define NO_EVENT    UINT_MAX
+
+/* the longest the CPU waits in one go when it's idle (a scanline) */
+#define SOC_MAX_WAIT        456
+
+/* the longest loop (in bytes) the CPU runs ahead when it's idle, and the most
+ * instructions it runs in one go */
+#define CPU_IDLE_LOOP_LEN   32
+#define CPU_IDLE_MAX_INSTRS 64
+
+/* the components tracked by the scheduler. the order is the same in which they
+ * are cycled within a single dot */
+enum soc_event {
+    SOC_EVENT_CPU,
+    SOC_EVENT_DMA,
+    SOC_EVENT_PPU,
+    SOC_EVENT_TIM,
+    SOC_EVENT_JP,
+    SOC_EVENTS
+};
+
 /* this represents the bus's status for the current cycle */
 typedef enum bus_prio {
     PRIO_DMA,
@@ -33,6 +60,20 @@ typedef enum bus_prio {
     PRIO_CPU,
 } bus_prio_t;
 
+/* the buses arbitrated by the SoC */
+enum soc_bus {
+    SOC_BUS_EXT,
+    SOC_BUS_VID,
+    SOC_BUS_OAM,
+    SOC_BUSES
+};
+
+/* the most components that can follow the bus owners (see soc_bus_subscribe) */
+#define SOC_BUS_SUBSCRIBERS 4
+
+/* the cart's windows into the memory map (see soc.c) */
+#define SOC_CART_WINDOWS    3
+
 /* pre-define structs because of circular dependencies */
 struct dma;
 struct cpu;
@@ -40,6 +81,9 @@ struct ppu;
 struct tim;
 struct soc;
 struct jp;
+struct bcache;
+struct jit;
+struct aot_image;
 
 /* some joypad definitions */
 #define JP_ACTION(x)        (((x) & 0x20) >> 5)
@@ -152,6 +196,46 @@ typedef struct obj_store_entry {
     unsigned obj_idx;
 } obj_store_entry_t;
 
+/* the tiles in VRAM, with the color IDs of each row packed together (see
+ * pixel_pack_row). a tile is only decoded again when it's used after being
+ * written to */
+#define PPU_TILES   384
+
+typedef struct tile_cache {
+    /* the rows of every tile */
+    uint16_t rows[PPU_TILES][8];
+
+    /* one bit per tile that has to be decoded again */
+    uint64_t dirty[PPU_TILES / 64];
+} tile_cache_t;
+
+/* the objects OAMSCAN picks for each line, kept up to date as OAM is written to
+ * (see ppu_oam_write). a line is only picked again after one of its objects
+ * has moved */
+#define PPU_OBJS        40
+#define PPU_LINE_OBJS   10
+
+typedef struct obj_line {
+    /* the OAM indices of the objects, sorted by X and then by OAM index */
+    uint8_t objs[PPU_LINE_OBJS];
+    uint8_t count;
+} obj_line_t;
+
+typedef struct obj_index {
+    /* the objects on each line, one bit per OAM index, both for 8 and 16
+     * pixel tall objects */
+    uint64_t on_line[2][SCREEN_HEIGHT];
+
+    /* the objects picked for each line */
+    obj_line_t lines[SCREEN_HEIGHT];
+
+    /* one bit per line that has to be picked again */
+    uint64_t dirty[(SCREEN_HEIGHT + 63) / 64];
+
+    /* the object height the lines were picked for */
+    unsigned height;
+} obj_index_t;
+
 /* the various PPU modes */
 enum ppu_mode {
     PPU_HBLANK,
@@ -229,6 +313,19 @@ typedef struct ppu {
     /* the objects' palettes */
     uint8_t obp0, obp1;
 
+    /* the same palettes as lookup tables, from color ID to shade. they're
+     * rebuilt whenever the registers are written (see ppu_write_palette) */
+    uint8_t bgp_shades[4], obp_shades[2][4];
+
+    /* the pixel kernels that suit the host best */
+    const struct pixel_kernels *kernels;
+
+    /* the decoded tiles, for the lines drawn at once */
+    tile_cache_t tiles;
+
+    /* the objects on each line, for the OAM scans done at once */
+    obj_index_t obj_index;
+
     /* the window's position */
     uint8_t wx, wy;
 
@@ -236,8 +333,12 @@ typedef struct ppu {
     bool lyc_int_enabled, oam_int_enabled,
          vblank_int_enabled, hblank_int_enabled;
 
-    /* sprite store with X coords (matchers) */
-    obj_store_entry_t objs[10];
+    /* sprite store with X coords (matchers), sorted by X once OAMSCAN is over
+     */
+    obj_store_entry_t objs[PPU_LINE_OBJS];
+
+    /* one bit per X with an object on it */
+    uint64_t obj_xmap[3];
 
     /* current index in the OAM */
     size_t cur_oam_idx;
@@ -258,25 +359,28 @@ typedef struct ppu {
     uint8_t cur_fetched_obj_attrs;
 
     /* next object index to check (in case of multiple sprites in the same X
-     * coordinate) */
+     * coordinate). the ones before it are behind LX or already fetched */
     size_t next_obj_to_check;
 
-    /* the BG queue */
-    uint8_t bg_queue[8];
+    /* the BG queue, as shift registers like the real thing: the low bitplane
+     * in the low byte and the high one in the high byte. the next pixel out is
+     * bit 7 of each */
+    uint16_t bg_queue;
 
-    /* the object queues with attributes */
-    uint8_t obj_queue[8], obj_attrs[8];
+    /* the object queue the same way, plus one register for each attribute the
+     * pusher needs (one bit per pixel) */
+    uint16_t obj_queue;
+    uint8_t obj_prio, obj_palette;
 
-    /* the current head in the BG queue (8 means it's empty). the OBJ queue has
-     * no index because it works by forever "shifting" 0x00 bytes if it is empty
-     */
+    /* how many pixels left the BG queue (8 means it's empty). the OBJ queue has
+     * no index because it works by forever shifting in transparent pixels */
     size_t bg_queue_idx;
 
     /* whether the temp queue register is full and ready to fill BG queue */
     bool tmp_reg_full;
 
-    /* the temporary BG queue register */
-    uint8_t tmp_reg[8];
+    /* the temporary BG queue register, laid out like the queue */
+    uint16_t tmp_reg;
 
     /* current pusher X value (which pixel is being pushed) */
     unsigned lx;
@@ -296,8 +400,18 @@ typedef struct ppu {
     /* how many cycles the RENDER phase took */
     unsigned render_cycles;
 
-    /* the actual screen */
-    pixel_t screen[SCREEN_HEIGHT][SCREEN_WIDTH];
+    /* whether the current line is drawn all at once when RENDER ends, instead
+     * of through the FIFOs. it's given up as soon as something the line
+     * depends on changes halfway through (see ppu_line_write) */
+    bool whole_line;
+
+    /* the same for OAMSCAN: whether the objects are looked up in the index
+     * when it ends, instead of read one by one (see ppu_scan_write) */
+    bool whole_scan;
+
+    /* the actual screen, in shades from 0 (white) to 3 (black). ppu_blit()
+     * turns them into colors */
+    uint8_t screen[SCREEN_HEIGHT][SCREEN_WIDTH];
 
     /* the STAT sources. these two are ORed together into a single line which
      * interrupts the CPU if it goes high from low (STAT blocking) */
@@ -340,6 +454,68 @@ typedef fn_row_t (*fn_row_array_ptrs[])[256];
 typedef fn_row_t *fn_list_t;
 typedef fn_list_t *instructions_t;
 
+/* the memory an instruction touches besides its own bytes. this decides whether
+ * it can run in one go (see cpu.c) */
+enum cpu_access {
+    ACCESS_NONE,        /* registers only */
+    ACCESS_IHL,         /* (HL) */
+    ACCESS_IRR,         /* (BC), (DE), (HL+) or (HL-) */
+    ACCESS_HIGH_N,      /* (0xFF00 + imm8) */
+    ACCESS_HIGH_C,      /* (0xFF00 + C) */
+    ACCESS_INN,         /* (imm16) */
+    ACCESS_INN_SP,      /* (imm16) and (imm16 + 1) */
+    ACCESS_PUSH,        /* (SP - 1) and (SP - 2) */
+    ACCESS_POP,         /* (SP) and (SP + 1) */
+    ACCESS_CYCLED       /* anything that must go through the machine cycles */
+};
+
+/* how the last ALU operation sets the half carry and subtract flags */
+enum cpu_flags_op {
+    FLAGS_NH,           /* known already, kept as they are in F */
+    FLAGS_ADD,          /* x + y + carry in */
+    FLAGS_SUB,          /* x - y - carry in */
+    FLAGS_INC,          /* the result plus one */
+    FLAGS_DEC           /* the result minus one */
+};
+
+/* the flags as the last ALU operation left them. Z and C are always known,
+ * since they are read the most (conditions, ADC, SBC and the rotates). N and H
+ * are only worked out when the whole F is needed (see cpu_common.h) */
+typedef struct cpu_flags {
+    enum cpu_flags_op op;
+
+    /* the operands of an addition or a subtraction */
+    uint8_t x, y, cin;
+
+    /* N and H for FLAGS_NH, in their F bits */
+    uint8_t nh;
+
+    /* Z is set if the result is zero */
+    uint8_t res;
+
+    /* C as 0 or 1 */
+    uint8_t carry;
+} cpu_flags_t;
+
+/* a decoded instruction. the micro-op lists and the operands all follow from
+ * the opcode, so only the bytes are kept, along with what running it takes
+ * (see instrs.h) */
+typedef struct cpu_op {
+    /* the opcode and the second byte of a CB instruction, if known yet */
+    uint8_t ir, cb_ir;
+    bool cb;
+
+    /* the machine cycles it takes at most and the memory it reads or writes
+     * (an enum cpu_access) */
+    uint8_t mcycles, access;
+    bool writes;
+
+    /* a common sequence starting here, run by a single handler (see fuse.c):
+     * how many instructions it covers and the machine cycles they take at
+     * most */
+    uint8_t fused, fused_mcycles;
+} cpu_op_t;
+
 /* the SoC's pseudo-SM83 core. it is "pseudo" because it is probably modified by
  * Nintendo, but the inner workings seem to match the original Sharp's SM83 */
 typedef struct cpu {
@@ -361,9 +537,12 @@ typedef struct cpu {
     /* the current EI instruction state */
     enum ei_state ei_state;
 
-    /* register set */
+    /* register set. F is only up to date after _cpu_flags() */
     reg_t af, bc, de, hl;
 
+    /* what the flags are made of */
+    cpu_flags_t flags;
+
     /* program counter and stack pointer */
     reg_t pc, sp;
 
@@ -376,6 +555,12 @@ typedef struct cpu {
     /* the current state */
     enum cpu_state state;
 
+#ifdef GBEMU_THREADED
+    /* where cpu_cycle() runs the current step of the instruction (see cpu.c).
+     * NULL until the first instruction is fetched */
+    const void *site;
+#endif
+
     /* the current instruction PC for debugging purposes */
     reg_t curpc;
 
@@ -385,8 +570,105 @@ typedef struct cpu {
 
     /* the HALT logic */
     bool halt, halt_bug;
+
+    /* the decoded current instruction. this either lives in the block cache or
+     * in the scratch area, if the instruction had to be decoded on the fly */
+    const cpu_op_t *op;
+    cpu_op_t scratch;
 } cpu_t;
 
+/* the number of cached blocks and the maximum instructions per block */
+#define BCACHE_BLOCKS       512
+#define BCACHE_BLOCK_LEN    16
+
+/* the blocks are allocated this many at a time */
+#define BCACHE_CHUNK        32
+
+/* the RAM (cart RAM, WRAM and HRAM) tracked for self-modifying code */
+#define BCACHE_RAM_START    0xA000
+#define BCACHE_RAM_SIZE     0x6000
+
+/* a block compiled to native code, either ahead of time or by the JIT. it runs
+ * the block from the start and returns what NATIVE_RET() packs: the machine
+ * cycles taken and the index of the instruction to resume from */
+typedef unsigned (*bcache_native_t)(struct cpu *cpu, const cpu_op_t *ops);
+#define NATIVE_RET(cycles, idx)     (((cycles) << 8) | (idx))
+
+/* a straight run of decoded instructions, ending at the first jump */
+typedef struct bcache_block {
+    bool valid;
+
+    /* whether the block sits on the external bus (it might be taken by DMA) */
+    bool ext;
+
+    /* where the block is: the first address and the bank mapped there */
+    uint16_t pc;
+    unsigned bank;
+
+    /* the address after the last instruction */
+    uint16_t end;
+
+    /* the decoded instructions along with their addresses */
+    unsigned len;
+    uint16_t pcs[BCACHE_BLOCK_LEN];
+    cpu_op_t ops[BCACHE_BLOCK_LEN];
+
+    /* the native code (if any) and the machine cycles it takes at most */
+    bcache_native_t native;
+    unsigned native_cycles;
+
+#ifdef GBEMU_JIT
+    /* how many times the block has been entered and whether it can't be
+     * compiled */
+    unsigned hits;
+    bool nojit;
+#endif
+} bcache_block_t;
+
+/* the block cache. it is keyed by PC and bank, and it saves the CPU from
+ * reading and decoding an opcode at every fetch */
+typedef struct bcache {
+    /* pointer to the controlling SoC */
+    struct soc *soc;
+
+    /* the block being executed and the next instruction in it */
+    bcache_block_t *cur;
+    unsigned idx;
+
+    /* RAM bytes covered by a cached block, one bit each */
+    uint8_t code[BCACHE_RAM_SIZE / 8];
+
+    /* direct-mapped cache. a slot only gets a block of its own the first time
+     * something is built there, until then it shares an empty one */
+    bcache_block_t *blocks[BCACHE_BLOCKS];
+
+    /* where the blocks come from. there's never more than one per slot, so
+     * the chunks are enough for all of them. nblocks counts the ones handed
+     * out */
+    bcache_block_t *chunks[BCACHE_BLOCKS / BCACHE_CHUNK];
+    unsigned nblocks;
+} bcache_t;
+
+/* called whenever a bus changes hands, with its new owner */
+typedef void (*soc_bus_fn_t)(struct soc *soc, enum soc_bus bus,
+        bus_prio_t owner, void *data);
+
+/* host pointers to the memory behind every 256-byte page, so that plain
+ * memory is a single load away. the bus tables have what the buses map (DMA
+ * always owns the bus it reads from), the CPU tables only the pages of the
+ * buses the CPU owns. NULL pages go the slow way */
+typedef struct soc_map {
+    uint8_t *bus_read[0x100], *bus_write[0x100];
+    uint8_t *cpu_read[0x100], *cpu_write[0x100];
+
+    /* the bank and the first page of each of the cart's windows (ROM bank 0,
+     * the switchable ROM bank and the cart RAM) when they were last mapped */
+    struct {
+        unsigned bank;
+        uint8_t *read, *write;
+    } cart[SOC_CART_WINDOWS];
+} soc_map_t;
+
 /* the main system-on-chip structure. the DMG-CPU-B can roughly be divided in
  * the following components:
  *      - CPU (SM83 core)
@@ -415,8 +697,29 @@ typedef struct soc {
     /* the joypad */
     struct jp *jp;
 
-    /* the priorities for the current cycle */
+    /* the CPU's block cache */
+    struct bcache *bcache;
+
+#ifdef GBEMU_JIT
+    /* the recompiler */
+    struct jit *jit;
+#endif
+
+    /* the ahead-of-time compiled code for the cart, if any */
+    const struct aot_image *aot;
+
+    /* the owners of the buses. they only change when DMA or the PPU start or
+     * stop using a bus, which they signal with soc_bus_transition(). the new
+     * owners take over from the next dot */
     bus_prio_t ext_prio, vid_prio, oam_prio;
+    bool bus_transition;
+
+    /* whoever follows the owners */
+    struct {
+        soc_bus_fn_t fn;
+        void *data;
+    } bus_subs[SOC_BUS_SUBSCRIBERS];
+    unsigned nbus_subs;
 
     /* the external bus */
     bus_t *ext_bus;
@@ -424,6 +727,14 @@ typedef struct soc {
     /* the video bus */
     bus_t *video_bus;
 
+#ifdef GBEMU_STD_BUS
+    /* whether the buses are the stock ones, which are then called directly */
+    bool std_ext, std_vid;
+#endif
+
+    /* the fast memory map */
+    soc_map_t map;
+
     /* OAM memory (it's actually 2*128B SRAM chips, even if only the first 160
      * bytes are accessible by the Game Boy) */
     uint8_t oam[0x100];
@@ -435,8 +746,22 @@ typedef struct soc {
     bool pending_io_read;
     uint8_t *pending_dst;
     uint8_t pending_addr;
+
+    /* the master clock, counting every dot since power on */
+    uint64_t timestamp;
+
+    /* the scheduler's queue: the timestamp at which each component will do
+     * something other than wasting cycles */
+    uint64_t events[SOC_EVENTS];
 } soc_t;
 
+static inline void
+soc_bus_transition(soc_t *soc)
+{
+    /* DMA or the PPU might have started or stopped using a bus */
+    soc->bus_transition = true;
+}
+
 /*
  *      ** DMA **
  */
@@ -451,6 +776,35 @@ dma_start(dma_t *dma, uint8_t high_addr)
      * (mooneye's oam_dma_restart) */
     dma->requested = 8;
     dma->high_addr = high_addr;
+
+    /* a running transfer might move to the other bus */
+    if (dma->pending)
+        soc_bus_transition(dma->soc);
+}
+
+static inline unsigned
+dma_next_event(dma_t *dma)
+{
+    /* the request countdown is short, just go through it cycle by cycle */
+    if (dma->requested)
+        return 0;
+
+    /* an idle DMA never wakes up by itself */
+    if (!dma->pending)
+        return NO_EVENT;
+
+    /* otherwise the next byte is copied once the wasted cycles are over */
+    return dma->cycles_to_waste;
+}
+
+static inline void
+dma_skip(dma_t *dma, unsigned cycles)
+{
+    /* these are cycles that dma_cycle() would have wasted anyway */
+    if (dma->pending) {
+        assert(cycles <= dma->cycles_to_waste);
+        dma->cycles_to_waste -= cycles;
+    }
 }
 
 void dma_cycle(dma_t *dma);
@@ -460,9 +814,114 @@ void dma_init(dma_t *dma, soc_t *soc);
  *      ** CPU **
  */
 
+static inline unsigned
+cpu_next_event(cpu_t *cpu)
+{
+    /* the CPU does something at every machine cycle */
+    return cpu->cycles_to_waste;
+}
+
+static inline void
+cpu_skip(cpu_t *cpu, unsigned cycles)
+{
+    assert(cycles <= cpu->cycles_to_waste);
+    cpu->cycles_to_waste -= cycles;
+}
+
 void cpu_cycle(cpu_t *cpu);
 void cpu_init(cpu_t *cpu, soc_t *soc);
 
+/*
+ *      ** BLOCK CACHE **
+ */
+
+static inline unsigned
+_bcache_ram_idx(uint16_t addr)
+{
+    /* echo RAM is the same as WRAM */
+    if (addr >= 0xE000 && addr < 0xFE00)
+        addr -= 0x2000;
+
+    return addr - BCACHE_RAM_START;
+}
+
+void _bcache_invalidate(bcache_t *bcache, uint16_t addr);
+
+static inline void
+bcache_write(bcache_t *bcache, uint16_t addr)
+{
+    /* a ROM write goes to the MBC, which might be switching banks under the
+     * current block. just look it up again at the next fetch */
+    if (addr < 0x8000) {
+        bcache->cur = NULL;
+        return;
+    }
+
+    /* writes to RAM only matter if they hit cached code */
+    unsigned idx = _bcache_ram_idx(addr);
+    if (bcache->code[idx >> 3] & (1 << (idx & 7)))
+        _bcache_invalidate(bcache, addr);
+}
+
+uint8_t bcache_peek(bcache_t *bcache, uint16_t addr);
+bcache_block_t *bcache_probe(bcache_t *bcache, uint16_t pc);
+const cpu_op_t *bcache_fetch(bcache_t *bcache, uint16_t pc);
+unsigned bcache_run_native(bcache_t *bcache, cpu_t *cpu);
+void bcache_init(bcache_t *bcache, soc_t *soc);
+void bcache_deinit(bcache_t *bcache);
+
+/*
+ *      ** AOT **
+ */
+
+/* a block compiled ahead of time by gbemu-aot. it must match the block cache's
+ * own block at the same place */
+typedef struct aot_block {
+    uint16_t pc;
+    unsigned bank;
+    uint16_t end;
+    unsigned len;
+    unsigned cycles;
+    bcache_native_t fn;
+} aot_block_t;
+
+/* the blocks compiled from a ROM, sorted by bank and PC. the ROM is recognized
+ * by its header */
+typedef struct aot_image {
+    char title[16];
+    uint8_t header_checksum;
+    uint16_t global_checksum;
+    size_t nblocks;
+    const aot_block_t *blocks;
+} aot_image_t;
+
+const aot_image_t *aot_match(bus_t *ext_bus);
+void aot_attach(const aot_image_t *image, bcache_block_t *block);
+
+/*
+ *      ** JIT **
+ */
+
+#ifdef GBEMU_JIT
+/* the size of the native code buffer */
+#define JIT_CODE_SIZE       (4 << 20)
+
+/* the x86-64 recompiler. blocks from the block cache that get hot are
+ * translated to native code, which runs them in one go */
+typedef struct jit {
+    /* pointer to the controlling SoC */
+    struct soc *soc;
+
+    /* the code buffer, filled from the start and flushed when full */
+    uint8_t *code;
+    size_t used;
+} jit_t;
+
+void jit_enter(jit_t *jit, bcache_block_t *block);
+void jit_init(jit_t *jit, soc_t *soc);
+void jit_deinit(jit_t *jit);
+#endif
+
 /*
  *      ** SOC **
  */
@@ -483,9 +942,31 @@ void soc_oam_write(soc_t *soc, bus_prio_t prio, uint8_t addr, uint8_t val);
 bool soc_internal_read(soc_t *soc, uint8_t *dst, uint8_t addr);
 void soc_internal_write(soc_t *soc, uint8_t addr, uint8_t val);
 
+/* the host memory an instance takes, in bytes. whatever is behind the buses is
+ * only counted if they can tell */
+typedef struct soc_usage {
+    size_t soc;         /* the SoC and its smaller components */
+    size_t ppu;         /* the PPU, screen included */
+    size_t bcache;      /* the block cache and the blocks it has allocated */
+    size_t jit;         /* the JIT and the code it has generated */
+    size_t ext_bus;     /* the external bus, WRAM and the cart */
+    size_t video_bus;   /* the video bus and VRAM */
+    size_t total;
+} soc_usage_t;
+
+void soc_usage(soc_t *soc, soc_usage_t *usage);
+
+/* bus ownership. false if there's no room for another subscriber */
+bool soc_bus_subscribe(soc_t *soc, soc_bus_fn_t fn, void *data);
+
 /* core soc */
 void soc_cycle(soc_t *soc);
 unsigned soc_step(soc_t *soc);
+bool soc_can_run_ahead(soc_t *soc, unsigned mcycles);
+unsigned soc_halt_wait(soc_t *soc);
+unsigned soc_idle_horizon(soc_t *soc);
+unsigned soc_io_stable(soc_t *soc, uint8_t addr);
+void soc_finish_io_read(soc_t *soc);
 unsigned soc_run_until_vblank(soc_t *soc);
 void soc_run_one_frame(soc_t *soc);
 soc_t *soc_create(bus_t *ext_bus, bus_t *video_bus);
@@ -499,6 +980,62 @@ soc_interrupt(soc_t *soc, uint8_t int_mask)
     soc->cpu->iflag |= int_mask;
 }
 
+/* the bus accesses themselves, past the priority checks. a GBEMU_STD_BUS build
+ * calls into the stock buses directly, anything else goes through bus_t */
+static inline uint8_t
+_soc_ext_read(soc_t *soc, uint16_t addr, bool cs)
+{
+#ifdef GBEMU_STD_BUS
+    if (soc->std_ext)
+        return _ext_bus_read((ext_bus_t *)soc->ext_bus, addr, cs);
+#endif
+    return soc->ext_bus->read(soc->ext_bus, addr, cs);
+}
+
+static inline void
+_soc_ext_write(soc_t *soc, uint16_t addr, bool cs, uint8_t val)
+{
+#ifdef GBEMU_STD_BUS
+    if (soc->std_ext) {
+        _ext_bus_write((ext_bus_t *)soc->ext_bus, addr, cs, val);
+        return;
+    }
+#endif
+    soc->ext_bus->write(soc->ext_bus, addr, cs, val);
+}
+
+static inline unsigned
+_soc_ext_bank(soc_t *soc, uint16_t addr, bool cs)
+{
+#ifdef GBEMU_STD_BUS
+    if (soc->std_ext)
+        return _ext_bus_bank((ext_bus_t *)soc->ext_bus, addr, cs);
+#endif
+    return soc->ext_bus->bank(soc->ext_bus, addr, cs);
+}
+
+static inline uint8_t
+_soc_vid_read(soc_t *soc, uint16_t addr, bool cs)
+{
+#ifdef GBEMU_STD_BUS
+    if (soc->std_vid)
+        return _vid_bus_read((vid_bus_t *)soc->video_bus, addr, cs);
+#endif
+    return soc->video_bus->read(soc->video_bus, addr, cs);
+}
+
+static inline void
+_soc_vid_write(soc_t *soc, uint16_t addr, bool cs, uint8_t val)
+{
+#ifdef GBEMU_STD_BUS
+    if (soc->std_vid) {
+        _vid_bus_write((vid_bus_t *)soc->video_bus, addr, cs, val);
+        return;
+    }
+#endif
+    soc->video_bus->write(soc->video_bus, addr, cs, val);
+}
+
 /* this is for a component to "cancel" its own interrupt. imagine the PPU is
  * turned off; if it doesn't clear its interrupt it may be problematic as it may
  * trigger a VBlank interrupt when it is in a different mode */
@@ -538,9 +1075,36 @@ ppu_set_stat(ppu_t *ppu, uint8_t val)
     ppu->stat_written = true;
 }
 
+void ppu_fallback(ppu_t *ppu);
+void ppu_oam_write(ppu_t *ppu, uint8_t addr, uint8_t val);
+
+/* to be called before anything the current line is drawn from changes: LCDC,
+ * the viewport, the palettes, VRAM or OAM. a line that was going to be drawn
+ * at the end of RENDER goes back to the FIFOs for the rest of the way */
+static inline void
+ppu_line_write(ppu_t *ppu)
+{
+    if (ppu->whole_line && ppu->mode == PPU_RENDER)
+        ppu_fallback(ppu);
+}
+
+/* to be called before anything OAMSCAN depends on changes: LCDC, OAM or DMA,
+ * which takes OAM away from it. the objects read so far were read as they
+ * were, and the rest are read one by one */
+static inline void
+ppu_scan_write(ppu_t *ppu)
+{
+    if (ppu->whole_scan && ppu->mode == PPU_OAMSCAN)
+        ppu_fallback(ppu);
+}
+
 static inline void
 ppu_write_lcdc(ppu_t *ppu, uint8_t val)
 {
+    /* the line so far was drawn with the old value */
+    ppu_line_write(ppu);
+    ppu_scan_write(ppu);
+
     /* if LCD is turned off, reset it for good */
     if (!LCDC_PPU_ENABLE(val)) {
         ppu->ly = 0;
@@ -550,10 +1114,49 @@ ppu_write_lcdc(ppu_t *ppu, uint8_t val)
     }
 
     /* set normal LCDC */
+    if (LCDC_PPU_ENABLE(val) != LCDC_PPU_ENABLE(ppu->lcdc))
+        soc_bus_transition(ppu->soc);
     ppu->lcdc = val;
 }
 
+/* whether the PPU leaves VRAM alone for the given cycles. it only reads it in
+ * RENDER, which is at least a whole OAMSCAN (80 cycles) away from HBLANK and
+ * VBLANK */
+static inline bool
+ppu_vram_idle(ppu_t *ppu, unsigned cycles)
+{
+    if (!LCDC_PPU_ENABLE(ppu->lcdc))
+        return true;
+
+    return (ppu->mode == PPU_HBLANK || ppu->mode == PPU_VBLANK) &&
+        cycles <= 80;
+}
+
+/* to be called whenever VRAM is written to */
+static inline void
+ppu_vram_write(ppu_t *ppu, uint16_t addr)
+{
+    unsigned tile = (addr & 0x1FFF) >> 4;
+    if (tile < PPU_TILES)
+        ppu->tiles.dirty[tile / 64] |= (uint64_t)1 << (tile % 64);
+}
+
+static inline void
+ppu_write_palette(ppu_t *ppu, uint8_t *reg, uint8_t *shades, uint8_t val)
+{
+    /* the line so far was drawn with the old palette */
+    ppu_line_write(ppu);
+
+    *reg = val;
+    for (size_t i = 0; i < 4; ++i)
+        shades[i] = (val >> (i * 2)) & 0x03;
+}
+
+unsigned ppu_next_event(ppu_t *ppu);
+unsigned ppu_next_change(ppu_t *ppu);
+void ppu_skip(ppu_t *ppu, unsigned cycles);
 void ppu_cycle(ppu_t *ppu);
+void ppu_blit(ppu_t *ppu, void *dst, size_t pitch);
 void ppu_init(ppu_t *ppu, soc_t *soc);
 
 /*
@@ -597,12 +1200,25 @@ tim_write_tac(tim_t *tim, uint8_t val)
     tim->tac = val | 0xF8;
 }
 
+unsigned tim_next_event(tim_t *tim);
+unsigned tim_next_tick(tim_t *tim);
+unsigned tim_next_div(tim_t *tim);
+unsigned tim_next_irq(tim_t *tim);
+void tim_skip(tim_t *tim, unsigned cycles);
 void tim_cycle(tim_t *tim);
 void tim_init(tim_t *tim, soc_t *soc);
 
 /*
  *      ** JOYPAD **
  */
+static inline unsigned
+jp_next_event(jp_t *jp)
+{
+    /* the joypad only reacts to the buttons, which the frontend changes in
+     * between steps (and every step starts with a CPU cycle) */
+    return NO_EVENT;
+}
+
 uint8_t jp_read(jp_t *jp);
 void jp_write(jp_t *jp, uint8_t val);
 void jp_cycle(jp_t *jp);
@@ -19,6 +19,76 @@ _get_freq_bit(uint8_t clock)
     }
 }
 
+static inline bool
+_tim_busy(tim_t *tim)
+{
+    /* anything that isn't plain counting is handled one cycle at a time */
+    return tim->div_write || tim->tima_write || tim->overflow ||
+        tim->tima_writes_ignored || tim->old_tac != tim->tac;
+}
+
+unsigned
+tim_next_tick(tim_t *tim)
+{
+    if (_tim_busy(tim))
+        return 0;
+
+    /* a disabled timer just counts SYS */
+    if (!TAC_ENABLE(tim->tac))
+        return NO_EVENT;
+
+    /* TIMA ticks on the cycle where the selected bit falls, which happens
+     * when the bit itself and all the bits below it are set */
+    unsigned bit = _get_freq_bit(TAC_CLOCK(tim->tac)) + 1;
+    uint16_t mask = MASK(bit);
+    return mask - (tim->sys & mask);
+}
+
+unsigned
+tim_next_div(tim_t *tim)
+{
+    if (tim->div_write)
+        return 0;
+
+    /* DIV is the upper byte of SYS */
+    return 0xFF - (tim->sys & 0xFF);
+}
+
+unsigned
+tim_next_event(tim_t *tim)
+{
+    /* the ticks before the overflow are plain increments that tim_skip() can
+     * do by itself, so only the overflowing one needs to be run */
+    unsigned next = tim_next_tick(tim);
+    if (!next || next == NO_EVENT)
+        return next;
+
+    unsigned bit = _get_freq_bit(TAC_CLOCK(tim->tac)) + 1;
+    return next + (0xFF - tim->tima) * (1 << bit);
+}
+
+unsigned
+tim_next_irq(tim_t *tim)
+{
+    /* the interrupt comes after the overflow, which is the timer's next event.
+     * nothing can be predicted while the timer is busy (or disabled) */
+    return tim_next_event(tim);
+}
+
+void
+tim_skip(tim_t *tim, unsigned cycles)
+{
+    /* TIMA ticks on every falling edge of the selected bit in between. they
+     * never overflow (see tim_next_event) */
+    if (TAC_ENABLE(tim->tac)) {
+        unsigned bit = _get_freq_bit(TAC_CLOCK(tim->tac)) + 1;
+        unsigned sys = tim->sys;
+        tim->tima += ((sys + cycles) >> bit) - (sys >> bit);
+    }
+
+    tim->sys += cycles;
+}
+
 void
 tim_cycle(tim_t *tim)
 {